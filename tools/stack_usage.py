@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+  @file    stack_usage.py
+  @version 0.5.0
+  @author  Adam Mitchell
+  @brief   Collect the stack used by each public call of the Thingpilot NB-IoT
+           interface from a build with -fstack-usage. With GCC 10 or later
+           -fcallgraph-info=su also gives the call graph, from which the worst
+           case of each call, including everything it calls, is reported
+
+  Usage: python3 tools/stack_usage.py <build directory> [class or prefix ...]
+
+  Build with e.g. mbed compile --profile release.json, with "-fstack-usage"
+  (and "-fcallgraph-info=su" if supported) added to the cxx flags. Figures
+  marked + include a call to a function whose frame is unknown, i.e. one in
+  a library built without the flags or a call through a pointer, or recursion
+"""
+
+import os
+import re
+import sys
+
+SU_LINE = re.compile(r'^(?:.*?:\d+:\d+:)?(?P<name>.+)\t(?P<bytes>\d+)\t(?P<kind>\S+)$')
+CI_NODE = re.compile(r'node: \{ title: "(?P<title>[^"]+)" label: "(?P<label>[^"]*)"')
+CI_EDGE = re.compile(r'edge: \{ sourcename: "(?P<source>[^"]+)" targetname: "(?P<target>[^"]+)"')
+CI_BYTES = re.compile(r'\\n(?P<bytes>\d+) bytes \((?P<kind>[^)]+)\)')
+
+
+def is_member(name, prefixes):
+    """ Return whether the function, as named by GCC with its return type,
+        is a member of one of the classes
+    """
+    return any(re.search(r'(^|[\s*&])' + re.escape(prefix), name) for prefix in prefixes)
+
+
+def read_build(directory):
+    """ Return the frame of each function, by name, and its kind as reported
+        by GCC, and if .ci files were found the call graph keyed by title
+    """
+    frames = {}
+    names = {}
+    calls = {}
+
+    for root, _, files in os.walk(directory):
+        for file in files:
+            path = os.path.join(root, file)
+
+            if file.endswith('.su'):
+                with open(path) as su:
+                    for line in su:
+                        match = SU_LINE.match(line.rstrip('\n'))
+                        if match:
+                            frames[match['name']] = (int(match['bytes']), match['kind'])
+
+            elif file.endswith('.ci'):
+                with open(path) as ci:
+                    for line in ci:
+                        node = CI_NODE.search(line)
+                        if node:
+                            names[node['title']] = node['label'].split('\\n')[0]
+                            size = CI_BYTES.search(node['label'])
+                            if size:
+                                frames[names[node['title']]] = (int(size['bytes']), size['kind'])
+                            continue
+
+                        edge = CI_EDGE.search(line)
+                        if edge:
+                            calls.setdefault(edge['source'], set()).add(edge['target'])
+
+    return frames, names, calls
+
+
+def worst_case(title, frames, names, calls, seen, memo):
+    """ Return the worst case stack of a function and every function it calls,
+        and whether any part of it is unknown
+    """
+    if title in memo:
+        return memo[title]
+
+    if title in seen:
+        return 0, True
+
+    frame = frames.get(names.get(title, title))
+    own, unknown = (frame[0], frame[1] != 'static') if frame else (0, True)
+
+    seen.add(title)
+    deepest = 0
+    for callee in calls.get(title, ()):
+        depth, callee_unknown = worst_case(callee, frames, names, calls, seen, memo)
+        deepest = max(deepest, depth)
+        unknown = unknown or callee_unknown
+    seen.discard(title)
+
+    memo[title] = (own + deepest, unknown)
+    return memo[title]
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip().split('\n\n')[1])
+        return 1
+
+    prefixes = tuple(name + '::' for name in sys.argv[2:]) or ('TP_NBIoT_Interface::', 'TP_NBIoT_Gateway::')
+    frames, names, calls = read_build(sys.argv[1])
+
+    if not frames:
+        print('No .su or .ci files found in %s, build with -fstack-usage' % sys.argv[1])
+        return 1
+
+    memo = {}
+    rows = []
+    if names:
+        for title, name in names.items():
+            if is_member(name, prefixes) and name in frames:
+                depth, unknown = worst_case(title, frames, names, calls, set(), memo)
+                rows.append((name, frames[name][0], '%d%s' % (depth, '+' if unknown else '')))
+    else:
+        for name, (size, kind) in frames.items():
+            if is_member(name, prefixes):
+                rows.append((name, size, '%d+' % size if kind != 'static' else '-'))
+
+    print('%-80s %8s %10s' % ('Function', 'Frame', 'Worst case'))
+    for name, size, depth in sorted(rows):
+        print('%-80s %8d %10s' % (name[:80], size, depth))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,361 @@
+/**
+  * @file    tp_coap_message.cpp
+  * @version 0.5.0
+  * @author  Adam Mitchell
+  * @brief   C++ file of a compact CoAP (RFC 7252) message encoder and parser, used to
+  *          frame datagrams sent over the raw UDP socket path of TP_NBIoT_Interface
+  */
+
+/** Includes
+ */
+#include "tp_coap_message.h"
+#include <string.h>
+
+/** Constructor for the TP_CoAP_Message class
+ *
+ * @param *buffer Pointer to the buffer into which the message is written
+ * @param capacity Capacity of buffer in bytes
+ */
+TP_CoAP_Message::TP_CoAP_Message(uint8_t *buffer, size_t capacity) : _buffer(buffer), _capacity(capacity)
+{
+
+}
+
+/** Start a new message, discarding anything already written
+ *
+ * @param type Message type
+ * @param code Request method or response code
+ * @param message_id Message ID
+ * @param *token Pointer to token, may be NULL if token_length is 0
+ * @param token_length Token length, no greater than 8
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::begin(TP_CoAP_Type type, uint8_t code, uint16_t message_id,
+						   const uint8_t *token, uint8_t token_length)
+{
+	if(token_length > 8)
+	{
+		return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+	}
+
+	_length = 0;
+	_last_option = 0;
+	_payload_set = false;
+
+	if(_capacity < 4 + (size_t)token_length)
+	{
+		return TP_CoAP_Message::COAP_BUFFER_TOO_SMALL;
+	}
+
+	_buffer[0] = (uint8_t)(0x40 | ((uint8_t)type << 4) | token_length);
+	_buffer[1] = code;
+	_buffer[2] = (uint8_t)(message_id >> 8);
+	_buffer[3] = (uint8_t)message_id;
+
+	if(token_length > 0)
+	{
+		memcpy(&_buffer[4], token, token_length);
+	}
+
+	_length = 4 + token_length;
+
+	return TP_CoAP_Message::COAP_OK;
+}
+
+/** Append an option
+ *
+ * @param number Option number, no less than that of the previous option
+ * @param *value Pointer to option value
+ * @param length Length of option value
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::add_option(uint16_t number, const uint8_t *value, size_t length)
+{
+	if(_length == 0 || _payload_set || number < _last_option)
+	{
+		return TP_CoAP_Message::COAP_OPTION_ORDER;
+	}
+
+	if(length > 0xFFFF)
+	{
+		return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+	}
+
+	uint16_t delta = number - _last_option;
+	size_t start = _length;
+
+	if(_length >= _capacity)
+	{
+		return TP_CoAP_Message::COAP_BUFFER_TOO_SMALL;
+	}
+
+	_buffer[_length++] = (uint8_t)((nibble(delta) << 4) | nibble((uint16_t)length));
+
+	if(write_extended(delta) != TP_CoAP_Message::COAP_OK ||
+	   write_extended((uint16_t)length) != TP_CoAP_Message::COAP_OK ||
+	   _capacity - _length < length)
+	{
+		_length = start;
+		return TP_CoAP_Message::COAP_BUFFER_TOO_SMALL;
+	}
+
+	if(length > 0)
+	{
+		memcpy(&_buffer[_length], value, length);
+		_length += length;
+	}
+
+	_last_option = number;
+
+	return TP_CoAP_Message::COAP_OK;
+}
+
+/** Append an option with an unsigned integer value, encoded in as
+ *  few bytes as possible
+ *
+ * @param number Option number, no less than that of the previous option
+ * @param value Option value
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::add_option_uint(uint16_t number, uint32_t value)
+{
+	uint8_t bytes[4];
+	size_t length = 0;
+
+	for(int shift = 24; shift >= 0; shift -= 8)
+	{
+		if(length > 0 || (value >> shift) != 0)
+		{
+			bytes[length++] = (uint8_t)(value >> shift);
+		}
+	}
+
+	return add_option(number, bytes, length);
+}
+
+/** Append one Uri-Path option per segment of path, i.e. "sensors/temp"
+ *
+ * @param *path Pointer to null terminated path, a leading '/' is ignored
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::add_uri_path(const char *path)
+{
+	if(*path == '/')
+	{
+		path++;
+	}
+
+	while(*path != '\0')
+	{
+		const char *end = strchr(path, '/');
+		size_t length = end == NULL ? strlen(path) : (size_t)(end - path);
+
+		int status = add_option(TP_CoAP_Message::OPTION_URI_PATH, (const uint8_t *)path, length);
+		if(status != TP_CoAP_Message::COAP_OK)
+		{
+			return status;
+		}
+
+		path += length;
+		if(*path == '/')
+		{
+			path++;
+		}
+	}
+
+	return TP_CoAP_Message::COAP_OK;
+}
+
+/** Append the payload marker and payload. Nothing may be added afterwards
+ *
+ * @param *data Pointer to payload
+ * @param length Length of payload
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::set_payload(const uint8_t *data, size_t length)
+{
+	if(_length == 0 || _payload_set)
+	{
+		return TP_CoAP_Message::COAP_OPTION_ORDER;
+	}
+
+	/** An empty payload is sent without the marker
+	 */
+	if(length == 0)
+	{
+		_payload_set = true;
+		return TP_CoAP_Message::COAP_OK;
+	}
+
+	if(_capacity - _length < length + 1)
+	{
+		return TP_CoAP_Message::COAP_BUFFER_TOO_SMALL;
+	}
+
+	_buffer[_length++] = 0xFF;
+	memcpy(&_buffer[_length], data, length);
+	_length += length;
+	_payload_set = true;
+
+	return TP_CoAP_Message::COAP_OK;
+}
+
+/** Length of the message written so far
+ *
+ * @return Length in bytes
+ */
+size_t TP_CoAP_Message::length() const
+{
+	return _length;
+}
+
+/** Message written so far
+ *
+ * @return Pointer to the start of the message
+ */
+const uint8_t *TP_CoAP_Message::data() const
+{
+	return _buffer;
+}
+
+/** Parse a received message without copying its payload
+ *
+ * @param *data Pointer to received message
+ * @param length Length of received message
+ * @param &header Address of TP_CoAP_Header in which to store fixed header fields
+ * @param *&payload Address of pointer set to the payload within data,
+ *                  NULL if there is none
+ * @param &payload_length Address of size_t in which to store payload length
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::parse(const uint8_t *data, size_t length, TP_CoAP_Header &header,
+						   const uint8_t *&payload, size_t &payload_length)
+{
+	payload = NULL;
+	payload_length = 0;
+
+	if(length < 4 || (data[0] >> 6) != 1)
+	{
+		return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+	}
+
+	header.type = (TP_CoAP_Type)((data[0] >> 4) & 0x03);
+	header.token_length = data[0] & 0x0F;
+	header.code = data[1];
+	header.message_id = (uint16_t)((data[2] << 8) | data[3]);
+
+	if(header.token_length > 8 || length < 4 + (size_t)header.token_length)
+	{
+		return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+	}
+
+	memcpy(header.token, &data[4], header.token_length);
+
+	/** Skip the options, only their lengths are needed to find the payload
+	 */
+	size_t index = 4 + header.token_length;
+
+	while(index < length && data[index] != 0xFF)
+	{
+		uint8_t delta = data[index] >> 4;
+		size_t option_length = data[index] & 0x0F;
+		index++;
+
+		if(delta == 15 || option_length == 15)
+		{
+			return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+		}
+
+		index += delta == 13 ? 1 : (delta == 14 ? 2 : 0);
+
+		if(option_length == 13)
+		{
+			if(index >= length)
+			{
+				return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+			}
+
+			option_length = data[index++] + 13;
+		}
+		else if(option_length == 14)
+		{
+			if(index + 1 >= length)
+			{
+				return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+			}
+
+			option_length = ((data[index] << 8) | data[index + 1]) + 269;
+			index += 2;
+		}
+
+		index += option_length;
+		if(index > length)
+		{
+			return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+		}
+	}
+
+	if(index < length)
+	{
+		/** A payload marker must be followed by a payload
+		 */
+		if(index + 1 == length)
+		{
+			return TP_CoAP_Message::COAP_INVALID_MESSAGE;
+		}
+
+		payload = &data[index + 1];
+		payload_length = length - index - 1;
+	}
+
+	return TP_CoAP_Message::COAP_OK;
+}
+
+/** Write an option delta or length nibble's extended bytes
+ *
+ * @param value Delta or length
+ * @return Indicates success or failure reason
+ */
+int TP_CoAP_Message::write_extended(uint16_t value)
+{
+	if(value < 13)
+	{
+		return TP_CoAP_Message::COAP_OK;
+	}
+
+	if(value < 269)
+	{
+		if(_length >= _capacity)
+		{
+			return TP_CoAP_Message::COAP_BUFFER_TOO_SMALL;
+		}
+
+		_buffer[_length++] = (uint8_t)(value - 13);
+		return TP_CoAP_Message::COAP_OK;
+	}
+
+	if(_capacity - _length < 2)
+	{
+		return TP_CoAP_Message::COAP_BUFFER_TOO_SMALL;
+	}
+
+	_buffer[_length++] = (uint8_t)((value - 269) >> 8);
+	_buffer[_length++] = (uint8_t)(value - 269);
+
+	return TP_CoAP_Message::COAP_OK;
+}
+
+/** Nibble encoding a delta or length, 13 and 14 indicating extended bytes
+ *
+ * @param value Delta or length
+ * @return Nibble
+ */
+uint8_t TP_CoAP_Message::nibble(uint16_t value)
+{
+	if(value < 13)
+	{
+		return (uint8_t)value;
+	}
+
+	return value < 269 ? 13 : 14;
+}
@@ -0,0 +1,184 @@
+/**
+  * @file    tp_coap_message.h
+  * @version 0.5.0
+  * @author  Adam Mitchell
+  * @brief   Header file of a compact CoAP (RFC 7252) message encoder and parser, used to
+  *          frame datagrams sent over the raw UDP socket path of TP_NBIoT_Interface
+  */
+
+/** Define to prevent recursive inclusion
+ */
+#pragma once
+
+/** Includes
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/** Writes a single CoAP message directly into a caller-supplied buffer. Options
+ *  must be added in increasing option number order, followed by the payload
+ */
+class TP_CoAP_Message
+{
+
+	public:
+
+		/** Function return codes
+		 */
+		enum
+		{
+			COAP_OK               = 0,
+			COAP_BUFFER_TOO_SMALL = 80,
+			COAP_OPTION_ORDER     = 81,
+			COAP_INVALID_MESSAGE  = 82
+		};
+
+		/** Message types
+		 */
+		enum class TP_CoAP_Type
+		{
+			CON = 0,
+			NON = 1,
+			ACK = 2,
+			RST = 3
+		};
+
+		/** Request method codes, class 0
+		 */
+		enum
+		{
+			COAP_EMPTY  = 0x00,
+			COAP_GET    = 0x01,
+			COAP_POST   = 0x02,
+			COAP_PUT    = 0x03,
+			COAP_DELETE = 0x04
+		};
+
+		/** Option numbers
+		 */
+		enum
+		{
+			OPTION_URI_HOST       = 3,
+			OPTION_OBSERVE        = 6,
+			OPTION_URI_PORT       = 7,
+			OPTION_URI_PATH       = 11,
+			OPTION_CONTENT_FORMAT = 12,
+			OPTION_MAX_AGE        = 14,
+			OPTION_URI_QUERY      = 15,
+			OPTION_ACCEPT         = 17,
+			OPTION_BLOCK2         = 23,
+			OPTION_BLOCK1         = 27,
+			OPTION_SIZE1          = 60
+		};
+
+		/** Fixed header fields of a parsed message. code is as sent, i.e.
+		 *  class in bits 7 to 5 and detail in bits 4 to 0, so 2.05 is 0x45
+		 */
+		struct TP_CoAP_Header
+		{
+			TP_CoAP_Type type;
+			uint8_t code;
+			uint16_t message_id;
+			uint8_t token[8];
+			uint8_t token_length;
+		};
+
+		/** Constructor for the TP_CoAP_Message class
+		 *
+		 * @param *buffer Pointer to the buffer into which the message is written
+		 * @param capacity Capacity of buffer in bytes
+		 */
+		TP_CoAP_Message(uint8_t *buffer, size_t capacity);
+
+		/** Start a new message, discarding anything already written
+		 *
+		 * @param type Message type
+		 * @param code Request method or response code
+		 * @param message_id Message ID
+		 * @param *token Pointer to token, may be NULL if token_length is 0
+		 * @param token_length Token length, no greater than 8
+		 * @return Indicates success or failure reason
+		 */
+		int begin(TP_CoAP_Type type, uint8_t code, uint16_t message_id,
+				  const uint8_t *token = NULL, uint8_t token_length = 0);
+
+		/** Append an option
+		 *
+		 * @param number Option number, no less than that of the previous option
+		 * @param *value Pointer to option value
+		 * @param length Length of option value
+		 * @return Indicates success or failure reason
+		 */
+		int add_option(uint16_t number, const uint8_t *value, size_t length);
+
+		/** Append an option with an unsigned integer value, encoded in as
+		 *  few bytes as possible
+		 *
+		 * @param number Option number, no less than that of the previous option
+		 * @param value Option value
+		 * @return Indicates success or failure reason
+		 */
+		int add_option_uint(uint16_t number, uint32_t value);
+
+		/** Append one Uri-Path option per segment of path, i.e. "sensors/temp"
+		 *
+		 * @param *path Pointer to null terminated path, a leading '/' is ignored
+		 * @return Indicates success or failure reason
+		 */
+		int add_uri_path(const char *path);
+
+		/** Append the payload marker and payload. Nothing may be added afterwards
+		 *
+		 * @param *data Pointer to payload
+		 * @param length Length of payload
+		 * @return Indicates success or failure reason
+		 */
+		int set_payload(const uint8_t *data, size_t length);
+
+		/** Length of the message written so far
+		 *
+		 * @return Length in bytes
+		 */
+		size_t length() const;
+
+		/** Message written so far
+		 *
+		 * @return Pointer to the start of the message
+		 */
+		const uint8_t *data() const;
+
+		/** Parse a received message without copying its payload
+		 *
+		 * @param *data Pointer to received message
+		 * @param length Length of received message
+		 * @param &header Address of TP_CoAP_Header in which to store fixed header fields
+		 * @param *&payload Address of pointer set to the payload within data,
+		 *                  NULL if there is none
+		 * @param &payload_length Address of size_t in which to store payload length
+		 * @return Indicates success or failure reason
+		 */
+		static int parse(const uint8_t *data, size_t length, TP_CoAP_Header &header,
+						 const uint8_t *&payload, size_t &payload_length);
+
+	private:
+
+		/** Write an option delta or length nibble's extended bytes
+		 *
+		 * @param value Delta or length
+		 * @return Indicates success or failure reason
+		 */
+		int write_extended(uint16_t value);
+
+		/** Nibble encoding a delta or length, 13 and 14 indicating extended bytes
+		 *
+		 * @param value Delta or length
+		 * @return Nibble
+		 */
+		static uint8_t nibble(uint16_t value);
+
+		uint8_t *_buffer;
+		size_t _capacity;
+		size_t _length = 0;
+		uint16_t _last_option = 0;
+		bool _payload_set = false;
+};
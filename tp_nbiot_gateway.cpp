@@ -0,0 +1,484 @@
+/**
+  * @file    tp_nbiot_gateway.cpp
+  * @version 0.5.0
+  * @author  Adam Mitchell
+  * @brief   C++ file of the gateway front end to several NB-IoT modules. Attaches
+  *          them concurrently and spreads uplinks across them by load and signal,
+  *          failing over from modules that stop responding
+  */
+
+/** Includes
+ */
+#include "tp_nbiot_gateway.h"
+
+#if (BOARD == WRIGHT_V1_0_0 || BOARD == DEVELOPMENT_BOARD_V1_1_0) && TP_NBIOT_ASYNC /* #endif at EoF */
+
+/** Module masks are held in 32-bit words and EventFlags reserves the top bit
+ */
+static_assert(TP_NBIOT_GATEWAY_MAX_MODEMS <= 31, "TP_NBIOT_GATEWAY_MAX_MODEMS must be no greater than 31");
+
+/** Constructor for the TP_NBIoT_Gateway class
+ *
+ * @param **modems Pointer to an array of interfaces, one per module,
+ *                 which must outlive the gateway
+ * @param count Number of interfaces, modules beyond
+ *              TP_NBIOT_GATEWAY_MAX_MODEMS are ignored
+ */
+TP_NBIoT_Gateway::TP_NBIoT_Gateway(TP_NBIoT_Interface **modems, size_t count)
+{
+	_count = count < TP_NBIOT_GATEWAY_MAX_MODEMS ? count : TP_NBIOT_GATEWAY_MAX_MODEMS;
+
+	for(size_t i = 0; i < _count; i++)
+	{
+		_modems[i].gateway = this;
+		_modems[i].interface = modems[i];
+		_modems[i].index = i;
+		_modems[i].state = TP_Modem_State::DOWN;
+		_modems[i].failures = 0;
+		_modems[i].retry_ms = 0;
+	}
+}
+
+/** Start every module at the same time, returning once all of them
+ *  have attached or failed, or timeout_s has passed. Modules that
+ *  fail are retried by poll()
+ *
+ * @param timeout_s Timeout period in seconds
+ * @param &attached Address of size_t in which to store the number of
+ *                  modules attached
+ * @return Indicates success or failure reason, FAIL_TO_CONNECT if no
+ *         module attached
+ */
+int TP_NBIoT_Gateway::start(uint16_t timeout_s, size_t &attached)
+{
+	uint32_t starting = 0;
+
+	_start_timeout_s = timeout_s;
+	_start_flags.clear();
+
+	for(size_t i = 0; i < _count; i++)
+	{
+		if(start_modem(i, timeout_s) == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			starting |= (1UL << i);
+		}
+	}
+
+	/** Each module's start() times out by itself, the margin covers the
+	 *  reboot it may begin with
+	 */
+	if(starting != 0)
+	{
+		_start_flags.wait_all(starting, (uint32_t)timeout_s * 1000 + 30000);
+	}
+
+	ScopedLock<Mutex> lock(_mutex);
+
+	attached = 0;
+
+	for(size_t i = 0; i < _count; i++)
+	{
+		if(_modems[i].state == TP_Modem_State::UP)
+		{
+			attached++;
+		}
+	}
+
+	return attached > 0 ? TP_NBIoT_Interface::NBIOT_OK : TP_NBIoT_Interface::FAIL_TO_CONNECT;
+}
+
+/** Queue a POST request using CoAP on the module with the lowest
+ *  cost, that is the fewest queued requests and best signal. If the
+ *  module fails the request, it is sent again on another
+ *
+ * @param *send_data Pointer to a byte array containing the data to be
+ *                   sent to the server. Must remain valid until the
+ *                   callback is called
+ * @param buffer_len Number of bytes to send
+ * @param *recv_data Pointer to a byte array where the data returned
+ *                   from the server will be stored. Must remain valid
+ *                   until the callback is called
+ * @param data_intenfier Integer value representing the data format
+ *                       type, i.e. TEXT_PLAIN
+ * @param cb Callback to be called on completion
+ * @param &handle Address of integer in which to store the handle that
+ *                identifies this request in TP_Gateway_Result
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Gateway::coap_post_async(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
+									  TP_Gateway_Callback cb, uint32_t &handle)
+{
+	#if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0
+		if(buffer_len > TP_NBIOT_ASYNC_PAYLOAD_SIZE)
+		{
+			return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+		}
+	#endif /* #if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0 */
+
+	ScopedLock<Mutex> lock(_mutex);
+
+	for(size_t i = 0; i < TP_NBIOT_GATEWAY_QUEUE_DEPTH; i++)
+	{
+		TP_Gateway_Request &request = _requests[i];
+
+		if(request.used)
+		{
+			continue;
+		}
+
+		request.handle = _next_handle++;
+		if(_next_handle == 0)
+		{
+			_next_handle = 1;
+		}
+
+		request.attempts = 0;
+		request.tried = 0;
+		request.send_data = send_data;
+		request.buffer_len = buffer_len;
+		request.recv_data = recv_data;
+		request.data_indentifier = data_indentifier;
+		request.cb = cb;
+
+		int status = submit(request);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			request.cb = TP_Gateway_Callback();
+			return status;
+		}
+
+		request.used = true;
+		_pending++;
+		handle = request.handle;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::QUEUE_FULL;
+}
+
+/** Restart modules that are down once their retry time has passed.
+ *  Should be called periodically
+ *
+ * @return Number of modules restarted
+ */
+size_t TP_NBIoT_Gateway::poll()
+{
+	size_t restarted = 0;
+	uint64_t now = Kernel::get_ms_count();
+
+	for(size_t i = 0; i < _count; i++)
+	{
+		bool retry = false;
+
+		{
+			ScopedLock<Mutex> lock(_mutex);
+			retry = _modems[i].state == TP_Modem_State::DOWN && now >= _modems[i].retry_ms;
+		}
+
+		if(retry && start_modem(i, _start_timeout_s) == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			restarted++;
+		}
+	}
+
+	return restarted;
+}
+
+/** Return the state of a module
+ *
+ * @param modem Index of module
+ * @param &state Address of TP_Modem_State in which to store its state
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Gateway::get_modem_state(size_t modem, TP_Modem_State &state)
+{
+	ScopedLock<Mutex> lock(_mutex);
+
+	if(modem >= _count)
+	{
+		return TP_NBIoT_Gateway::INVALID_MODEM;
+	}
+
+	state = _modems[modem].state;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Return the number of requests queued and not yet completed
+ *
+ * @return Number of outstanding requests
+ */
+uint32_t TP_NBIoT_Gateway::pending()
+{
+	ScopedLock<Mutex> lock(_mutex);
+
+	return _pending;
+}
+
+/** Completion of start_async(). Runs on the module's worker, which 
+ *  reads the module's signal once it has attached so that it can be 
+ *  ranked
+ *
+ * @param &result Outcome of start()
+ * @return None
+ */
+void TP_NBIoT_Gateway::TP_Gateway_Modem::started(const TP_NBIoT_Interface::TP_Async_Result &result)
+{
+	if(result.status == TP_NBIoT_Interface::NBIOT_OK)
+	{
+		int power = 0;
+		int quality = 0;
+		interface->get_csq(power, quality);
+	}
+
+	gateway->on_started(index, result.status);
+}
+
+/** Completion of coap_post_async(). Runs on the module's worker, 
+ *  which reads the module's signal again after a successful uplink,
+ *  while it is still awake
+ *
+ * @param &result Outcome of the request
+ * @return None
+ */
+void TP_NBIoT_Gateway::TP_Gateway_Modem::completed(const TP_NBIoT_Interface::TP_Async_Result &result)
+{
+	gateway->on_completed(index, result);
+
+	/** Read after the application's callback so as not to delay it, the
+	 *  snapshot being what select_modem() ranks modules by
+	 */
+	if(result.status == TP_NBIoT_Interface::NBIOT_OK)
+	{
+		int power = 0;
+		int quality = 0;
+		interface->get_csq(power, quality);
+	}
+}
+
+/** Queue start() on a module
+ *
+ * @param modem Index of module
+ * @param timeout_s Timeout period in seconds
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Gateway::start_modem(size_t modem, uint16_t timeout_s)
+{
+	TP_Gateway_Modem &entry = _modems[modem];
+	uint32_t handle = 0;
+
+	{
+		ScopedLock<Mutex> lock(_mutex);
+		entry.state = TP_Modem_State::STARTING;
+	}
+
+	/** start_async() only queues the request. A failure to queue it is 
+	 *  recorded here, outside the lock, as on_started() takes it
+	 */
+	int status = entry.interface->start_async(timeout_s, callback(&entry, &TP_Gateway_Modem::started), handle);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		on_started(modem, status);
+	}
+
+	return status;
+}
+
+/** Choose the module with the lowest cost that has not been tried
+ *
+ * @param tried Bit n set to exclude module n
+ * @param &modem Address of size_t in which to store module index
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Gateway::select_modem(uint32_t tried, size_t &modem)
+{
+	bool found = false;
+	int32_t best = 0;
+
+	for(size_t i = 0; i < _count; i++)
+	{
+		if(_modems[i].state != TP_Modem_State::UP || (tried & (1UL << i)))
+		{
+			continue;
+		}
+
+		uint32_t queued = _modems[i].interface->async_pending();
+		if(queued >= TP_NBIOT_ASYNC_QUEUE_DEPTH)
+		{
+			continue;
+		}
+
+		/** AT+CSQ signal power, 0 to 31, or 99 if unknown. A module whose
+		 *  signal isn't known is ranked as if it had none
+		 */
+		TP_NBIoT_Interface::TP_Connection_Snapshot snapshot;
+		_modems[i].interface->get_connection_snapshot(snapshot);
+
+		int32_t signal = snapshot.radio_valid && snapshot.rsrp != 99 ? snapshot.rsrp : 0;
+		int32_t cost = (int32_t)queued * TP_NBIOT_GATEWAY_LOAD_WEIGHT - signal;
+
+		if(!found || cost < best)
+		{
+			found = true;
+			best = cost;
+			modem = i;
+		}
+	}
+
+	if(!found)
+	{
+		return TP_NBIoT_Gateway::NO_MODEM_AVAILABLE;
+	}
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Send a request to the cheapest module that accepts it
+ *
+ * @param &request Address of request
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Gateway::submit(TP_Gateway_Request &request)
+{
+	size_t modem = 0;
+
+	while(select_modem(request.tried, modem) == TP_NBIoT_Interface::NBIOT_OK)
+	{
+		request.tried |= (1UL << modem);
+
+		int status = _modems[modem].interface->coap_post_async(request.send_data, request.buffer_len,
+															   request.recv_data, request.data_indentifier, 0, 0,
+															   callback(&_modems[modem], &TP_Gateway_Modem::completed),
+															   request.modem_handle);
+		if(status == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			request.modem = modem;
+			request.attempts++;
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+	}
+
+	return TP_NBIoT_Gateway::NO_MODEM_AVAILABLE;
+}
+
+/** Record the outcome of start() on a module
+ *
+ * @param modem Index of module
+ * @param status Outcome of start()
+ * @return None
+ */
+void TP_NBIoT_Gateway::on_started(size_t modem, int status)
+{
+	{
+		ScopedLock<Mutex> lock(_mutex);
+
+		TP_Gateway_Modem &entry = _modems[modem];
+
+		if(status == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			entry.state = TP_Modem_State::UP;
+			entry.failures = 0;
+		}
+		else
+		{
+			entry.state = TP_Modem_State::DOWN;
+			entry.retry_ms = Kernel::get_ms_count() + (uint64_t)TP_NBIOT_GATEWAY_RETRY_S * 1000;
+		}
+	}
+
+	_start_flags.set(1UL << modem);
+}
+
+/** Complete a request, failing over to another module if necessary
+ *
+ * @param modem Index of module
+ * @param &result Outcome of the request on that module
+ * @return None
+ */
+void TP_NBIoT_Gateway::on_completed(size_t modem, const TP_NBIoT_Interface::TP_Async_Result &result)
+{
+	TP_Gateway_Callback cb;
+	TP_Gateway_Result outcome;
+
+	{
+		/** The submitting thread holds the lock until modem_handle has been
+		 *  stored, so a request that completes straight away is still found
+		 */
+		ScopedLock<Mutex> lock(_mutex);
+
+		TP_Gateway_Request *request = NULL;
+
+		for(size_t i = 0; i < TP_NBIOT_GATEWAY_QUEUE_DEPTH; i++)
+		{
+			if(_requests[i].used && _requests[i].modem == modem && _requests[i].modem_handle == result.handle)
+			{
+				request = &_requests[i];
+				break;
+			}
+		}
+
+		if(request == NULL)
+		{
+			return;
+		}
+
+		/** A CoAP error response comes from the server, so only a failed
+		 *  exchange with the module is held against it
+		 */
+		if(result.status == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			_modems[modem].failures = 0;
+		}
+		else
+		{
+			modem_failed(modem);
+
+			if(submit(*request) == TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return;
+			}
+		}
+
+		outcome.handle = request->handle;
+		outcome.modem = modem;
+		outcome.status = result.status;
+		outcome.response_code = result.response_code;
+		outcome.attempts = request->attempts;
+
+		cb = request->cb;
+		request->cb = TP_Gateway_Callback();
+		request->used = false;
+		_pending--;
+	}
+
+	if(cb)
+	{
+		cb(outcome);
+	}
+}
+
+/** Count a failed request against a module, taking it out of use
+ *  after too many
+ *
+ * @param modem Index of module
+ * @return None
+ */
+void TP_NBIoT_Gateway::modem_failed(size_t modem)
+{
+	TP_Gateway_Modem &entry = _modems[modem];
+
+	if(entry.failures < UINT8_MAX)
+	{
+		entry.failures++;
+	}
+
+	if(entry.failures >= TP_NBIOT_GATEWAY_MAX_FAILURES && entry.state == TP_Modem_State::UP)
+	{
+		entry.state = TP_Modem_State::DOWN;
+		entry.retry_ms = Kernel::get_ms_count() + (uint64_t)TP_NBIOT_GATEWAY_RETRY_S * 1000;
+	}
+}
+
+#endif /* #if (BOARD == WRIGHT_V1_0_0 || BOARD == DEVELOPMENT_BOARD_V1_1_0) && TP_NBIOT_ASYNC */
@@ -0,0 +1,273 @@
+/**
+  * @file    tp_nbiot_gateway.h
+  * @version 0.5.0
+  * @author  Adam Mitchell
+  * @brief   Header file of the gateway front end to several NB-IoT modules. Attaches
+  *          them concurrently and spreads uplinks across them by load and signal,
+  *          failing over from modules that stop responding
+  */
+
+/** Define to prevent recursive inclusion
+ */
+#pragma once
+
+/** Includes
+ */
+#include "tp_nbiot_interface.h"
+
+/** Gateway #defines. Each queued request counts as TP_NBIOT_GATEWAY_LOAD_WEIGHT
+ *  steps of AT+CSQ signal power when choosing a module, the signal being read
+ *  by each module's worker after it attaches and after every successful 
+ *  uplink. A module is taken out of use after TP_NBIOT_GATEWAY_MAX_FAILURES
+ *  failed requests in a row and restarted by poll() every 
+ *  TP_NBIOT_GATEWAY_RETRY_S until it attaches
+ */
+#ifndef TP_NBIOT_GATEWAY_MAX_MODEMS
+	#define TP_NBIOT_GATEWAY_MAX_MODEMS 4
+#endif /* #ifndef TP_NBIOT_GATEWAY_MAX_MODEMS */
+
+#ifndef TP_NBIOT_GATEWAY_QUEUE_DEPTH
+	#define TP_NBIOT_GATEWAY_QUEUE_DEPTH (TP_NBIOT_ASYNC_QUEUE_DEPTH * TP_NBIOT_GATEWAY_MAX_MODEMS)
+#endif /* #ifndef TP_NBIOT_GATEWAY_QUEUE_DEPTH */
+
+#ifndef TP_NBIOT_GATEWAY_LOAD_WEIGHT
+	#define TP_NBIOT_GATEWAY_LOAD_WEIGHT 5
+#endif /* #ifndef TP_NBIOT_GATEWAY_LOAD_WEIGHT */
+
+#ifndef TP_NBIOT_GATEWAY_MAX_FAILURES
+	#define TP_NBIOT_GATEWAY_MAX_FAILURES 2
+#endif /* #ifndef TP_NBIOT_GATEWAY_MAX_FAILURES */
+
+#ifndef TP_NBIOT_GATEWAY_RETRY_S
+	#define TP_NBIOT_GATEWAY_RETRY_S 60
+#endif /* #ifndef TP_NBIOT_GATEWAY_RETRY_S */
+
+#if TP_NBIOT_ASYNC
+
+/** Drives several TP_NBIoT_Interface instances, one per module, behind a
+ *  single API. Each module is served by its own worker thread so AT
+ *  latency overlaps across modules, hence the gateway is only built with
+ *  TP_NBIOT_ASYNC set. Modules must not be used directly while owned by
+ *  a gateway
+ */
+class TP_NBIoT_Gateway
+{
+
+	public:
+
+		/** Function return codes, in addition to those of TP_NBIoT_Interface
+		 */
+		enum
+		{
+			NO_MODEM_AVAILABLE = 95,
+			INVALID_MODEM      = 96
+		};
+
+		/** State of a module
+		 */
+		enum class TP_Modem_State
+		{
+			DOWN     = 0,
+			STARTING = 1,
+			UP       = 2
+		};
+
+		/** Outcome of a request queued with the gateway. modem is the index of
+		 *  the module that served it last and attempts the number of modules
+		 *  that it was sent to
+		 */
+		struct TP_Gateway_Result
+		{
+			uint32_t handle;
+			size_t modem;
+			int status;
+			int response_code;
+			uint8_t attempts;
+		};
+
+		/** Completion callback of a gateway request. Called from the worker
+		 *  thread of the module that served it
+		 */
+		typedef Callback<void(const TP_Gateway_Result &result)> TP_Gateway_Callback;
+
+		/** Constructor for the TP_NBIoT_Gateway class
+		 *
+		 * @param **modems Pointer to an array of interfaces, one per module,
+		 *                 which must outlive the gateway
+		 * @param count Number of interfaces, modules beyond
+		 *              TP_NBIOT_GATEWAY_MAX_MODEMS are ignored
+		 */
+		TP_NBIoT_Gateway(TP_NBIoT_Interface **modems, size_t count);
+
+		/** Start every module at the same time, returning once all of them
+		 *  have attached or failed, or timeout_s has passed. Modules that
+		 *  fail are retried by poll()
+		 *
+		 * @param timeout_s Timeout period in seconds
+		 * @param &attached Address of size_t in which to store the number of
+		 *                  modules attached
+		 * @return Indicates success or failure reason, FAIL_TO_CONNECT if no
+		 *         module attached
+		 */
+		int start(uint16_t timeout_s, size_t &attached);
+
+		/** Queue a POST request using CoAP on the module with the lowest
+		 *  cost, that is the fewest queued requests and best signal. If the
+		 *  module fails the request, it is sent again on another
+		 *
+		 * @param *send_data Pointer to a byte array containing the data to be
+		 *                   sent to the server. Must remain valid until the
+		 *                   callback is called
+		 * @param buffer_len Number of bytes to send
+		 * @param *recv_data Pointer to a byte array where the data returned
+		 *                   from the server will be stored. Must remain valid
+		 *                   until the callback is called
+		 * @param data_intenfier Integer value representing the data format
+		 *                       type, i.e. TEXT_PLAIN
+		 * @param cb Callback to be called on completion
+		 * @param &handle Address of integer in which to store the handle that
+		 *                identifies this request in TP_Gateway_Result
+		 * @return Indicates success or failure reason
+		 */
+		int coap_post_async(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
+							TP_Gateway_Callback cb, uint32_t &handle);
+
+		/** Restart modules that are down once their retry time has passed.
+		 *  Should be called periodically
+		 *
+		 * @return Number of modules restarted
+		 */
+		size_t poll();
+
+		/** Return the state of a module
+		 *
+		 * @param modem Index of module
+		 * @param &state Address of TP_Modem_State in which to store its state
+		 * @return Indicates success or failure reason
+		 */
+		int get_modem_state(size_t modem, TP_Modem_State &state);
+
+		/** Return the number of requests queued and not yet completed
+		 *
+		 * @return Number of outstanding requests
+		 */
+		uint32_t pending();
+
+	private:
+
+		/** A module and the gateway's view of it. Bound as the completion
+		 *  callback for requests sent to the module
+		 */
+		struct TP_Gateway_Modem
+		{
+			TP_NBIoT_Gateway *gateway;
+			TP_NBIoT_Interface *interface;
+			size_t index;
+			TP_Modem_State state;
+			uint8_t failures;
+			uint64_t retry_ms;
+
+			/** Completion of start_async(). Runs on the module's worker, which 
+			 *  reads the module's signal once it has attached so that it can be 
+			 *  ranked
+			 *
+			 * @param &result Outcome of start()
+			 * @return None
+			 */
+			void started(const TP_NBIoT_Interface::TP_Async_Result &result);
+
+			/** Completion of coap_post_async(). Runs on the module's worker, 
+			 *  which reads the module's signal again after a successful uplink,
+			 *  while it is still awake
+			 *
+			 * @param &result Outcome of the request
+			 * @return None
+			 */
+			void completed(const TP_NBIoT_Interface::TP_Async_Result &result);
+		};
+
+		/** Request queued with the gateway. tried has bit n set once module n
+		 *  has been sent the request
+		 */
+		struct TP_Gateway_Request
+		{
+			bool used;
+			uint32_t handle;
+			size_t modem;
+			uint32_t modem_handle;
+			uint8_t attempts;
+			uint32_t tried;
+			uint8_t *send_data;
+			size_t buffer_len;
+			char *recv_data;
+			int data_indentifier;
+			TP_Gateway_Callback cb;
+		};
+
+		/** Queue start() on a module
+		 *
+		 * @param modem Index of module
+		 * @param timeout_s Timeout period in seconds
+		 * @return Indicates success or failure reason
+		 */
+		int start_modem(size_t modem, uint16_t timeout_s);
+
+		/** Choose the module with the lowest cost that has not been tried
+		 *
+		 * @param tried Bit n set to exclude module n
+		 * @param &modem Address of size_t in which to store module index
+		 * @return Indicates success or failure reason
+		 */
+		int select_modem(uint32_t tried, size_t &modem);
+
+		/** Send a request to the cheapest module that accepts it
+		 *
+		 * @param &request Address of request
+		 * @return Indicates success or failure reason
+		 */
+		int submit(TP_Gateway_Request &request);
+
+		/** Record the outcome of start() on a module
+		 *
+		 * @param modem Index of module
+		 * @param status Outcome of start()
+		 * @return None
+		 */
+		void on_started(size_t modem, int status);
+
+		/** Complete a request, failing over to another module if necessary
+		 *
+		 * @param modem Index of module
+		 * @param &result Outcome of the request on that module
+		 * @return None
+		 */
+		void on_completed(size_t modem, const TP_NBIoT_Interface::TP_Async_Result &result);
+
+		/** Count a failed request against a module, taking it out of use
+		 *  after too many
+		 *
+		 * @param modem Index of module
+		 * @return None
+		 */
+		void modem_failed(size_t modem);
+
+		TP_Gateway_Modem _modems[TP_NBIOT_GATEWAY_MAX_MODEMS];
+		size_t _count;
+		uint16_t _start_timeout_s = 300;
+
+		TP_Gateway_Request _requests[TP_NBIOT_GATEWAY_QUEUE_DEPTH] = {};
+		uint32_t _next_handle = 1;
+		uint32_t _pending = 0;
+
+		/** Guards module state and requests against the module workers.
+		 *  While it is held the modules are only asked for async_pending(),
+		 *  get_connection_snapshot() and to queue requests, none of which 
+		 *  wait for the module's lock, so a busy module never holds up the
+		 *  gateway. _start_flags has bit n set once module n has finished 
+		 *  starting
+		 */
+		Mutex _mutex;
+		EventFlags _start_flags;
+};
+
+#endif /* #if TP_NBIOT_ASYNC */
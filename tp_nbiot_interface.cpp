@@ -1,6 +1,6 @@
 /**
   * @file    tp_nbiot_interface.cpp
-  * @version 0.4.0
+  * @version 0.5.0
   * @author  Adam Mitchell
   * @brief   C++ file of the Thingpilot NB-IoT interface. This interface is hardware agnostic
   *          and depends on the underlying modem drivers exposing an identical interface
@@ -14,6 +14,78 @@
  */
 #include "tp_nbiot_interface.h"
 
+/** Definitions of the timer tables, required as they are odr-used
+ */
+constexpr TP_NBIoT_Interface::TP_Timer_Unit TP_NBIoT_Interface::T3412_TABLE[];
+constexpr TP_NBIoT_Interface::TP_Timer_Unit TP_NBIoT_Interface::T3324_TABLE[];
+constexpr TP_NBIoT_Interface::T3412_units TP_NBIoT_Interface::T3412_UNITS[];
+constexpr TP_NBIoT_Interface::T3324_units TP_NBIoT_Interface::T3324_UNITS[];
+
+/** RAM budget and report, see TP_NBIOT_RAM_BUDGET and TP_NBIOT_RAM_REPORT.
+ *  The report is a const symbol holding ram_footprint(), kept by the 
+ *  linker so that it is listed in the map file and can be read from the 
+ *  image
+ */
+#if TP_NBIOT_RAM_BUDGET > 0
+	static_assert(sizeof(TP_NBIoT_Interface) <= TP_NBIOT_RAM_BUDGET, "TP_NBIoT_Interface exceeds TP_NBIOT_RAM_BUDGET");
+#endif /* #if TP_NBIOT_RAM_BUDGET > 0 */
+
+#if TP_NBIOT_RAM_REPORT
+	extern const TP_NBIoT_Interface::TP_RAM_Footprint tp_nbiot_ram_report;
+	MBED_USED const TP_NBIoT_Interface::TP_RAM_Footprint tp_nbiot_ram_report = TP_NBIoT_Interface::ram_footprint();
+#endif /* #if TP_NBIOT_RAM_REPORT */
+
+/** Value names of the NUESTATS categories as reported by the module
+ */
+const TP_NBIoT_Interface::TP_Nuestats_Field TP_NBIoT_Interface::NUESTATS_RADIO_FIELDS[] =
+{
+	{ "Signal power", offsetof(TP_Nuestats_Radio, signal_power) },
+	{ "Total power",  offsetof(TP_Nuestats_Radio, total_power) },
+	{ "TX power",     offsetof(TP_Nuestats_Radio, tx_power) },
+	{ "TX time",      offsetof(TP_Nuestats_Radio, tx_time) },
+	{ "RX time",      offsetof(TP_Nuestats_Radio, rx_time) },
+	{ "Cell ID",      offsetof(TP_Nuestats_Radio, cell_id) },
+	{ "ECL",          offsetof(TP_Nuestats_Radio, ecl) },
+	{ "SNR",          offsetof(TP_Nuestats_Radio, snr) },
+	{ "EARFCN",       offsetof(TP_Nuestats_Radio, earfcn) },
+	{ "PCI",          offsetof(TP_Nuestats_Radio, pci) },
+	{ "RSRQ",         offsetof(TP_Nuestats_Radio, rsrq) },
+	{ NULL, 0 }
+};
+
+const TP_NBIoT_Interface::TP_Nuestats_Field TP_NBIoT_Interface::NUESTATS_BLER_FIELDS[] =
+{
+	{ "RLC UL BLER",       offsetof(TP_Nuestats_BLER, rlc_ul_bler) },
+	{ "RLC DL BLER",       offsetof(TP_Nuestats_BLER, rlc_dl_bler) },
+	{ "MAC UL BLER",       offsetof(TP_Nuestats_BLER, mac_ul_bler) },
+	{ "MAC DL BLER",       offsetof(TP_Nuestats_BLER, mac_dl_bler) },
+	{ "Total TX bytes",    offsetof(TP_Nuestats_BLER, total_tx_bytes) },
+	{ "Total RX bytes",    offsetof(TP_Nuestats_BLER, total_rx_bytes) },
+	{ "Total TX blocks",   offsetof(TP_Nuestats_BLER, total_tx_blocks) },
+	{ "Total RX blocks",   offsetof(TP_Nuestats_BLER, total_rx_blocks) },
+	{ "Total RTX blocks",  offsetof(TP_Nuestats_BLER, total_rtx_blocks) },
+	{ "Total ACK/NACK RX", offsetof(TP_Nuestats_BLER, total_ack_nack_rx) },
+	{ NULL, 0 }
+};
+
+const TP_NBIoT_Interface::TP_Nuestats_Field TP_NBIoT_Interface::NUESTATS_THP_FIELDS[] =
+{
+	{ "RLC UL", offsetof(TP_Nuestats_THP, rlc_ul) },
+	{ "RLC DL", offsetof(TP_Nuestats_THP, rlc_dl) },
+	{ "MAC UL", offsetof(TP_Nuestats_THP, mac_ul) },
+	{ "MAC DL", offsetof(TP_Nuestats_THP, mac_dl) },
+	{ NULL, 0 }
+};
+
+const TP_NBIoT_Interface::TP_Nuestats_Field TP_NBIoT_Interface::NUESTATS_APPSMEM_FIELDS[] =
+{
+	{ "Current Allocated", offsetof(TP_Nuestats_APPSMEM, current_allocated) },
+	{ "Total Free",        offsetof(TP_Nuestats_APPSMEM, total_free) },
+	{ "Max Free",          offsetof(TP_Nuestats_APPSMEM, max_free) },
+	{ "Num Allocs",        offsetof(TP_Nuestats_APPSMEM, num_allocs) },
+	{ "Num Frees",         offsetof(TP_Nuestats_APPSMEM, num_frees) },
+	{ NULL, 0 }
+};
 
 #if BOARD == WRIGHT_V1_0_0 || BOARD == DEVELOPMENT_BOARD_V1_1_0
 	/** Constructor for the TP_NBIoT_Interface class, specifically when 
@@ -30,9 +102,17 @@
 	 */  
 	TP_NBIoT_Interface::TP_NBIoT_Interface(PinName txu, PinName rxu, PinName cts, PinName rst, 
 										PinName vint, PinName gpio, int baud) :
-										_modem(txu, rxu, cts, rst, vint, gpio, baud) 
+										_modem(txu, rxu, cts, rst, vint, gpio, baud)
+										#if TP_NBIOT_ASYNC
+											, _worker(osPriorityNormal, TP_NBIOT_WORKER_STACK_SIZE, _worker_stack, "tp_nbiot")
+										#endif /* #if TP_NBIOT_ASYNC */
 	{
-		
+		_link_baud = baud;
+		_link_boot_baud = baud;
+
+		#if TP_NBIOT_DRIVER_URCS
+			_modem.sigio(callback(this, &TP_NBIoT_Interface::urc_sigio));
+		#endif /* #if TP_NBIOT_DRIVER_URCS */
 	}
 #endif /* #if BOARD == ... */
 
@@ -53,11 +133,15 @@ TP_NBIoT_Interface::~TP_NBIoT_Interface()
   */
 int TP_NBIoT_Interface::ready(uint8_t timeout_s)
 {
+    TP_NBIOT_LOCK();
+
     int status = -1;
+    TP_NBIOT_TRACE(TP_Perf_Operation::READY, status);
 
     if(_driver == TP_NBIoT_Interface::SARAN2)
     {
         time_t start_time = time(NULL);
+        bool responsive = true;
 
         while(true)
         {
@@ -65,20 +149,45 @@ int TP_NBIoT_Interface::ready(uint8_t timeout_s)
 
             if(status == TP_NBIoT_Interface::NBIOT_OK)
             {
-                return TP_NBIoT_Interface::NBIOT_OK;
+                /** An unresponsive modem has most likely been reset, in
+                 *  which case any CoAP session state we hold is stale
+                 */
+                if(!responsive)
+                {
+                    coap_session_reset();
+                    urc_reset();
+
+                    #if TP_NBIOT_DRIVER_SOCKETS
+                        socket_reset();
+                    #endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+                    if(_urc_oob_attached)
+                    {
+                        TP_NBIOT_TRACE_RETURN(status, enable_network_urcs());
+                    }
+                }
+
+                TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
             }
 
+            responsive = false;
+
             time_t current_time = time(NULL);
             if(current_time >= start_time + timeout_s)
 			{
-				return TP_NBIoT_Interface::FAIL_TO_CONNECT;
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::FAIL_TO_CONNECT);
 			}
 
-			ThisThread::sleep_for(500);
+            /** The modem announces itself over UART once it has booted, so
+             *  rather than sleeping for a fixed period wake as soon as it
+             *  sends anything
+             */
+            _urc_flags.clear(URC_FLAG_UART_ACTIVITY);
+            _urc_flags.wait_any(URC_FLAG_UART_ACTIVITY, 500);
         }
     }
 
-    return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+    TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
 /** Initialise the modem with default parameters:
@@ -87,6 +196,11 @@ int TP_NBIoT_Interface::ready(uint8_t timeout_s)
  *  SIM_PSM = TRUE
  *  MODULE_PSM = TRUE
  * 
+ *  The current configuration is read first and only settings that 
+ *  differ are written. The modem is only rebooted if a setting that
+ *  requires it has changed, so a modem that is already configured
+ *  is not re-attached
+ * 
  *  Then attempt to connect to a network for 5 minutes; if this is 
  *  unsuccessful then turn off the modem and report that status
  *  back to the application. If it is successful then the modem 
@@ -98,618 +212,1040 @@ int TP_NBIoT_Interface::ready(uint8_t timeout_s)
  */
 int TP_NBIoT_Interface::start(uint16_t timeout_s)
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::START, status);
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = enable_autoconnect();
+		status = start_configure();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
-            debug("\r\nLine %d, status %d",__LINE__,status);
 			return status;
 		}
 
-		status = enable_cell_reselection();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-            status = enable_cell_reselection();
-            if(status != TP_NBIoT_Interface::NBIOT_OK)
-		    {
-                debug("\r\nLine %d, status %d",__LINE__,status);
-                return status;
-            }
-		}
+		/** URCs are optional, if the modem won't enable them we fall back
+		 *  to polling for registration
+		 */
+		enable_network_urcs();
 
-		status = enable_sim_power_save_mode();
+		/** Attempt to connect and register to the network for 5 minutes. If we fail
+		 *  then turn off the radio to conserve power and let the application decide 
+		 *  what to do
+		 */
+		status = wait_for_registration(timeout_s);
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
-            debug("\r\nLine %d, status %d",__LINE__,status);
-			return status;
-		}
+			TP_NBIOT_STAT(_stats.start_timeouts++);
+
+			int radio_status = deactivate_radio();
+			if(radio_status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				TP_NBIOT_TRACE_RETURN(status, radio_status);
+			}
 
-		status = enable_power_save_mode();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-            debug("\r\nLine %d, status %d",__LINE__,status);
 			return status;
 		}
 
-		status = reboot_modem();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Recover a lost or failed connection, i.e. after start() returns 
+ *  FAIL_TO_CONNECT or the module deregisters. Escalates through the 
+ *  TP_Recovery_Step steps, waiting for registration after each and 
+ *  backing off exponentially with jitter between them so that a fleet
+ *  does not retry in step. The serving cell is queried first and 
+ *  recovery begins one step cheaper than the step that last 
+ *  recovered the connection in that cell, so that a cell which once
+ *  needed a reboot isn't rebooted on every recovery from then on. 
+ *  Cells are only told apart with TP_NBIOT_DRIVER_NUESTATS. The 
+ *  interface lock is held for each step but released during the 
+ *  backoff between them
+ * 
+ * @param timeout_s Overall timeout period in seconds
+ * @param &step Address of TP_Recovery_Step in which to store the 
+ *              step that recovered the connection
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::recover(uint16_t timeout_s, TP_Recovery_Step &step)
+{
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		uint64_t start_ms = Kernel::get_ms_count();
+		uint64_t deadline = start_ms + (uint64_t)timeout_s * 1000;
+		uint32_t cell_id = 0;
+
+		/** The interface lock is held for each step but not for the backoff
+		 *  between them, which can last minutes, so that other callers and
+		 *  the async worker aren't held up
+		 */
 		{
-            debug("\r\nLine %d, status %d",__LINE__,status);
-			return status;
+			TP_NBIOT_LOCK();
+
+			/** The cell last reported may be long out of date, so ask for 
+			 *  the serving cell. If the module can't say, i.e. because it 
+			 *  has lost it, the last known cell is the best guess. Without
+			 *  NUESTATS the cell is unknown and the one history entry of
+			 *  cell 0 is used for every recovery
+			 */
+			#if TP_NBIOT_DRIVER_NUESTATS
+				TP_NBIOT_SCRATCH(TP_Nuestats_Radio, radio, radio);
+				get_nuestats(radio);
+			#endif /* #if TP_NBIOT_DRIVER_NUESTATS */
+
+			cell_id = _recovery_cell_id;
+
+			/** A step that was needed once isn't necessarily needed again, 
+			 *  the next cheaper one is tried first
+			 */
+			step = (TP_Recovery_Step)recovery_cell(cell_id).step;
+			if(step != TP_Recovery_Step::WAIT_URC)
+			{
+				step = (TP_Recovery_Step)((int)step - 1);
+			}
+
+			if(_recovery_seed == 0)
+			{
+				_recovery_seed = (uint32_t)start_ms ^ cell_id ^ 0x9E3779B9UL;
+			}
 		}
 
-		TP_Connection_Status conn_status;
-		int connected = 0;
-		int registered = 0;
-		int psm = 0;
-		status = get_module_network_status(conn_status, connected, registered, psm);
-		time_t start_time = time(NULL);
+		uint32_t backoff_ms = TP_NBIOT_RECOVERY_BACKOFF_MS;
 
-		/** Attempt to connect and register to the network for 5 minutes. If we fail
-		 *  then turn off the radio to conserve power and let the application decide 
-		 *  what to do
-		 */
 		while(true)
 		{
-            status = get_module_network_status(conn_status, connected, registered, psm);
-            if (conn_status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_CONNECTED ||
-		        conn_status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED ||
-			    conn_status == TP_Connection_Status::PSM_REGISTERED)
-              {  
-                  break;
-              }
-            debug("\r\nconn_status %d, connected %d, registered %d, psm %d",conn_status, connected, registered, psm);
-			time_t current_time = time(NULL);
-			if(current_time >= start_time + timeout_s)
-			{
-				status = deactivate_radio();
-				if(status != TP_NBIoT_Interface::NBIOT_OK)
+			uint64_t now = Kernel::get_ms_count();
+			if(now >= deadline)
+			{
+				break;
+			}
+
+			uint64_t remaining_s = (deadline - now) / 1000;
+			uint16_t step_timeout_s = remaining_s < TP_NBIOT_RECOVERY_STEP_TIMEOUT_S ? 
+									  (uint16_t)remaining_s : TP_NBIOT_RECOVERY_STEP_TIMEOUT_S;
+
+			uint32_t sleep_ms = 0;
+
+			{
+				TP_NBIOT_LOCK();
+
+				if(recovery_step(step, step_timeout_s) == TP_NBIoT_Interface::NBIOT_OK)
 				{
-					return status;
+					TP_Recovery_Cell &cell = recovery_cell(cell_id);
+					cell.step = (uint8_t)step;
+					cell.recoveries++;
+					return TP_NBIoT_Interface::NBIOT_OK;
 				}
 
-				return TP_NBIoT_Interface::FAIL_TO_CONNECT;
+				/** Sleep for a random time between half and all of the 
+				 *  backoff, which doubles after every failed step
+				 */
+				_recovery_seed ^= _recovery_seed << 13;
+				_recovery_seed ^= _recovery_seed >> 17;
+				_recovery_seed ^= _recovery_seed << 5;
+
+				sleep_ms = backoff_ms / 2 + _recovery_seed % (backoff_ms / 2 + 1);
 			}
 
-			ThisThread::sleep_for(2500);
-		}
+			now = Kernel::get_ms_count();
+			if(now + sleep_ms > deadline)
+			{
+				sleep_ms = now < deadline ? (uint32_t)(deadline - now) : 0;
+			}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+			if(recovery_backoff(sleep_ms))
+			{
+				TP_NBIOT_LOCK();
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
-}
+				TP_Recovery_Cell &cell = recovery_cell(cell_id);
+				cell.step = (uint8_t)step;
+				cell.recoveries++;
+				return TP_NBIoT_Interface::NBIOT_OK;
+			}
 
-/** Power-cycle the NB-IoT modem
- * 
- * @return Indicates success or failure reason
- */
-int TP_NBIoT_Interface::reboot_modem()
-{
-	int status = -1;
+			backoff_ms = backoff_ms > TP_NBIOT_RECOVERY_MAX_BACKOFF_MS / 2 ? TP_NBIOT_RECOVERY_MAX_BACKOFF_MS : backoff_ms * 2;
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.reboot_module();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+			if(step != TP_Recovery_Step::REBOOT)
+			{
+				step = (TP_Recovery_Step)((int)step + 1);
+			}
+		}
+
+		TP_NBIOT_LOCK();
+
+		recovery_cell(cell_id).failures++;
+
+		/** As start() does, turn off the radio to conserve power and let the
+		 *  application decide what to do
+		 */
+		int radio_status = deactivate_radio();
+		if(radio_status != TP_NBIoT_Interface::NBIOT_OK)
 		{
-			return status;
+			return radio_status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		return TP_NBIoT_Interface::FAIL_TO_CONNECT;
 	}
 
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Is the modem TX/RX circuitry turned on or off? 1 is on, 0 is off
+/** Copy the recovery history, i.e. to persist it across MCU resets
  * 
- * @param &status Address of integer value to which to return the status
- *                value of the radio
- * @return Indicates success or failure reason
+ * @param *cells Pointer to an array of TP_NBIOT_RECOVERY_CELLS entries
+ * @return None
  */
-int TP_NBIoT_Interface::get_radio_status(int &radio_status)
+void TP_NBIoT_Interface::get_recovery_history(TP_Recovery_Cell *cells)
 {
-	int status = -1;
-
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.get_radio_status(radio_status);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	TP_NBIOT_LOCK();
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}	
-
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	memcpy(cells, _recovery_cells, sizeof(_recovery_cells));
 }
 
-/** Disable TX and RX RF circuits
+/** Restore recovery history saved by get_recovery_history()
  * 
- * @return Indicates success or failure reason
+ * @param *cells Pointer to an array of TP_NBIOT_RECOVERY_CELLS entries
+ * @return None
  */
-int TP_NBIoT_Interface::deactivate_radio()
+void TP_NBIoT_Interface::set_recovery_history(const TP_Recovery_Cell *cells)
 {
-	int status = -1;
+	TP_NBIOT_LOCK();
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	memcpy(_recovery_cells, cells, sizeof(_recovery_cells));
+
+	_recovery_sequence = 0;
+	for(int i = 0; i < TP_NBIOT_RECOVERY_CELLS; i++)
 	{
-		status = _modem.deactivate_radio();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		if(_recovery_cells[i].step > (uint8_t)TP_Recovery_Step::REBOOT)
 		{
-			return status;
+			_recovery_cells[i].step = (uint8_t)TP_Recovery_Step::WAIT_URC;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		if(_recovery_cells[i].valid && _recovery_cells[i].sequence > _recovery_sequence)
+		{
+			_recovery_sequence = _recovery_cells[i].sequence;
+		}
 	}
-
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Enable TX and RX RF circuits
+/** Perform a single recovery step and wait for registration
  * 
+ * @param step Recovery step
+ * @param timeout_s Timeout period in seconds
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::activate_radio()
+int TP_NBIoT_Interface::recovery_step(TP_Recovery_Step step, uint16_t timeout_s)
 {
-	int status = -1;
+	int status = TP_NBIoT_Interface::NBIOT_OK;
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	switch(step)
 	{
-		status = _modem.activate_radio();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		case TP_Recovery_Step::WAIT_URC:
 		{
-			return status;
+			/** URCs are optional, without them registration is polled
+			 */
+			enable_network_urcs();
+			break;
+		}
+		case TP_Recovery_Step::RADIO_TOGGLE:
+		{
+			status = deactivate_radio();
+			if(status == TP_NBIoT_Interface::NBIOT_OK)
+			{
+				status = activate_radio();
+			}
+			break;
 		}
+		case TP_Recovery_Step::REATTACH:
+		{
+			status = gprs_detach();
+			if(status == TP_NBIoT_Interface::NBIOT_OK)
+			{
+				status = gprs_attach();
+			}
+			break;
+		}
+		case TP_Recovery_Step::REBOOT:
+		{
+			status = reboot_modem();
+			break;
+		}
+	}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	return wait_for_registration(timeout_s);
 }
 
-/** Attempt to attach to network GPRS service
- *
- * @return Indicates success or failure reason
+/** Sleep between recovery steps, waking early if URCs report that
+ *  the module has registered. Called without the interface lock, 
+ *  which is taken only to read URCs
+ * 
+ * @param backoff_ms Time to sleep in milliseconds
+ * @return True if the module registered meanwhile
  */
-int TP_NBIoT_Interface::gprs_attach()
+bool TP_NBIoT_Interface::recovery_backoff(uint32_t backoff_ms)
 {
-	int status = -1;
+	if(!_urc_oob_attached)
+	{
+		ThisThread::sleep_for(backoff_ms);
+		return false;
+	}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	uint64_t deadline = Kernel::get_ms_count() + backoff_ms;
+
+	while(true)
 	{
-		status = _modem.gprs_attach();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
-			return status;
+			/** Only reading the URCs holds the modem, not the wait
+			 */
+			TP_NBIOT_LOCK();
+
+			_urc_flags.clear(URC_FLAG_UART_ACTIVITY | URC_FLAG_STATE_CHANGED);
+			process_urcs();
+
+			if(_snapshot.valid && is_registered(_snapshot.status))
+			{
+				return true;
+			}
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+		uint64_t now = Kernel::get_ms_count();
+		if(now >= deadline)
+		{
+			return false;
+		}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+		_urc_flags.wait_any(URC_FLAG_UART_ACTIVITY | URC_FLAG_STATE_CHANGED, (uint32_t)(deadline - now));
+	}
 }
 
-/** Attempt to detach from network GPRS service
- *
- * @return Indicates success or failure reason
+/** Find the recovery history of a cell, replacing the least recently
+ *  used entry if it has none
+ * 
+ * @param cell_id Cell ID
+ * @return Reference to the history entry
  */
-int TP_NBIoT_Interface::gprs_detach()
+TP_NBIoT_Interface::TP_Recovery_Cell &TP_NBIoT_Interface::recovery_cell(uint32_t cell_id)
 {
-	int status = -1;
+	TP_Recovery_Cell *oldest = &_recovery_cells[0];
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	for(int i = 0; i < TP_NBIOT_RECOVERY_CELLS; i++)
 	{
-		status = _modem.gprs_detach();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		TP_Recovery_Cell &cell = _recovery_cells[i];
+
+		if(cell.valid && cell.cell_id == cell_id)
 		{
-			return status;
+			cell.sequence = ++_recovery_sequence;
+			return cell;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		if(!cell.valid || (oldest->valid && cell.sequence < oldest->sequence))
+		{
+			oldest = &cell;
+		}
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	*oldest = {};
+	oldest->cell_id = cell_id;
+	oldest->sequence = ++_recovery_sequence;
+	oldest->step = (uint8_t)TP_Recovery_Step::WAIT_URC;
+	oldest->valid = true;
+
+	return *oldest;
 }
 
-/** Attempt to automatically register to network
- *  using SIM card home PLMN
- *
+/** Configure the settings required by start() and reboot if necessary,
+ *  only writing those that differ from the current configuration
+ * 
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::auto_register_to_network()
+int TP_NBIoT_Interface::start_configure()
 {
-	int status = -1;
+	const uint8_t required = UE_AUTOCONNECT | UE_CELL_RESELECTION | UE_SIM_PSM;
+	bool changed = false;
+
+	/** Only the settings start() relies on are written, as they always
+	 *  were. Those not yet known, i.e. on the first start() after an MCU
+	 *  reset without TP_NBIOT_DRIVER_NCONFIG, are all written, leaving 
+	 *  operator specific settings such as scrambling untouched
+	 */
+	int status = apply_ue_flags(required, required, false, changed);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	int power_save_mode = 0;
+
+	status = query_power_save_mode(power_save_mode, TP_Query_Mode::URGENT);
+	if(status != TP_NBIoT_Interface::NBIOT_OK || power_save_mode != 1)
 	{
-		status = _modem.auto_register_to_network();
+		status = enable_power_save_mode();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
+	}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+	/** AT+NCONFIG settings only take effect after a reboot
+	 */
+	if(changed)
+	{
+		return reboot_modem();
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	/** Without a reboot the radio must be turned back on explicitly, i.e.
+	 *  if a previous start() timed out and deactivated it
+	 */
+	int radio_status = 0;
+
+	status = get_radio_status(radio_status, TP_Query_Mode::URGENT);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	if(radio_status != 1)
+	{
+		return activate_radio();
+	}
+
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Deregister from network
+/** Power-cycle the NB-IoT modem. AT+NRB is sent at the rate and flow
+ *  control in use, then the MCU follows the module to the rate it 
+ *  boots at, the link is verified and flow control reapplied
  * 
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::deregister_from_network()
+int TP_NBIoT_Interface::reboot_modem()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::REBOOT, status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.deregister_from_network();
+		/** Whatever the outcome the modem has lost its loaded profile
+		 *  and selected AT interface
+		 */
+		coap_session_reset();
+		urc_reset();
+
+		#if TP_NBIOT_DRIVER_SOCKETS
+			socket_reset();
+		#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+		status = _modem.reboot_module();
+
+		#if TP_NBIOT_DRIVER_LINK_SPEED
+			/** The module comes up at the rate last persisted, without flow 
+			 *  control. If that isn't the rate AT+NRB was sent at, its answer 
+			 *  may have been lost to the change, so the link decides
+			 */
+			TP_Flow_Control flow_control = _link_flow_control;
+
+			if(_link_flow_control != TP_Flow_Control::NONE)
+			{
+				_modem.set_serial_flow_control(false);
+				_link_flow_control = TP_Flow_Control::NONE;
+			}
+
+			if(_link_baud != _link_boot_baud)
+			{
+				_modem.set_serial_baud(_link_boot_baud);
+				_link_baud = _link_boot_baud;
+
+				status = link_verify();
+			}
+		#endif /* #if TP_NBIOT_DRIVER_LINK_SPEED */
+
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		TP_NBIOT_STAT(_stats.reboots++);
+
+		#if TP_NBIOT_DRIVER_LINK_SPEED
+			if(flow_control != TP_Flow_Control::NONE)
+			{
+				status = link_flow_control(flow_control);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+			}
+		#endif /* #if TP_NBIOT_DRIVER_LINK_SPEED */
+
+		/** Once attached, the out-of-band handlers are the only source of 
+		 *  connection state so URCs must be turned back on immediately
+		 */
+		if(_urc_oob_attached)
+		{
+			status = enable_network_urcs();
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Enable entire module Power Save Mode (PSM)
+/** Switch the UART between MCU and module to a different baud rate 
+ *  and flow control mode, i.e. 460800 with CTS for large uploads. The
+ *  module is switched with AT+NATSPEED, then the MCU, and the new 
+ *  rate is verified. If it can't be, both return to the previous 
+ *  rate. If persisted the module boots at the new rate, otherwise 
+ *  reboot_modem() returns the MCU to the rate the module boots at. 
+ *  After an MCU reset construct the interface at the persisted 
+ *  rate, or call resume(), which restores it
  * 
- * @return Indicates success or failure reason
+ * @param baud Baud rate, one of 4800, 9600, 57600, 115200, 230400,
+ *             460800 and 921600
+ * @param flow_control Flow control mode
+ * @param persist Store the baud rate in the module's NVM
+ * @return Indicates success or failure reason, LINK_FALLBACK if the
+ *         new rate could not be verified and the previous rate has
+ *         been restored, NOT_SUPPORTED if built without 
+ *         TP_NBIOT_DRIVER_LINK_SPEED
  */
-int TP_NBIoT_Interface::enable_power_save_mode()
+int TP_NBIoT_Interface::set_link_speed(uint32_t baud, TP_Flow_Control flow_control, bool persist)
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::LINK_SPEED, status);
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.enable_power_save_mode();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+	#if TP_NBIOT_DRIVER_LINK_SPEED
+		if(_driver == TP_NBIoT_Interface::SARAN2)
 		{
+			if(!link_baud_supported(baud))
+			{
+				status = TP_NBIoT_Interface::INVALID_UNIT_VALUE;
+				return status;
+			}
+
+			/** Flow control is changed at the rate already known to work
+			 */
+			if(flow_control != _link_flow_control)
+			{
+				status = link_flow_control(flow_control);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+			}
+
+			if(baud != _link_baud)
+			{
+				/** Not stored yet, so that a rate that doesn't work is forgotten 
+				 *  by the module when it falls back
+				 */
+				status = _modem.set_uart_speed(baud, TP_NBIOT_LINK_FALLBACK_S, false);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+
+				_modem.set_serial_baud(baud);
+
+				status = link_verify();
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					/** Wait out the module's own fallback, then check that the
+					 *  previous rate works again
+					 */
+					_modem.set_serial_baud(_link_baud);
+					ThisThread::sleep_for(TP_NBIOT_LINK_FALLBACK_S * 1000 + 500);
+
+					status = _modem.at();
+					if(status != TP_NBIoT_Interface::NBIOT_OK)
+					{
+						return status;
+					}
+
+					status = TP_NBIoT_Interface::LINK_FALLBACK;
+					return status;
+				}
+
+				_link_baud = baud;
+			}
+
+			if(persist && _link_boot_baud != baud)
+			{
+				status = _modem.set_uart_speed(baud, TP_NBIOT_LINK_FALLBACK_S, true);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+
+				_link_boot_baud = baud;
+			}
+
+			status = TP_NBIoT_Interface::NBIOT_OK;
 			return status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	#else
+		(void)baud;
+		(void)flow_control;
+		(void)persist;
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+		status = TP_NBIoT_Interface::NOT_SUPPORTED;
+
+		return status;
+	#endif /* #if TP_NBIOT_DRIVER_LINK_SPEED */
 }
 
-/** Disable entire module Power Save Mode (PSM)
+/** Return the baud rate and flow control mode in use between MCU and
+ *  module, without communicating with the module
  * 
+ * @param &baud Address of uint32_t in which to store the baud rate
+ * @param &flow_control Address of TP_Flow_Control in which to store
+ *                      the flow control mode
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_power_save_mode()
+int TP_NBIoT_Interface::get_link_speed(uint32_t &baud, TP_Flow_Control &flow_control)
 {
-	int status = -1;
-
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.disable_power_save_mode();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	TP_NBIOT_LOCK();
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+	baud = _link_baud;
+	flow_control = _link_flow_control;
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Query whether or not Power Save Mode (PSM) is enabled
- *  
- * @param &power_save_mode Address of integer in which to store
- *                         value of power save mode setting. 1 
- *                         means that PSM is enabled, 0 means 
- *                         that PSM is disabled
- * @return Indicates success or failure reason
+/** Save the state needed by resume() to carry on after an MCU reset
+ *  without restarting the modem: the last known connection status,
+ *  EARFCN, T3412/T3324 timers, UE configuration, a hash of the endpoint
+ *  held by each CoAP profile and open sockets. Made from cached state 
+ *  only, so there is no AT traffic. Call once registered, i.e. before 
+ *  entering MCU standby
+ * 
+ * @param &context Address of TP_Attach_Context in which to store the 
+ *                 context, to be kept in retained RAM or flash
+ * @return Indicates success or failure reason, FAIL_TO_CONNECT if the
+ *         module is not known to be registered
  */
-int TP_NBIoT_Interface::query_power_save_mode(int &power_save_mode)
+int TP_NBIoT_Interface::save_attach_context(TP_Attach_Context &context)
 {
-	int status = -1;
+	TP_NBIOT_LOCK();
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	/** The snapshot is stale straight after resume() but the registration
+	 *  it holds has been confirmed
+	 */
+	if(!is_registered(_snapshot.status))
 	{
-		status = _modem.query_power_save_mode(power_save_mode);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		return TP_NBIoT_Interface::FAIL_TO_CONNECT;
+	}
+
+	/** Zeroed first so that padding doesn't upset the checksum
+	 */
+	memset(&context, 0, sizeof(context));
+
+	context.magic = TP_NBIoT_Interface::ATTACH_CONTEXT_MAGIC;
+	context.status = _snapshot.status;
+	context.earfcn = _snapshot.earfcn;
+	context.earfcn_valid = _snapshot.earfcn_valid;
+	context.t3412_s = _t3412_s;
+	context.t3324_s = _t3324_s;
+	/** Endpoints restored by an earlier resume() and not yet passed in 
+	 *  again keep the hash they were restored with
+	 */
+	for(int profile = 0; profile < TP_NBIOT_COAP_PROFILES; profile++)
+	{
+		const TP_CoAP_Endpoint &endpoint = _coap_endpoints[profile];
+
+		if(_coap_endpoints_used & (1 << profile))
 		{
-			return status;
+			context.coap_endpoint_hashes[profile] = endpoint_hash(endpoint.ipv4, endpoint.port, 
+																  endpoint.uri, endpoint.uri_length);
+		}
+		else if(_coap_endpoints_restored & (1 << profile))
+		{
+			context.coap_endpoint_hashes[profile] = _coap_restored_hashes[profile];
 		}
-
-		return TP_NBIoT_Interface::NBIOT_OK;
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	context.coap_endpoints_used = _coap_endpoints_used | _coap_endpoints_restored;
+	context.coap_endpoints_registered = _coap_endpoints_registered;
+	context.coap_selected_profile = (int8_t)_coap_selected_profile;
+	context.ue_config = _ue_config;
+	context.ue_config_known = _ue_config_known;
+	context.link_baud = _link_baud;
+	context.link_boot_baud = _link_boot_baud;
+	context.link_flow_control = (uint8_t)_link_flow_control;
+
+	#if TP_NBIOT_DRIVER_SOCKETS
+		context.sockets_open = _sockets_open;
+	#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+	context.checksum = attach_context_checksum(context);
+
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Determine whether or not the modem is in power save mode or not
+/** Carry on from a context saved by save_attach_context() before an
+ *  MCU reset, instead of calling start(). A single AT+CEREG? query 
+ *  confirms that the module is still registered, after which the saved
+ *  state is restored and data can be sent straight away. If this fails
+ *  call start() as usual. The saved connection state and EARFCN are 
+ *  restored as stale, so that the first request with a maximum age 
+ *  queries the module. Sockets open at the time are still open in the
+ *  module and are tracked again, but data announced before the MCU 
+ *  reset is not counted by socket_pending(); socket_recv_from() reads
+ *  it regardless. Endpoint handles stay valid. An endpoint passed to
+ *  configure_coap() or register_endpoint() again is checked against the
+ *  saved hash and, if it matches, its profile is reused without being
+ *  rewritten
  * 
- * @param &psm Address of integer in which to store actual PSM value,
- *             1 = in PSM, 0 = active
- * @return Indicates success or failure reason
- */ 
-int TP_NBIoT_Interface::get_power_save_mode_status(int &psm)
+ * @param &context Context saved by save_attach_context()
+ * @return Indicates success or failure reason, INVALID_CONTEXT if the 
+ *         context is corrupt and FAIL_TO_CONNECT if the module is no 
+ *         longer registered
+ */
+int TP_NBIoT_Interface::resume(const TP_Attach_Context &context)
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::RESUME, status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.npsmr(psm);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		if(context.magic != TP_NBIoT_Interface::ATTACH_CONTEXT_MAGIC || 
+		   context.checksum != attach_context_checksum(context))
 		{
-			return status;
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::INVALID_CONTEXT);
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+		#if TP_NBIOT_DRIVER_LINK_SPEED
+			/** The module kept the link settings of set_link_speed() across the
+			 *  MCU reset, so only the MCU side needs restoring
+			 */
+			TP_Flow_Control flow_control = (TP_Flow_Control)context.link_flow_control;
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
-}
+			if(context.link_baud != _link_baud)
+			{
+				_modem.set_serial_baud(context.link_baud);
+				_link_baud = context.link_baud;
+			}
 
-/** Return u-blox defined connection status based on radio connection status, 
- *  network registration status and PSM status. This document can be found in 8.4
- *  at https://www.u-blox.com/sites/default/files/SARA-N2-Application-Development_AppNote_%28UBX-16017368%29.pdf
- * 
- * @param &status Address of TP_Connection_Status to return u-blox defined connection
- *                status to
- * @param &connected Address of integer value in which to store radio connection status
- *                   where 1 = connected and 0 is not connected
- * @param &registered Address of integer value in which to store network registration
- *                    status. See AT+CEREG=0/AT+CEREG? for possible values
- * @param &psm Address of integer value in which to store PSM status where 1 = in PSM
- *             and 0 is in Active mode
- * @return Indicates success or failure reason
- */ 
-int TP_NBIoT_Interface::get_module_network_status(TP_Connection_Status &status, int &connected, 
-                                                  int &registered, int &psm)
-{
-	int func_status = -1;
+			if(flow_control != _link_flow_control)
+			{
+				_modem.set_serial_flow_control(flow_control == TP_Flow_Control::CTS);
+				_link_flow_control = flow_control;
+			}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		func_status = get_connection_status(connected, registered);
-		if(func_status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return func_status;
-		}
+			_link_boot_baud = context.link_boot_baud;
+		#endif /* #if TP_NBIOT_DRIVER_LINK_SPEED */
 
-		func_status = get_power_save_mode_status(psm);
-		if(func_status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return func_status;
-		}
+		int urc = 0;
+		int registered = 0;
 
-		if(registered == 0 && connected == 0 && psm == 0)
-		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_NO_NETWORK_ACTIVITY;
-		}
-		else if(registered == 2 && connected == 0 && psm == 0)
-		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_SCANNING_FOR_BASE_STATION;
-		}
-		else if(registered == 2 && connected == 1 && psm == 0)
-		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_STARTING_REGISTRATION;
-		}
-		else if((registered == 1 || registered == 5) && (connected == 1 && psm == 0))
-		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_REGISTERED_RRC_CONNECTED;
-		}
-		else if((registered == 1 || registered == 5) && (connected == 0 && psm == 0))
-		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED;
-		}
-		else if((registered == 1 || registered == 5) && (connected == 0 && psm == 1))
-		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::PSM_REGISTERED;
-		}
-		else if(registered == 3)
+		status = _modem.cereg(urc, registered);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::REGISTRATION_FAILED;
+			return status;
 		}
-		else
+
+		if(registered != 1 && registered != 5)
 		{
-			status = TP_NBIoT_Interface::TP_Connection_Status::STATE_UNDEFINED;
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::FAIL_TO_CONNECT);
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		/** The module has not been rebooted, so what it was configured with 
+		 *  before the MCU reset still stands. Which profile is loaded isn't 
+		 *  trusted though, the first CoAP request loads the selected profile
+		 */
+		_t3412_s = context.t3412_s;
+		_t3324_s = context.t3324_s;
+		_ue_config = context.ue_config;
+		_ue_config_known = context.ue_config_known;
+
+		/** Only a hash of each endpoint is saved, so the endpoints are
+		 *  revalidated as they are passed to configure_coap() or 
+		 *  register_endpoint() again
+		 */
+		memcpy(_coap_restored_hashes, context.coap_endpoint_hashes, sizeof(_coap_restored_hashes));
+		_coap_endpoints_used = 0;
+		_coap_endpoints_restored = context.coap_endpoints_used;
+		_coap_endpoints_registered = context.coap_endpoints_registered & context.coap_endpoints_used;
+		_coap_selected_profile = context.coap_selected_profile;
+		coap_session_reset();
+
+		#if TP_NBIOT_DRIVER_SOCKETS
+			socket_reset();
+			_sockets_open = context.sockets_open & ((1 << TP_NBIOT_MAX_SOCKETS) - 1);
+			if(_sockets_open != 0)
+			{
+				socket_oob_attach();
+			}
+		#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+		/** Only registration has been confirmed. The rest is what was last
+		 *  known before the MCU reset, whose timestamps mean nothing now, 
+		 *  so it is kept for get_connection_snapshot() but doesn't stand in
+		 *  for a query
+		 */
+		_snapshot.connected = 0;
+		_snapshot.registered = registered;
+		_snapshot.psm = context.status == TP_Connection_Status::PSM_REGISTERED ? 1 : 0;
+		_snapshot.earfcn = context.earfcn;
+		_snapshot.earfcn_valid = false;
+		snapshot_confirm();
+
+		_snapshot.valid = false;
+		snapshot_publish();
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Query UE for radio connection and network registration status
+/** Enable +CSCON, +CEREG and +NPSMR unsolicited result codes (URCs)
+ *  and track radio connection, network registration and PSM status
+ *  from them rather than by polling. Once enabled, get_connection_status(),
+ *  get_power_save_mode_status() and get_module_network_status() are 
+ *  answered from the URC state without issuing AT commands. URCs are 
+ *  disabled by the modem on reboot, after which reboot_modem() and 
+ *  ready() re-enable them automatically
  * 
- * @param &connected Address of integer in which to store radio 
- *                   connection status
- * @param &reg_status Address of integer in which to store
- *                    network registration status
- * @return Indicates success or failure reason
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_URCS
  */
-int TP_NBIoT_Interface::get_connection_status(int &connected, int &reg_status)
+int TP_NBIoT_Interface::enable_network_urcs()
 {
-    int status = -1;
+	TP_NBIOT_LOCK();
 
-    if(_driver == TP_NBIoT_Interface::SARAN2)
-    {
-        int urc;
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::NETWORK_URCS, status);
 
-        status = _modem.cscon(urc, connected);
-        if(status != TP_NBIoT_Interface::NBIOT_OK)
-        {
-            return status;
-        }
+	#if TP_NBIOT_DRIVER_URCS
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			if(_urc_enabled)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+			}
 
-        status = _modem.cereg(urc, reg_status);
-        if(status != TP_NBIoT_Interface::NBIOT_OK)
-        {
-            return status;
-        }
+			const TP_AT_Step steps[] =
+			{
+				{ TP_AT_Command::SET_CSCON, 1, 0, NULL },
+				{ TP_AT_Command::SET_CEREG, 2, 0, NULL },
+				{ TP_AT_Command::SET_NPSMR, 1, 0, NULL }
+			};
 
-        return TP_NBIoT_Interface::NBIOT_OK;
-    }
+			status = run_at_batch(steps, sizeof(steps) / sizeof(steps[0]));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
 
-    return TP_NBIoT_Interface::DRIVER_UNKNOWN;
-}
+			/** URCs are only sent on change so seed the state with a query. This
+			 *  is only possible before the out-of-band handlers are attached, 
+			 *  after which they also capture the query responses. From then on
+			 *  the URC state is authoritative; it is reset to that of a freshly 
+			 *  booted modem whenever the modem reboots and URCs are re-enabled
+			 *  straight away
+			 */
+			if(!_urc_oob_attached)
+			{
+				int urc;
+
+				status = _modem.cscon(urc, _snapshot.connected);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+
+				status = _modem.cereg(urc, _snapshot.registered);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+
+				status = _modem.npsmr(_snapshot.psm);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
 
+				_modem.oob("+CSCON:", callback(this, &TP_NBIoT_Interface::urc_cscon));
+				_modem.oob("+CEREG:", callback(this, &TP_NBIoT_Interface::urc_cereg));
+				_modem.oob("+NPSMR:", callback(this, &TP_NBIoT_Interface::urc_npsmr));
+				_urc_oob_attached = true;
+			}
+
+			_urc_enabled = true;
+			snapshot_confirm();
+			_urc_flags.set(URC_FLAG_STATE_CHANGED);
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
 
-/** Get last known RSRP and RSRQ
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	#else
+		status = TP_NBIoT_Interface::NOT_SUPPORTED;
+
+		return status;
+	#endif /* #if TP_NBIOT_DRIVER_URCS */
+}
+
+/** Dispatch any URCs waiting in the modem UART buffer. Only required
+ *  if the application wants URC state to be updated while it is not
+ *  otherwise calling into the interface
  * 
- * @param &power Address of integer in which to return
- *               last known RSRP
- * @param &quality Address of integer in which to return
- *                 last known RSRQ
- * @return Indicates success or failure reason
+ * @return None
  */
-int TP_NBIoT_Interface::get_csq(int &power, int &quality)
+void TP_NBIoT_Interface::process_urcs()
 {
-    int status = -1;
-
-    if(_driver == TP_NBIoT_Interface::SARAN2)
-    {
-        status = _modem.csq(power, quality);
-        if(status != TP_NBIoT_Interface::NBIOT_OK)
-        {
-            return status;
-        }
+	TP_NBIOT_LOCK();
 
-        return TP_NBIoT_Interface::NBIOT_OK;
-    }
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		#if TP_NBIOT_DRIVER_URCS
+			if(_urc_oob_attached)
+			{
+				_modem.process_oob();
+			}
+		#endif /* #if TP_NBIOT_DRIVER_URCS */
 
-    return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+		if(_deferred_queries != 0 && !modem_in_psm())
+		{
+			run_deferred_queries();
+		}
+	}
 }
 
-/** Return LTE channel number, EARFCN
+/** Is the modem TX/RX circuitry turned on or off? 1 is on, 0 is off.
+ *  A deferred query made in PSM is answered with the status last read
+ *  or set since the module was reset or, if there is none, queued until
+ *  the next wakeup
  * 
- * @param &band Address of TP_NBIoT_Band value in which to store
- *              determined EARFCN
- * @return Indicates success or failure reason
+ * @param &status Address of integer value to which to return the status
+ *                value of the radio
+ * @param mode Whether the module may be woken from PSM to answer
+ * @return Indicates success or failure reason, QUERY_DEFERRED if 
+ *         queued
  */
-int TP_NBIoT_Interface::get_band(TP_NBIoT_Band &band)
+int TP_NBIoT_Interface::get_radio_status(int &radio_status, TP_Query_Mode mode)
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::RADIO_STATUS, status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		SaraN2::Nuestats_t stats;
+		if(mode == TP_Query_Mode::DEFERRED && modem_in_psm())
+		{
+			if(_radio_status < 0)
+			{
+				_deferred_queries |= TP_NBIoT_Interface::DEFERRED_RADIO;
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::QUERY_DEFERRED);
+			}
 
-		status = get_nuestats(stats.data);
+			radio_status = _radio_status;
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		status = _modem.get_radio_status(radio_status);
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
-		if(stats.parameters.earfcn >= EARFCN_B8_LOW && stats.parameters.earfcn <= EARFCN_B8_HIGH)
-		{
-			band = TP_NBIoT_Interface::TP_NBIoT_Band::BAND_8;
-		}
-		else if(stats.parameters.earfcn >= EARFCN_B20_LOW && stats.parameters.earfcn <= EARFCN_B20_HIGH)
-		{
-			band = TP_NBIoT_Interface::TP_NBIoT_Band::BAND_20;
-		}
-		else 
-		{
-			band = TP_NBIoT_Interface::TP_NBIoT_Band::BAND_UNKNOWN;
-		}
+		_radio_status = radio_status;
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}	
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Return operation stats, of a given type, of the module
+/** Disable TX and RX RF circuits
  * 
- * @param *data Point to .data parameter of Nuestats_t struct
- *              to copy data into
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::get_nuestats(char *data)
+int TP_NBIoT_Interface::deactivate_radio()
 {
-    int status = -1;
-
-    if(_driver == TP_NBIoT_Interface::SARAN2)
-    {
-        status = _modem.nuestats(data);
-        if(status != TP_NBIoT_Interface::NBIOT_OK)
-        {
-            return status;
-        }
-
-        return TP_NBIoT_Interface::NBIOT_OK;
-    }
-
-    return TP_NBIoT_Interface::DRIVER_UNKNOWN;
-}
+	TP_NBIOT_LOCK();
 
-/** Allow the platform to automatically attempt to connect to the 
- *  network after power-on or reboot. Will set AT+CFUN=1 and read
- *  the SIM PLMN. Will use APN provided by network.
- * 
- * @return Indicates success or failure reason
- */
-int TP_NBIoT_Interface::enable_autoconnect()
-{
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::AUTOCONNECT, SaraN2::TRUE);
+		status = _modem.deactivate_radio();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
+		_radio_status = 0;
+
 		return TP_NBIoT_Interface::NBIOT_OK;
 	}
 
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Disable previously described autoconnect functionality
+/** Enable TX and RX RF circuits
  * 
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_autoconnect()
+int TP_NBIoT_Interface::activate_radio()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::AUTOCONNECT, SaraN2::FALSE);
+		status = _modem.activate_radio();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
+		_radio_status = 1;
+
 		return TP_NBIoT_Interface::NBIOT_OK;
 	}
 
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Enable CR_0354_0338 scrambling. This is an operator specific 
- *  setting so please confirm with your mobile network provider
- *  if you're unsure as to what to set this to
- * 
+/** Attempt to attach to network GPRS service
+ *
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::enable_scrambling()
+int TP_NBIoT_Interface::gprs_attach()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::SCRAMBLING, SaraN2::TRUE);
+		status = _modem.gprs_attach();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
@@ -721,17 +1257,19 @@ int TP_NBIoT_Interface::enable_scrambling()
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Disable previously described CR_0354_0338 scrambling functionality
- * 
+/** Attempt to detach from network GPRS service
+ *
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_scrambling()
+int TP_NBIoT_Interface::gprs_detach()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::SCRAMBLING, SaraN2::FALSE);
+		status = _modem.gprs_detach();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
@@ -743,19 +1281,20 @@ int TP_NBIoT_Interface::disable_scrambling()
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Enable the scheduling of conflicted NSIB. This is an operator 
- *  specific setting so please confirm with your mobile network 
- *  provider if you're unsure as to what to set this to
- * 
+/** Attempt to automatically register to network
+ *  using SIM card home PLMN
+ *
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::enable_si_avoid()
+int TP_NBIoT_Interface::auto_register_to_network()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::SI_AVOID, SaraN2::TRUE);
+		status = _modem.auto_register_to_network();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
@@ -767,17 +1306,19 @@ int TP_NBIoT_Interface::enable_si_avoid()
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Disable the previously described scheduling of conflicted NSIB
+/** Deregister from network
  * 
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_si_avoid()
+int TP_NBIoT_Interface::deregister_from_network()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::SI_AVOID, SaraN2::FALSE);
+		status = _modem.deregister_from_network();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
@@ -789,789 +1330,5689 @@ int TP_NBIoT_Interface::disable_si_avoid()
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Enable combined EPS/IMSI network attach
+/** Enable entire module Power Save Mode (PSM)
  * 
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::enable_combine_attach()
+int TP_NBIoT_Interface::enable_power_save_mode()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::COMBINE_ATTACH, SaraN2::TRUE);
+		status = _modem.enable_power_save_mode();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
+		_power_save_mode = 1;
+
 		return TP_NBIoT_Interface::NBIOT_OK;
 	}
 
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Disable combined EPS/IMSI network attach
+/** Disable entire module Power Save Mode (PSM)
  * 
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_combine_attach()
+int TP_NBIoT_Interface::disable_power_save_mode()
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::COMBINE_ATTACH, SaraN2::FALSE);
+		status = _modem.disable_power_save_mode();
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
+		_power_save_mode = 0;
+
 		return TP_NBIoT_Interface::NBIOT_OK;
 	}
 
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Enable RRC cell reselection
- * 
- * @return Indicates success or failure reason
+/** Query whether or not Power Save Mode (PSM) is enabled. A deferred
+ *  query made in PSM is answered with the setting last read or written
+ *  since the module was reset or, if there is none, queued until the 
+ *  next wakeup
+ *  
+ * @param &power_save_mode Address of integer in which to store
+ *                         value of power save mode setting. 1 
+ *                         means that PSM is enabled, 0 means 
+ *                         that PSM is disabled
+ * @param mode Whether the module may be woken from PSM to answer
+ * @return Indicates success or failure reason, QUERY_DEFERRED if 
+ *         queued
  */
-int TP_NBIoT_Interface::enable_cell_reselection()
+int TP_NBIoT_Interface::query_power_save_mode(int &power_save_mode, TP_Query_Mode mode)
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::PSM_QUERY, status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::CELL_RESELECTION, SaraN2::TRUE);
+		if(mode == TP_Query_Mode::DEFERRED && modem_in_psm())
+		{
+			if(_power_save_mode < 0)
+			{
+				_deferred_queries |= TP_NBIoT_Interface::DEFERRED_PSM;
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::QUERY_DEFERRED);
+			}
+
+			power_save_mode = _power_save_mode;
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		status = _modem.query_power_save_mode(power_save_mode);
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		_power_save_mode = power_save_mode;
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Disable RRC cell reselection
+/** Determine whether or not the modem is in power save mode or not
  * 
+ * @param &psm Address of integer in which to store actual PSM value,
+ *             1 = in PSM, 0 = active
  * @return Indicates success or failure reason
- */
-int TP_NBIoT_Interface::disable_cell_reselection()
+ */ 
+int TP_NBIoT_Interface::get_power_save_mode_status(int &psm)
 {
+	TP_NBIOT_LOCK();
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::PSM_STATUS, status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::CELL_RESELECTION, SaraN2::FALSE);
+		if(_urc_oob_attached)
+		{
+			process_urcs();
+			psm = _snapshot.psm;
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		status = _modem.npsmr(psm);
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		_snapshot.psm = psm;
+		snapshot_publish();
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Enable Bearer Independent Protocol (BIP) where BIP is the interface
- *  between the SIM and the ME which provides access to the data bearers
- *  supported by the ME
+/** Return u-blox defined connection status based on radio connection status, 
+ *  network registration status and PSM status. This document can be found in 8.4
+ *  at https://www.u-blox.com/sites/default/files/SARA-N2-Application-Development_AppNote_%28UBX-16017368%29.pdf
  * 
+ * @param &status Address of TP_Connection_Status to return u-blox defined connection
+ *                status to
+ * @param &connected Address of integer value in which to store radio connection status
+ *                   where 1 = connected and 0 is not connected
+ * @param &registered Address of integer value in which to store network registration
+ *                    status. See AT+CEREG=0/AT+CEREG? for possible values
+ * @param &psm Address of integer value in which to store PSM status where 1 = in PSM
+ *             and 0 is in Active mode
  * @return Indicates success or failure reason
- */
-int TP_NBIoT_Interface::enable_bip()
+ */ 
+int TP_NBIoT_Interface::get_module_network_status(TP_Connection_Status &status, int &connected, 
+                                                  int &registered, int &psm)
 {
-	int status = -1;
+	TP_NBIOT_LOCK();
+
+	int func_status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::NETWORK_STATUS, func_status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::ENABLE_BIP, SaraN2::TRUE);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		func_status = get_connection_status(connected, registered);
+		if(func_status != TP_NBIoT_Interface::NBIOT_OK)
 		{
-			return status;
+			return func_status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		func_status = get_power_save_mode_status(psm);
+		if(func_status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return func_status;
+		}
+
+		snapshot_confirm();
+		status = _snapshot.status;
+
+		TP_NBIOT_TRACE_RETURN(func_status, TP_NBIoT_Interface::NBIOT_OK);
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	TP_NBIOT_TRACE_RETURN(func_status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Disable previously described BIP functionality
+/** Return u-blox defined connection status, only querying the modem
+ *  if the cached connection state is older than max_age_ms. If URCs
+ *  are enabled the cached state is always current
  * 
+ * @param &status Address of TP_Connection_Status to return u-blox defined connection
+ *                status to
+ * @param max_age_ms Maximum age of cached state, in milliseconds, that
+ *                   the caller is willing to accept
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_bip()
+int TP_NBIoT_Interface::get_module_network_status(TP_Connection_Status &status, uint32_t max_age_ms)
 {
-	int status = -1;
-
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.configure_ue(SaraN2::ENABLE_BIP, SaraN2::FALSE);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		/** Don't stall behind another thread's operation. Whoever holds the 
+		 *  lock is talking to the module and so handling its URCs already
+		 */
+#if TP_NBIOT_THREAD_SAFE
+		if(_mutex.trylock())
 		{
-			return status;
+			process_urcs();
+			_mutex.unlock();
 		}
+#else
+		process_urcs();
+#endif /* #if TP_NBIOT_THREAD_SAFE */
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		TP_Connection_Snapshot snapshot;
+		get_connection_snapshot(snapshot);
+
+		if(snapshot_is_fresh(snapshot, max_age_ms))
+		{
+			status = snapshot.status;
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		int connected = 0;
+		int registered = 0;
+		int psm = 0;
+
+		return get_module_network_status(status, connected, registered, psm);
 	}
 
 	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** When enabled, the SIM is only powered when it is accessed and will be 
- *  un-powered when not required, i.e. when in PSM
- *
+/** Return a copy of the last known connection state without communicating
+ *  with the modem. Never waits for another thread's operation to finish
+ * 
+ * @param &snapshot Address of TP_Connection_Snapshot in which to store
+ *                  the last known connection state
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::enable_sim_power_save_mode()
+int TP_NBIoT_Interface::get_connection_snapshot(TP_Connection_Snapshot &snapshot)
 {
-	int status = -1;
-
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.configure_ue(SaraN2::NAS_SIM_PSM_ENABLE, SaraN2::TRUE);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-            status = _modem.configure_ue(SaraN2::NAS_SIM_PSM_ENABLE, SaraN2::TRUE);
-			return status;
-		}
-
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+	core_util_critical_section_enter();
+	snapshot = _snapshot_published;
+	core_util_critical_section_exit();
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Disable previously described SIM PSM
- *
+/** Return the outcome of the last AT batch, i.e. which command of
+ *  configure_coap(), start() or set_psm_timers() failed and with what
+ *  status, without communicating with the modem
+ * 
+ * @param &report Address of TP_AT_Batch_Report in which to store the
+ *                outcome of the last batch
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::disable_sim_power_save_mode()
+int TP_NBIoT_Interface::get_at_batch_report(TP_AT_Batch_Report &report)
 {
-	int status = -1;
-
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.configure_ue(SaraN2::NAS_SIM_PSM_ENABLE, SaraN2::FALSE);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	TP_NBIOT_LOCK();
 
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
+	report = _at_batch;
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Configure CoAP profile 0 with a given IP address, port and URI
- *
- * @param *ipv4 Pointer to a byte array storing the IPv4 address of the 
- *              destination server as a string, for example:
- *              char ipv4[] = "168.134.102.18"; 
- * @param port Destination server port
- * @param *uri Pointer to a byte array storing the URI, for example:
- *             char uri[] = "http://coap.me:5683/sink";
- * @param uri_length Number of characters in URI, cannot be greater
- *                   than 200
+/** Return the RAM held by this interface, broken down by buffer, 
+ *  without communicating with the modem. Doesn't wait for the 
+ *  interface lock, so it can be called while the worker is busy
+ * 
+ * @param &footprint Address of TP_RAM_Footprint in which to store
+ *                   the sizes
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::configure_coap(char *ipv4, uint16_t port, char *uri, uint8_t uri_length)
+int TP_NBIoT_Interface::get_ram_footprint(TP_RAM_Footprint &footprint)
 {
-	int status = -1;
+	footprint = ram_footprint();
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
-	{
-		status = _modem.select_profile(SaraN2::COAP_PROFILE_0);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+	#if TP_NBIOT_ASYNC
+		if(_worker_started)
 		{
-			return status;
+			footprint.worker_stack_peak = _worker.max_stack();
 		}
+	#endif /* #if TP_NBIOT_ASYNC */
 
-		status = _modem.set_coap_ip_port(ipv4, port);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
 
-		status = _modem.set_coap_uri(uri, uri_length);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+/** Re-derive the connection status of the snapshot from its connected,
+ *  registered and psm values and mark it as confirmed now
+ * 
+ * @return None
+ */
+void TP_NBIoT_Interface::snapshot_confirm()
+{
+	TP_NBIOT_STAT(stats_note_status());
 
-		status = _modem.pdu_header_add_uri_path();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	_snapshot.status = derive_connection_status(_snapshot.connected, _snapshot.registered, _snapshot.psm);
+	_snapshot.timestamp_ms = Kernel::get_ms_count();
+	_snapshot.valid = true;
 
-		status = _modem.set_profile_validity(SaraN2::PROFILE_VALID);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
-
-		status = _modem.save_profile(SaraN2::COAP_PROFILE_0);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
-		return TP_NBIoT_Interface::NBIOT_OK;
-	}
-
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	snapshot_publish();
 }
 
-/** Perform a HTTP GET request over CoAP and capture the server
- *  response in recv_data
- *
- * @param *recv_data Pointer to a byte array that will be populated
- *              	 with the response from the server
- * @param &response_code Address of integer where CoAP operation response code
- *                       will be stored
- * @return Indicates success or failure reason
+/** Copy the working snapshot to the one read by get_connection_snapshot().
+ *  The copy is brief so is made with interrupts masked rather than under
+ *  the lock, which may be held for a whole upload
+ * 
+ * @return None
  */
-int TP_NBIoT_Interface::coap_get(char *recv_data, int &response_code)
+void TP_NBIoT_Interface::snapshot_publish()
 {
-	int status = -1;
+	core_util_critical_section_enter();
+	_snapshot_published = _snapshot;
+	core_util_critical_section_exit();
+}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+/** Is the cached connection state no older than max_age_ms?
+ * 
+ * @param &snapshot Snapshot to check
+ * @param max_age_ms Maximum age in milliseconds
+ * @return True if the snapshot may be used
+ */
+bool TP_NBIoT_Interface::snapshot_is_fresh(const TP_Connection_Snapshot &snapshot, uint32_t max_age_ms)
+{
+	if(!snapshot.valid)
 	{
-		status = _modem.load_profile(SaraN2::COAP_PROFILE_0);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+		return false;
+	}
 
-		status = _modem.select_coap_at_interface();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	/** The out-of-band handlers see every change, so the state is current
+	 *  regardless of when it last changed
+	 */
+	if(_urc_oob_attached)
+	{
+		return true;
+	}
 
-		status = _modem.coap_get(recv_data, response_code);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+	return Kernel::get_ms_count() - snapshot.timestamp_ms <= max_age_ms;
+}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+/** Map radio connection, network registration and PSM status onto
+ *  the u-blox defined connection status
+ * 
+ * @param connected Radio connection status
+ * @param registered Network registration status
+ * @param psm PSM status
+ * @return u-blox defined connection status
+ */
+TP_NBIoT_Interface::TP_Connection_Status TP_NBIoT_Interface::derive_connection_status(int connected, int registered, int psm)
+{
+	if(registered == 0 && connected == 0 && psm == 0)
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_NO_NETWORK_ACTIVITY;
+	}
+	else if(registered == 2 && connected == 0 && psm == 0)
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_SCANNING_FOR_BASE_STATION;
+	}
+	else if(registered == 2 && connected == 1 && psm == 0)
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_STARTING_REGISTRATION;
+	}
+	else if((registered == 1 || registered == 5) && (connected == 1 && psm == 0))
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_REGISTERED_RRC_CONNECTED;
+	}
+	else if((registered == 1 || registered == 5) && (connected == 0 && psm == 0))
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED;
+	}
+	else if((registered == 1 || registered == 5) && (connected == 0 && psm == 1))
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::PSM_REGISTERED;
+	}
+	else if(registered == 3)
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::REGISTRATION_FAILED;
+	}
+	else
+	{
+		return TP_NBIoT_Interface::TP_Connection_Status::STATE_UNDEFINED;
 	}
-	
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Perform a HTTP DELETE request over CoAP and capture the server
- *  response in recv_data
- *
- * @param *recv_data Pointer to a byte array that will be populated
- *              	 with the response from the server
- * @param &response_code Address of integer where CoAP operation response code
- *                       will be stored
+/** Is the given connection status one in which the module is registered
+ *  to the network?
+ * 
+ * @param status u-blox defined connection status
+ * @return True if registered
+ */
+bool TP_NBIoT_Interface::is_registered(TP_Connection_Status status)
+{
+	return status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_CONNECTED ||
+		   status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED ||
+		   status == TP_Connection_Status::PSM_REGISTERED;
+}
+
+/** Wait for the module to register to the network, either by waiting
+ *  for URCs or, if they are not enabled, by polling
+ * 
+ * @param timeout_s Timeout period in seconds
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::coap_delete(char *recv_data, int &response_code)
+int TP_NBIoT_Interface::wait_for_registration(uint16_t timeout_s)
 {
 	int status = -1;
-
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	TP_Connection_Status conn_status;
+	int connected = 0;
+	int registered = 0;
+	int psm = 0;
+	time_t start_time = time(NULL);
+
+	#if TP_NBIOT_STATS
+		uint64_t attach_start_ms = Kernel::get_ms_count();
+		_stats.attach_attempts++;
+	#endif /* #if TP_NBIOT_STATS */
+
+	while(true)
 	{
-		status = _modem.load_profile(SaraN2::COAP_PROFILE_0);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		status = get_module_network_status(conn_status, connected, registered, psm);
+		if(status == TP_NBIoT_Interface::NBIOT_OK && is_registered(conn_status))
 		{
-			return status;
+			#if TP_NBIOT_STATS
+				uint32_t attach_ms = (uint32_t)(Kernel::get_ms_count() - attach_start_ms);
+				_stats.attach_successes++;
+				_stats.attach_time_total_ms += attach_ms;
+				_stats.attach_time_max_ms = attach_ms > _stats.attach_time_max_ms ? attach_ms : _stats.attach_time_max_ms;
+			#endif /* #if TP_NBIOT_STATS */
+
+			return TP_NBIoT_Interface::NBIOT_OK;
 		}
 
-		status = _modem.select_coap_at_interface();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		time_t current_time = time(NULL);
+		if(current_time >= start_time + timeout_s)
 		{
-			return status;
+			return TP_NBIoT_Interface::FAIL_TO_CONNECT;
 		}
 
-		status = _modem.coap_delete(recv_data, response_code);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		if(_urc_oob_attached)
 		{
-			return status;
+			/** Sleep until the modem sends something, which is then dispatched
+			 *  by get_module_network_status() at the top of the loop 
+			 */
+			uint32_t remaining_ms = (uint32_t)(start_time + timeout_s - current_time) * 1000;
+			_urc_flags.wait_any(URC_FLAG_UART_ACTIVITY | URC_FLAG_STATE_CHANGED, remaining_ms);
+		}
+		else
+		{
+			ThisThread::sleep_for(2500);
 		}
-
-		return TP_NBIoT_Interface::NBIOT_OK;
 	}
-	
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
 }
 
-/** Perform a PUT request using CoAP and save the returned 
- *  data into recv_data
+/** Forget URC state, i.e. because the modem has been reset and
+ *  has disabled URCs
  * 
- * @param *send_data Pointer to a byte array containing the 
- *                   data to be sent to the server
- * @param *recv_data Pointer to a byte array where the data 
- *                   returned from the server will be stored
- * @param data_intenfier Integer value representing the data 
- *                       format type. Possible values are enumerated
- *                       in the driver header file, i.e. TEXT_PLAIN
- * @param &response_code Address of integer where CoAP operation response code
- *                       will be stored
- * @return Indicates success or failure reason
- */ 
-int TP_NBIoT_Interface::coap_put(char *send_data, char *recv_data, int data_indentifier, int &response_code)
+ * @return None
+ */
+void TP_NBIoT_Interface::urc_reset()
 {
-	int status = -1;
+	_urc_enabled = false;
+	_snapshot.connected = 0;
+	_snapshot.registered = 0;
+	_snapshot.psm = 0;
+	snapshot_confirm();
+
+	/** Without out-of-band handlers nothing will keep the snapshot up to
+	 *  date so don't let it stand in for a query
+	 */
+	_snapshot.valid = _urc_oob_attached;
+	_snapshot.radio_valid = false;
+	_snapshot.earfcn_valid = false;
+	_gate_measured = false;
+	_radio_status = -1;
+	_power_save_mode = -1;
+
+	snapshot_publish();
+}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+#if TP_NBIOT_DRIVER_URCS
+	/** Called from UART interrupt context whenever data is received from modem
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::urc_sigio()
 	{
-		status = _modem.load_profile(SaraN2::COAP_PROFILE_0);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		_urc_flags.set(URC_FLAG_UART_ACTIVITY);
+
+		/** A +NSONMI may be waiting to be dispatched with nobody else using
+		 *  the modem, only the worker would see it. Most activity is AT 
+		 *  responses, during which whoever is reading them dispatches the URC,
+		 *  so the worker is only woken once the UART has settled
+		 */
+		#if TP_NBIOT_ASYNC && TP_NBIOT_DRIVER_SOCKETS
+			if(_downlink_enabled)
+			{
+				core_util_critical_section_enter();
+				_downlink_activity_ms = (uint32_t)Kernel::get_ms_count();
+				bool arm = !_downlink_settling;
+				_downlink_settling = true;
+				core_util_critical_section_exit();
+
+				if(arm)
+				{
+					_downlink_settle.attach_us(callback(this, &TP_NBIoT_Interface::downlink_settled), 
+											   TP_NBIOT_DOWNLINK_SETTLE_MS * 1000);
+				}
+			}
+		#endif /* #if TP_NBIOT_ASYNC && TP_NBIOT_DRIVER_SOCKETS */
+	}
+
+	/** Out-of-band handler for +CSCON. The URC carries <mode> and the
+	 *  query response carries <n>,<mode>
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::urc_cscon()
+	{
+		int first = 0;
+		int second = 0;
+
+		int fields = urc_read_fields(first, second);
+		if(fields > 0)
 		{
-			return status;
+			_snapshot.connected = fields == 2 ? second : first;
+			snapshot_confirm();
+			_urc_flags.set(URC_FLAG_STATE_CHANGED);
 		}
+	}
 
-		status = _modem.select_coap_at_interface();
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+	/** Out-of-band handler for +CEREG. The URC carries <stat>[,...] and the
+	 *  query response carries <n>,<stat>[,...]. Quoted fields following
+	 *  <stat> are not parsed as integers, so there is no ambiguity
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::urc_cereg()
+	{
+		int first = 0;
+		int second = 0;
+
+		int fields = urc_read_fields(first, second);
+		if(fields > 0)
 		{
-			return status;
+			_snapshot.registered = fields == 2 ? second : first;
+			_gate_measured = false;
+			snapshot_confirm();
+			_urc_flags.set(URC_FLAG_STATE_CHANGED);
 		}
+	}
 
-		status = _modem.coap_put(send_data, recv_data, data_indentifier, response_code);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+	/** Out-of-band handler for +NPSMR. The URC carries <mode> and the
+	 *  query response carries <n>,<mode>
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::urc_npsmr()
+	{
+		int first = 0;
+		int second = 0;
+
+		int fields = urc_read_fields(first, second);
+		if(fields > 0)
 		{
-			return status;
+			_snapshot.psm = fields == 2 ? second : first;
+			snapshot_confirm();
+			_urc_flags.set(URC_FLAG_STATE_CHANGED);
 		}
-
-		return TP_NBIoT_Interface::NBIOT_OK;
 	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
-}
+	/** Read the remainder of a URC and return its first and, if present,
+	 *  second integer fields
+	 * 
+	 * @param &first Address of integer in which to store first field
+	 * @param &second Address of integer in which to store second field,
+	 *                untouched if not present
+	 * @return Number of integer fields parsed
+	 */
+	int TP_NBIoT_Interface::urc_read_fields(int &first, int &second)
+	{
+		TP_NBIOT_SCRATCH(TP_URC_Line, line, urc_line);
 
-/** Perform a POST request using CoAP and save the returned 
- *  data into recv_data
+		if(!_modem.recv("%47[^\r\n]", line))
+		{
+			return 0;
+		}
+
+		int fields = sscanf(line, "%d,%d", &first, &second);
+
+		return fields < 0 ? 0 : fields;
+	}
+#endif /* #if TP_NBIOT_DRIVER_URCS */
+
+/** Query UE for radio connection and network registration status
  * 
- * @param *send_data Pointer to a byte array containing the 
- *                   data to be sent to the server
- * @param *recv_data Pointer to a byte array where the data 
- *                   returned from the server will be stored
- * @param data_intenfier Integer value representing the data 
- *                       format type. Possible values are enumerated
- *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
- * @param &response_code Address of integer where CoAP operation response code
- *                       will be stored
+ * @param &connected Address of integer in which to store radio 
+ *                   connection status
+ * @param &reg_status Address of integer in which to store
+ *                    network registration status
  * @return Indicates success or failure reason
- */ 
-int TP_NBIoT_Interface::coap_post(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
-                                    uint8_t send_block_number, uint8_t send_more_block, int &response_code)
+ */
+int TP_NBIoT_Interface::get_connection_status(int &connected, int &reg_status)
 {
+    TP_NBIOT_LOCK();
+
     int status = -1;
+    TP_NBIOT_TRACE(TP_Perf_Operation::CONNECTION_STATUS, status);
+
     if(_driver == TP_NBIoT_Interface::SARAN2)
     {
-        //todo: load_profile and select_coap_at_interface outside of loop?
-        status = _modem.load_profile(SaraN2::COAP_PROFILE_0);
+        if(_urc_oob_attached)
+        {
+            process_urcs();
+            connected = _snapshot.connected;
+            reg_status = _snapshot.registered;
+
+            TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+        }
+
+        int urc;
+
+        status = _modem.cscon(urc, connected);
         if(status != TP_NBIoT_Interface::NBIOT_OK)
         {
             return status;
         }
 
-        status = _modem.select_coap_at_interface();
+        status = _modem.cereg(urc, reg_status);
         if(status != TP_NBIoT_Interface::NBIOT_OK)
         {
             return status;
         }
-        
-        status = _modem.coap_post(send_data, buffer_len, recv_data, data_indentifier, send_block_number, 
-                                send_more_block, response_code);
 
-        if(status != TP_NBIoT_Interface::NBIOT_OK)
-        {
-            return status;
-        }
-        return TP_NBIoT_Interface::NBIOT_OK;
-    }
+        _snapshot.connected = connected;
+        _snapshot.registered = reg_status;
+        snapshot_publish();
+
+        TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+    }
+
+    TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+
+/** Get last known RSRP and RSRQ. A deferred query made in PSM is 
+ *  answered from the snapshot or, if there is nothing cached, queued 
+ *  until the next wakeup
+ * 
+ * @param &power Address of integer in which to return
+ *               last known RSRP
+ * @param &quality Address of integer in which to return
+ *                 last known RSRQ
+ * @param mode Whether the module may be woken from PSM to answer
+ * @return Indicates success or failure reason, QUERY_DEFERRED if 
+ *         queued
+ */
+int TP_NBIoT_Interface::get_csq(int &power, int &quality, TP_Query_Mode mode)
+{
+    TP_NBIOT_LOCK();
+
+    int status = -1;
+    TP_NBIOT_TRACE(TP_Perf_Operation::CSQ, status);
+
+    if(_driver == TP_NBIoT_Interface::SARAN2)
+    {
+        if(mode == TP_Query_Mode::DEFERRED && modem_in_psm())
+        {
+            if(!_snapshot.radio_valid)
+            {
+                _deferred_queries |= TP_NBIoT_Interface::DEFERRED_CSQ;
+                TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::QUERY_DEFERRED);
+            }
+
+            power = _snapshot.rsrp;
+            quality = _snapshot.rsrq;
+
+            TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+        }
+
+        status = _modem.csq(power, quality);
+        if(status != TP_NBIoT_Interface::NBIOT_OK)
+        {
+            return status;
+        }
+
+        _snapshot.rsrp = power;
+        _snapshot.rsrq = quality;
+        _snapshot.radio_timestamp_ms = Kernel::get_ms_count();
+        _snapshot.radio_valid = true;
+        snapshot_publish();
+
+        TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+    }
+
+    TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Return LTE channel number, EARFCN. The EARFCN of the snapshot is
+ *  used if no older than TP_NBIOT_BAND_MAX_AGE_MS
+ * 
+ * @param &band Address of TP_NBIoT_Band value in which to store
+ *              determined EARFCN
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_band(TP_NBIoT_Band &band)
+{
+	TP_NBIOT_LOCK();
+
+	return get_band(band, TP_NBIOT_BAND_MAX_AGE_MS);
+}
+
+/** Return LTE channel number, EARFCN. The EARFCN of the snapshot is
+ *  used if no older than max_age_ms, otherwise only the RADIO 
+ *  NUESTATS category is queried. A deferred query made in PSM uses
+ *  the snapshot regardless of age or, if there is nothing cached, is
+ *  queued until the next wakeup
+ * 
+ * @param &band Address of TP_NBIoT_Band value in which to store
+ *              determined EARFCN
+ * @param max_age_ms Maximum age of cached EARFCN, in milliseconds, 
+ *                   that the caller is willing to accept
+ * @param mode Whether the module may be woken from PSM to answer
+ * @return Indicates success or failure reason, QUERY_DEFERRED if 
+ *         queued
+ */
+int TP_NBIoT_Interface::get_band(TP_NBIoT_Band &band, uint32_t max_age_ms, TP_Query_Mode mode)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::BAND, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		if(mode == TP_Query_Mode::DEFERRED && modem_in_psm())
+		{
+			if(!_snapshot.earfcn_valid)
+			{
+				_deferred_queries |= TP_NBIoT_Interface::DEFERRED_BAND;
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::QUERY_DEFERRED);
+			}
+
+			max_age_ms = UINT32_MAX;
+		}
+
+		if(!_snapshot.earfcn_valid || Kernel::get_ms_count() - _snapshot.earfcn_timestamp_ms > max_age_ms)
+		{
+			#if TP_NBIOT_DRIVER_NUESTATS
+				TP_NBIOT_SCRATCH(TP_Nuestats_Radio, radio, radio);
+
+				status = get_nuestats(radio);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+			#else
+				/** Without typed queries the EARFCN is taken from the driver's
+				 *  own parse of AT+NUESTATS
+				 */
+				SaraN2::Nuestats_t stats;
+
+				status = get_nuestats(stats.data);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+
+				_snapshot.earfcn = stats.parameters.earfcn;
+				_snapshot.earfcn_timestamp_ms = Kernel::get_ms_count();
+				_snapshot.earfcn_valid = true;
+				snapshot_publish();
+			#endif /* #if TP_NBIOT_DRIVER_NUESTATS */
+		}
+
+		band = band_from_earfcn(_snapshot.earfcn);
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Return operation stats, of a given type, of the module
+ * 
+ * @param *data Point to .data parameter of Nuestats_t struct
+ *              to copy data into
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_nuestats(char *data)
+{
+    TP_NBIOT_LOCK();
+
+    int status = -1;
+    TP_NBIOT_TRACE(TP_Perf_Operation::NUESTATS, status);
+
+    if(_driver == TP_NBIoT_Interface::SARAN2)
+    {
+        status = _modem.nuestats(data);
+        if(status != TP_NBIoT_Interface::NBIOT_OK)
+        {
+            return status;
+        }
+
+        TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+    }
+
+    TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Query only the RADIO NUESTATS category of the module. The
+ *  snapshot EARFCN is updated from the result
+ * 
+ * @param &radio Address of TP_Nuestats_Radio in which to store values
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_NUESTATS
+ */
+int TP_NBIoT_Interface::get_nuestats(TP_Nuestats_Radio &radio)
+{
+	TP_NBIOT_LOCK();
+
+	radio = {};
+
+	int status = query_nuestats(TP_Nuestats_Type::RADIO, &radio);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	_snapshot.earfcn = radio.earfcn;
+	_recovery_cell_id = radio.cell_id;
+	_psm_rsrp_dbm = radio.signal_power / 10;
+	_psm_snr_db = radio.snr / 10;
+	_psm_radio_valid = true;
+	_snapshot.earfcn_timestamp_ms = Kernel::get_ms_count();
+	_snapshot.earfcn_valid = true;
+	snapshot_publish();
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Query only the CELL NUESTATS category of the module
+ * 
+ * @param &cell Address of TP_Nuestats_Cell in which to store values
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_NUESTATS
+ */
+int TP_NBIoT_Interface::get_nuestats(TP_Nuestats_Cell &cell)
+{
+	TP_NBIOT_LOCK();
+
+	cell = {};
+
+	return query_nuestats(TP_Nuestats_Type::CELL, &cell);
+}
+
+/** Query only the BLER NUESTATS category of the module
+ * 
+ * @param &bler Address of TP_Nuestats_BLER in which to store values
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_NUESTATS
+ */
+int TP_NBIoT_Interface::get_nuestats(TP_Nuestats_BLER &bler)
+{
+	TP_NBIOT_LOCK();
+
+	bler = {};
+
+	return query_nuestats(TP_Nuestats_Type::BLER, &bler);
+}
+
+/** Query only the THP NUESTATS category of the module
+ * 
+ * @param &thp Address of TP_Nuestats_THP in which to store values
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_NUESTATS
+ */
+int TP_NBIoT_Interface::get_nuestats(TP_Nuestats_THP &thp)
+{
+	TP_NBIOT_LOCK();
+
+	thp = {};
+
+	return query_nuestats(TP_Nuestats_Type::THP, &thp);
+}
+
+/** Query only the APPSMEM NUESTATS category of the module
+ * 
+ * @param &appsmem Address of TP_Nuestats_APPSMEM in which to store values
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_NUESTATS
+ */
+int TP_NBIoT_Interface::get_nuestats(TP_Nuestats_APPSMEM &appsmem)
+{
+	TP_NBIOT_LOCK();
+
+	appsmem = {};
+
+	return query_nuestats(TP_Nuestats_Type::APPSMEM, &appsmem);
+}
+
+/** Allow the platform to automatically attempt to connect to the 
+ *  network after power-on or reboot. Will set AT+CFUN=1 and read
+ *  the SIM PLMN. Will use APN provided by network.
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_autoconnect()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::AUTOCONNECT, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_AUTOCONNECT, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable previously described autoconnect functionality
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_autoconnect()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::AUTOCONNECT, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_AUTOCONNECT, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Enable CR_0354_0338 scrambling. This is an operator specific 
+ *  setting so please confirm with your mobile network provider
+ *  if you're unsure as to what to set this to
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_scrambling()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::SCRAMBLING, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_SCRAMBLING, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable previously described CR_0354_0338 scrambling functionality
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_scrambling()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::SCRAMBLING, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_SCRAMBLING, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Enable the scheduling of conflicted NSIB. This is an operator 
+ *  specific setting so please confirm with your mobile network 
+ *  provider if you're unsure as to what to set this to
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_si_avoid()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::SI_AVOID, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_SI_AVOID, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable the previously described scheduling of conflicted NSIB
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_si_avoid()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::SI_AVOID, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_SI_AVOID, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Enable combined EPS/IMSI network attach
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_combine_attach()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::COMBINE_ATTACH, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_COMBINE_ATTACH, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable combined EPS/IMSI network attach
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_combine_attach()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::COMBINE_ATTACH, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_COMBINE_ATTACH, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Enable RRC cell reselection
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_cell_reselection()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::CELL_RESELECTION, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_CELL_RESELECTION, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable RRC cell reselection
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_cell_reselection()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::CELL_RESELECTION, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_CELL_RESELECTION, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Enable Bearer Independent Protocol (BIP) where BIP is the interface
+ *  between the SIM and the ME which provides access to the data bearers
+ *  supported by the ME
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_bip()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::ENABLE_BIP, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_BIP, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable previously described BIP functionality
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_bip()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::ENABLE_BIP, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_BIP, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** When enabled, the SIM is only powered when it is accessed and will be 
+ *  un-powered when not required, i.e. when in PSM
+ *
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::enable_sim_power_save_mode()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::NAS_SIM_PSM_ENABLE, SaraN2::TRUE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+            status = _modem.configure_ue(SaraN2::NAS_SIM_PSM_ENABLE, SaraN2::TRUE);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+		}
+
+		ue_config_cache(UE_SIM_PSM, true);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Disable previously described SIM PSM
+ *
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::disable_sim_power_save_mode()
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.configure_ue(SaraN2::NAS_SIM_PSM_ENABLE, SaraN2::FALSE);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		ue_config_cache(UE_SIM_PSM, false);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Configure CoAP profile 0 with a given IP address, port and URI and
+ *  select it for subsequent CoAP requests. Profile 0 is only written
+ *  if it does not already hold this endpoint and never while another 
+ *  endpoint registered with register_endpoint() holds it
+ *
+ * @param *ipv4 Pointer to a byte array storing the IPv4 address of the 
+ *              destination server as a string, for example:
+ *              char ipv4[] = "168.134.102.18"; 
+ * @param port Destination server port
+ * @param *uri Pointer to a byte array storing the URI, for example:
+ *             char uri[] = "http://coap.me:5683/sink";
+ * @param uri_length Number of characters in URI, cannot be greater
+ *                   than TP_NBIOT_COAP_URI_MAX_LENGTH
+ * @return Indicates success or failure reason, ENDPOINT_IN_USE if
+ *         profile 0 holds a registered endpoint
+ */
+int TP_NBIoT_Interface::configure_coap(char *ipv4, uint16_t port, char *uri, uint8_t uri_length)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::CONFIGURE_COAP, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		if(uri_length > TP_NBIOT_COAP_URI_MAX_LENGTH || strlen(ipv4) >= sizeof(_coap_endpoints[0].ipv4))
+		{
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::EXCEEDS_MAX_VALUE);
+		}
+
+		/** Profile 0 is left as is if it holds the endpoint, including one
+		 *  restored by resume()
+		 */
+		if(!endpoint_revalidate(0, ipv4, port, uri, uri_length) &&
+		   (!(_coap_endpoints_used & 0x01) || !endpoint_matches(_coap_endpoints[0], ipv4, port, uri, uri_length)))
+		{
+			if(_coap_endpoints_registered & 0x01)
+			{
+				status = TP_NBIoT_Interface::ENDPOINT_IN_USE;
+				return status;
+			}
+
+			_coap_endpoints_used &= ~0x01;
+			_coap_endpoints_restored &= ~0x01;
+
+			status = write_coap_profile(SaraN2::COAP_PROFILE_0, ipv4, port, uri, uri_length);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			endpoint_set(_coap_endpoints[0], ipv4, port, uri, uri_length);
+			_coap_endpoints_used |= 0x01;
+		}
+
+		_coap_selected_profile = SaraN2::COAP_PROFILE_0;
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Save an endpoint into a free CoAP profile of the module so that it 
+ *  can later be selected with select_endpoint() without reconfiguring. 
+ *  If the endpoint is already registered its existing handle is 
+ *  returned without communicating with the modem
+ *
+ * @param *ipv4 Pointer to a byte array storing the IPv4 address of the 
+ *              destination server as a string
+ * @param port Destination server port
+ * @param *uri Pointer to a byte array storing the URI
+ * @param uri_length Number of characters in URI, cannot be greater
+ *                   than TP_NBIOT_COAP_URI_MAX_LENGTH
+ * @param &handle Address of integer in which to store the endpoint handle
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::register_endpoint(char *ipv4, uint16_t port, char *uri, uint8_t uri_length, int &handle)
+{
+	TP_NBIOT_LOCK();
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		if(uri_length > TP_NBIOT_COAP_URI_MAX_LENGTH || strlen(ipv4) >= sizeof(_coap_endpoints[0].ipv4))
+		{
+			return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+		}
+
+		int free_profile = TP_NBIoT_Interface::NO_COAP_PROFILE;
+
+		for(int profile = 0; profile < TP_NBIOT_COAP_PROFILES; profile++)
+		{
+			if(endpoint_revalidate(profile, ipv4, port, uri, uri_length) ||
+			   ((_coap_endpoints_used & (1 << profile)) && 
+			    endpoint_matches(_coap_endpoints[profile], ipv4, port, uri, uri_length)))
+			{
+				_coap_endpoints_registered |= (1 << profile);
+				handle = profile;
+				return TP_NBIoT_Interface::NBIOT_OK;
+			}
+
+			if(!((_coap_endpoints_used | _coap_endpoints_restored) & (1 << profile)) &&
+			   free_profile == TP_NBIoT_Interface::NO_COAP_PROFILE)
+			{
+				free_profile = profile;
+			}
+		}
+
+		if(free_profile == TP_NBIoT_Interface::NO_COAP_PROFILE)
+		{
+			return TP_NBIoT_Interface::NO_FREE_ENDPOINT;
+		}
+
+		int status = write_coap_profile(SaraN2::COAP_PROFILE_0 + free_profile, ipv4, port, uri, uri_length);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		endpoint_set(_coap_endpoints[free_profile], ipv4, port, uri, uri_length);
+		_coap_endpoints_used |= (1 << free_profile);
+		_coap_endpoints_registered |= (1 << free_profile);
+		handle = free_profile;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Release the CoAP profile held by an endpoint so that it can be reused
+ *  by register_endpoint(). The profile saved in the module is left as is
+ *
+ * @param handle Endpoint handle returned by register_endpoint()
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::unregister_endpoint(int handle)
+{
+	TP_NBIOT_LOCK();
+
+	if(handle < 0 || handle >= TP_NBIOT_COAP_PROFILES || !(_coap_endpoints_registered & (1 << handle)))
+	{
+		return TP_NBIoT_Interface::INVALID_ENDPOINT;
+	}
+
+	_coap_endpoints_used &= ~(1 << handle);
+	_coap_endpoints_registered &= ~(1 << handle);
+	_coap_endpoints_restored &= ~(1 << handle);
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Direct subsequent CoAP requests made without an endpoint handle to
+ *  an endpoint. Asynchronous requests already queued keep the endpoint
+ *  selected when they were queued. The profile is only loaded by the 
+ *  next request and only if not already loaded, so switching costs at
+ *  most one AT command. Threads sharing the interface should pass 
+ *  their endpoint handle to coap_post() or coap_post_async() instead
+ *
+ * @param handle Endpoint handle returned by register_endpoint()
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::select_endpoint(int handle)
+{
+	TP_NBIOT_LOCK();
+
+	if(handle < 0 || handle >= TP_NBIOT_COAP_PROFILES || !(_coap_endpoints_registered & (1 << handle)))
+	{
+		return TP_NBIoT_Interface::INVALID_ENDPOINT;
+	}
+
+	_coap_selected_profile = SaraN2::COAP_PROFILE_0 + handle;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Return the CoAP profile of an endpoint handle passed to a request
+ * 
+ * @param endpoint Endpoint handle returned by register_endpoint() or
+ *                 SELECTED_ENDPOINT
+ * @param &profile Address of integer in which to store the profile
+ * @return Indicates success or failure reason, INVALID_ENDPOINT if 
+ *         the handle isn't registered
+ */
+int TP_NBIoT_Interface::endpoint_profile(int endpoint, int &profile)
+{
+	if(endpoint == TP_NBIoT_Interface::SELECTED_ENDPOINT)
+	{
+		profile = _coap_selected_profile;
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	if(endpoint < 0 || endpoint >= TP_NBIOT_COAP_PROFILES || !(_coap_endpoints_registered & (1 << endpoint)))
+	{
+		return TP_NBIoT_Interface::INVALID_ENDPOINT;
+	}
+
+	profile = SaraN2::COAP_PROFILE_0 + endpoint;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Write an endpoint into a CoAP profile of the module and save it
+ *
+ * @param profile CoAP profile to write
+ * @param *ipv4 Pointer to IPv4 address string
+ * @param port Destination server port
+ * @param *uri Pointer to URI
+ * @param uri_length Number of characters in URI
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::write_coap_profile(int profile, char *ipv4, uint16_t port, char *uri, uint8_t uri_length)
+{
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		coap_session_reset();
+
+		const TP_AT_Step steps[] =
+		{
+			{ TP_AT_Command::SELECT_PROFILE,       profile,                0, NULL },
+			{ TP_AT_Command::SET_COAP_IP_PORT,     port,                   0, ipv4 },
+			{ TP_AT_Command::SET_COAP_URI,         uri_length,             0, uri  },
+			{ TP_AT_Command::ADD_URI_PATH,         0,                      0, NULL },
+			{ TP_AT_Command::SET_PROFILE_VALIDITY, SaraN2::PROFILE_VALID,  0, NULL },
+			{ TP_AT_Command::SAVE_PROFILE,         profile,                0, NULL }
+		};
+
+		status = run_at_batch(steps, sizeof(steps) / sizeof(steps[0]));
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Run a batch of commands, stopping at the first to fail. When 
+ *  TP_NBIOT_AT_PIPELINE is set the commands are written back to back 
+ *  and their responses matched in order. The outcome is kept for 
+ *  get_at_batch_report()
+ * 
+ * @param *steps Pointer to the steps of the batch
+ * @param count Number of steps, no greater than TP_NBIOT_AT_BATCH_MAX
+ * @return Indicates success or status of the first command to fail
+ */
+int TP_NBIoT_Interface::run_at_batch(const TP_AT_Step *steps, uint8_t count)
+{
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::AT_BATCH, status);
+
+	/** The longest batch is that of apply_ue_flags(), one per UE setting
+	 */
+	static_assert(TP_NBIOT_AT_BATCH_MAX >= 7, "TP_NBIOT_AT_BATCH_MAX must hold every UE setting");
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		uint64_t start_ms = Kernel::get_ms_count();
+
+		_at_batch.commands = count;
+		_at_batch.completed = 0;
+		_at_batch.pipelined = TP_NBIOT_AT_PIPELINE != 0;
+		_at_batch.duration_ms = 0;
+
+		if(count > TP_NBIOT_AT_BATCH_MAX)
+		{
+			status = TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+			_at_batch.failed_command = steps[0].command;
+			_at_batch.status = status;
+			return status;
+		}
+
+		status = TP_NBIoT_Interface::NBIOT_OK;
+
+		#if TP_NBIOT_AT_PIPELINE
+			/** While pipelining, the driver returns as soon as a command has
+			 *  been written. A command that can't be written ends the batch,
+			 *  responses to those written are then matched in order
+			 */
+			uint8_t written = 0;
+
+			_modem.begin_pipeline();
+
+			while(written < count)
+			{
+				status = issue_at_step(steps[written]);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					break;
+				}
+
+				written++;
+			}
+
+			size_t matched = 0;
+
+			int response_status = _modem.end_pipeline(matched);
+			if(response_status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				status = response_status;
+				written = (uint8_t)matched;
+			}
+
+			_at_batch.completed = written;
+		#else
+			while(_at_batch.completed < count)
+			{
+				status = issue_at_step(steps[_at_batch.completed]);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					break;
+				}
+
+				_at_batch.completed++;
+			}
+		#endif /* #if TP_NBIOT_AT_PIPELINE */
+
+		if(_at_batch.completed < count)
+		{
+			_at_batch.failed_command = steps[_at_batch.completed].command;
+		}
+
+		_at_batch.status = status;
+		_at_batch.duration_ms = (uint32_t)(Kernel::get_ms_count() - start_ms);
+
+		return status;
+	}
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Issue a single command of an AT batch
+ * 
+ * @param &step Address of the step to issue
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::issue_at_step(const TP_AT_Step &step)
+{
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		switch(step.command)
+		{
+			case TP_AT_Command::SELECT_PROFILE:
+			{
+				return _modem.select_profile(step.value);
+			}
+			case TP_AT_Command::SET_COAP_IP_PORT:
+			{
+				return _modem.set_coap_ip_port(step.text, (uint16_t)step.value);
+			}
+			case TP_AT_Command::SET_COAP_URI:
+			{
+				return _modem.set_coap_uri(step.text, (uint8_t)step.value);
+			}
+			case TP_AT_Command::ADD_URI_PATH:
+			{
+				return _modem.pdu_header_add_uri_path();
+			}
+			case TP_AT_Command::SET_PROFILE_VALIDITY:
+			{
+				return _modem.set_profile_validity(step.value);
+			}
+			case TP_AT_Command::SAVE_PROFILE:
+			{
+				return _modem.save_profile(step.value);
+			}
+			case TP_AT_Command::CONFIGURE_UE:
+			{
+				/** value is a UE_* flag, in the order of the driver's settings
+				 */
+				static const int items[] =
+				{
+					SaraN2::AUTOCONNECT, SaraN2::SCRAMBLING, SaraN2::SI_AVOID, SaraN2::COMBINE_ATTACH,
+					SaraN2::CELL_RESELECTION, SaraN2::ENABLE_BIP, SaraN2::NAS_SIM_PSM_ENABLE
+				};
+
+				for(size_t i = 0; i < sizeof(items) / sizeof(items[0]); i++)
+				{
+					if(step.value == (1 << i))
+					{
+						return _modem.configure_ue(items[i], step.option ? SaraN2::TRUE : SaraN2::FALSE);
+					}
+				}
+
+				return TP_NBIoT_Interface::INVALID_UNIT_VALUE;
+			}
+			#if TP_NBIOT_DRIVER_URCS
+				case TP_AT_Command::SET_CSCON:
+				{
+					return _modem.set_cscon(step.value);
+				}
+				case TP_AT_Command::SET_CEREG:
+				{
+					return _modem.set_cereg(step.value);
+				}
+				case TP_AT_Command::SET_NPSMR:
+				{
+					return _modem.set_npsmr(step.value);
+				}
+			#else
+				case TP_AT_Command::SET_CSCON:
+				case TP_AT_Command::SET_CEREG:
+				case TP_AT_Command::SET_NPSMR:
+				{
+					return TP_NBIoT_Interface::NOT_SUPPORTED;
+				}
+			#endif /* #if TP_NBIOT_DRIVER_URCS */
+			case TP_AT_Command::SET_T3412_TIMER:
+			{
+				return _modem.set_t3412_timer(step.text);
+			}
+			case TP_AT_Command::SET_T3324_TIMER:
+			{
+				return _modem.set_t3324_timer(step.text);
+			}
+		}
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Does a cached endpoint match a given IP address, port and URI?
+ *
+ * @param &endpoint Cached endpoint
+ * @param *ipv4 Pointer to IPv4 address string
+ * @param port Destination server port
+ * @param *uri Pointer to URI
+ * @param uri_length Number of characters in URI
+ * @return True if all three match
+ */
+bool TP_NBIoT_Interface::endpoint_matches(const TP_CoAP_Endpoint &endpoint, const char *ipv4, uint16_t port, 
+										  const char *uri, uint8_t uri_length)
+{
+	return endpoint.port == port && endpoint.uri_length == uri_length &&
+		   strncmp(endpoint.ipv4, ipv4, sizeof(endpoint.ipv4)) == 0 &&
+		   memcmp(endpoint.uri, uri, uri_length) == 0;
+}
+
+/** Record the IP address, port and URI held by a CoAP profile
+ *
+ * @param &endpoint Cached endpoint to fill
+ * @param *ipv4 Pointer to IPv4 address string
+ * @param port Destination server port
+ * @param *uri Pointer to URI
+ * @param uri_length Number of characters in URI
+ * @return None
+ */
+void TP_NBIoT_Interface::endpoint_set(TP_CoAP_Endpoint &endpoint, const char *ipv4, uint16_t port, 
+									  const char *uri, uint8_t uri_length)
+{
+	memset(&endpoint, 0, sizeof(endpoint));
+	strncpy(endpoint.ipv4, ipv4, sizeof(endpoint.ipv4) - 1);
+	endpoint.port = port;
+	endpoint.uri_length = uri_length;
+	memcpy(endpoint.uri, uri, uri_length);
+}
+
+/** FNV-1a hash of the IP address, port and URI of an endpoint, by 
+ *  which a saved attach context identifies the endpoint of a profile
+ *
+ * @param *ipv4 Pointer to IPv4 address string
+ * @param port Destination server port
+ * @param *uri Pointer to URI
+ * @param uri_length Number of characters in URI
+ * @return Hash
+ */
+uint32_t TP_NBIoT_Interface::endpoint_hash(const char *ipv4, uint16_t port, const char *uri, uint8_t uri_length)
+{
+	uint32_t hash = 2166136261UL;
+
+	/** The terminator separates the address from the port
+	 */
+	for(size_t i = 0; i <= strlen(ipv4); i++)
+	{
+		hash = (hash ^ (uint8_t)ipv4[i]) * 16777619UL;
+	}
+
+	hash = (hash ^ (port & 0xFF)) * 16777619UL;
+	hash = (hash ^ (port >> 8)) * 16777619UL;
+
+	for(size_t i = 0; i < uri_length; i++)
+	{
+		hash = (hash ^ (uint8_t)uri[i]) * 16777619UL;
+	}
+
+	return hash;
+}
+
+/** Does a profile hold an endpoint restored by resume() that matches
+ *  a given IP address, port and URI? If so it is taken back into the
+ *  endpoint cache
+ *
+ * @param profile CoAP profile
+ * @param *ipv4 Pointer to IPv4 address string
+ * @param port Destination server port
+ * @param *uri Pointer to URI
+ * @param uri_length Number of characters in URI
+ * @return True if the profile holds the endpoint
+ */
+bool TP_NBIoT_Interface::endpoint_revalidate(int profile, const char *ipv4, uint16_t port, const char *uri, uint8_t uri_length)
+{
+	if(!(_coap_endpoints_restored & (1 << profile)) || 
+	   _coap_restored_hashes[profile] != endpoint_hash(ipv4, port, uri, uri_length))
+	{
+		return false;
+	}
+
+	endpoint_set(_coap_endpoints[profile], ipv4, port, uri, uri_length);
+	_coap_endpoints_used |= (1 << profile);
+	_coap_endpoints_restored &= ~(1 << profile);
+
+	return true;
+}
+
+/** FNV-1a checksum of an attach context, excluding the checksum itself
+ *
+ * @param &context Attach context
+ * @return Checksum
+ */
+uint32_t TP_NBIoT_Interface::attach_context_checksum(const TP_Attach_Context &context)
+{
+	const uint8_t *bytes = (const uint8_t *)&context;
+	uint32_t hash = 2166136261UL;
+
+	for(size_t i = 0; i < offsetof(TP_Attach_Context, checksum); i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619UL;
+	}
+
+	return hash;
+}
+
+/** Is a baud rate accepted by AT+NATSPEED?
+ * 
+ * @param baud Baud rate
+ * @return True if supported
+ */
+bool TP_NBIoT_Interface::link_baud_supported(uint32_t baud)
+{
+	static const uint32_t rates[] = { 4800, 9600, 57600, 115200, 230400, 460800, 921600 };
+
+	for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+	{
+		if(rates[i] == baud)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#if TP_NBIOT_DRIVER_LINK_SPEED
+	/** Check that the module answers at the rate the MCU is set to, 
+	 *  allowing TP_NBIOT_LINK_VERIFY_ATTEMPTS attempts
+	 * 
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::link_verify()
+	{
+		int status = -1;
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			for(int attempt = 0; attempt < TP_NBIOT_LINK_VERIFY_ATTEMPTS; attempt++)
+			{
+				status = _modem.at();
+				if(status == TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return TP_NBIoT_Interface::NBIOT_OK;
+				}
+			}
+
+			return status;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+
+	/** Set the flow control mode of module and MCU. Enabled on the module
+	 *  first and disabled on the MCU first, so that the MCU never waits
+	 *  on a CTS line the module isn't driving
+	 * 
+	 * @param flow_control Flow control mode
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::link_flow_control(TP_Flow_Control flow_control)
+	{
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			bool enable = flow_control == TP_Flow_Control::CTS;
+
+			if(!enable)
+			{
+				_modem.set_serial_flow_control(false);
+			}
+
+			int status = _modem.set_flow_control(enable);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				/** Neither side has been left expecting flow control
+				 */
+				_modem.set_serial_flow_control(false);
+				_link_flow_control = TP_Flow_Control::NONE;
+
+				return status;
+			}
+
+			if(enable)
+			{
+				_modem.set_serial_flow_control(true);
+			}
+
+			_link_flow_control = flow_control;
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+#endif /* #if TP_NBIOT_DRIVER_LINK_SPEED */
+
+/** Wait for the module to leave RRC connected mode, i.e. to confirm 
+ *  that a release assistance indication took effect. The wait is on
+ *  +CSCON/+NPSMR URCs if enabled, otherwise the module is polled
+ *
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @param &elapsed_ms Address of integer in which to store the time 
+ *                    taken for the connection to be released
+ * @return Indicates success or failure reason, NOT_RELEASED if still
+ *         connected on timeout
+ */
+int TP_NBIoT_Interface::wait_for_rrc_release(uint32_t timeout_ms, uint32_t &elapsed_ms)
+{
+	TP_NBIOT_LOCK();
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		uint64_t start = Kernel::get_ms_count();
+		uint64_t deadline = start + timeout_ms;
+
+		while(true)
+		{
+			_urc_flags.clear(URC_FLAG_UART_ACTIVITY | URC_FLAG_STATE_CHANGED);
+
+			/** With URCs attached the snapshot is always current, otherwise
+			 *  a max_age_ms of 0 forces a query
+			 */
+			TP_Connection_Status conn_status;
+			int status = get_module_network_status(conn_status, 0);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			uint64_t now = Kernel::get_ms_count();
+			elapsed_ms = (uint32_t)(now - start);
+
+			if(conn_status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED ||
+			   conn_status == TP_Connection_Status::PSM_REGISTERED)
+			{
+				return TP_NBIoT_Interface::NBIOT_OK;
+			}
+
+			if(now >= deadline)
+			{
+				return TP_NBIoT_Interface::NOT_RELEASED;
+			}
+
+			if(_urc_oob_attached)
+			{
+				_urc_flags.wait_any(URC_FLAG_UART_ACTIVITY | URC_FLAG_STATE_CHANGED, (uint32_t)(deadline - now));
+			}
+			else
+			{
+				ThisThread::sleep_for(deadline - now < 500 ? (uint32_t)(deadline - now) : 500);
+			}
+		}
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+#if TP_NBIOT_DRIVER_SOCKETS
+	/** Open a UDP socket. Datagrams can then be sent without CoAP AT 
+	 *  framing and many may share one RRC connection. Arriving data is 
+	 *  announced by +NSONMI, see socket_wait() and socket_recv_from()
+	 *
+	 * @param local_port Local port to bind to, 0 to let the module choose
+	 * @param &socket Address of integer in which to store the socket number
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::socket_open(uint16_t local_port, int &socket)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			socket_oob_attach();
+
+			status = _modem.nsocr(local_port, socket);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			if(socket < 0 || socket >= TP_NBIOT_MAX_SOCKETS)
+			{
+				/** The module has opened a socket that can't be tracked, close
+				 *  it there rather than leave it open
+				 */
+				if(socket >= 0)
+				{
+					_modem.nsocl(socket);
+				}
+
+				return TP_NBIoT_Interface::INVALID_SOCKET;
+			}
+
+			_sockets_open |= (1 << socket);
+			_socket_pending[socket] = 0;
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+
+	/** Close a UDP socket
+	 *
+	 * @param socket Socket number returned by socket_open()
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::socket_close(int socket)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			if(!socket_is_open(socket))
+			{
+				return TP_NBIoT_Interface::INVALID_SOCKET;
+			}
+
+			/** The socket stays tracked until the module has closed it, so that
+			 *  a failed close can be retried
+			 */
+			status = _modem.nsocl(socket);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			_sockets_open &= ~(1 << socket);
+			_socket_pending[socket] = 0;
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+
+	/** Send a datagram from a caller-supplied buffer
+	 *
+	 * @param socket Socket number returned by socket_open()
+	 * @param *ipv4 Pointer to destination IPv4 address string
+	 * @param port Destination port
+	 * @param *data Pointer to datagram
+	 * @param length Length of datagram, no greater than 512 bytes
+	 * @param rai Release assistance indication, i.e. RELEASE for the last
+	 *            datagram of a batch so that the network releases the RRC
+	 *            connection straight away rather than on inactivity
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::socket_send_to(int socket, const char *ipv4, uint16_t port, const uint8_t *data, size_t length,
+										   TP_Release_Assistance rai)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			if(!socket_is_open(socket))
+			{
+				return TP_NBIoT_Interface::INVALID_SOCKET;
+			}
+
+			if(length > 512)
+			{
+				return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+			}
+
+			size_t sent = 0;
+
+			if(rai == TP_Release_Assistance::NONE)
+			{
+				status = _modem.nsost(socket, ipv4, port, data, length, sent);
+			}
+			else
+			{
+				status = _modem.nsostf(socket, ipv4, port, (int)rai, data, length, sent);
+			}
+
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			if(sent != length)
+			{
+				return TP_NBIoT_Interface::INVALID_RESPONSE;
+			}
+
+			TP_NBIOT_STAT(stats_note_traffic(sent, 0));
+			psm_note_uplink();
+			run_deferred_queries();
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+
+	/** Send a CoAP message encoded by TP_CoAP_Message
+	 *
+	 * @param socket Socket number returned by socket_open()
+	 * @param *ipv4 Pointer to destination IPv4 address string
+	 * @param port Destination port
+	 * @param &message Address of encoded message
+	 * @param rai Release assistance indication
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::socket_send_to(int socket, const char *ipv4, uint16_t port, const TP_CoAP_Message &message,
+										   TP_Release_Assistance rai)
+	{
+		TP_NBIOT_LOCK();
+
+		return socket_send_to(socket, ipv4, port, message.data(), message.length(), rai);
+	}
+
+	/** Read a received datagram into a caller-supplied buffer. A datagram 
+	 *  longer than recv_cap is read over several calls
+	 *
+	 * @param socket Socket number returned by socket_open()
+	 * @param *recv_buf Pointer to a byte array into which to read
+	 * @param recv_cap Capacity of recv_buf in bytes
+	 * @param &recv_len Address of size_t in which to store the number of 
+	 *                  bytes read
+	 * @param *ipv4 Pointer to a char array of at least 16 bytes in which to
+	 *              store the source IPv4 address
+	 * @param &port Address of uint16_t in which to store the source port
+	 * @return Indicates success or failure reason, NO_DATA if nothing
+	 *         was waiting
+	 */
+	int TP_NBIoT_Interface::socket_recv_from(int socket, uint8_t *recv_buf, size_t recv_cap, size_t &recv_len,
+											 char *ipv4, uint16_t &port)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			recv_len = 0;
+
+			if(!socket_is_open(socket))
+			{
+				return TP_NBIoT_Interface::INVALID_SOCKET;
+			}
+
+			size_t remaining = 0;
+
+			status = socket_read(socket, recv_buf, recv_cap, recv_len, ipv4, port, remaining);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			if(recv_len == 0)
+			{
+				return TP_NBIoT_Interface::NO_DATA;
+			}
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+
+	/** Number of received bytes announced by +NSONMI and not yet read,
+	 *  without communicating with the modem
+	 *
+	 * @param socket Socket number returned by socket_open()
+	 * @return Number of bytes waiting
+	 */
+	size_t TP_NBIoT_Interface::socket_pending(int socket)
+	{
+		if(!socket_is_open(socket))
+		{
+			return 0;
+		}
+
+		return _socket_pending[socket];
+	}
+
+	/** Read from a socket with AT+NSORF, accounting for the bytes read
+	 *
+	 * @param socket Socket number
+	 * @param *recv_buf Pointer to a byte array into which to read
+	 * @param recv_cap Capacity of recv_buf in bytes
+	 * @param &recv_len Address of size_t in which to store the number of 
+	 *                  bytes read
+	 * @param *ipv4 Pointer to a char array of at least 16 bytes in which to
+	 *              store the source IPv4 address
+	 * @param &port Address of uint16_t in which to store the source port
+	 * @param &remaining Address of size_t in which to store the number of 
+	 *                   bytes of the datagram left unread
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::socket_read(int socket, uint8_t *recv_buf, size_t recv_cap, size_t &recv_len,
+										char *ipv4, uint16_t &port, size_t &remaining)
+	{
+		int status = _modem.nsorf(socket, recv_buf, recv_cap, ipv4, port, recv_len, remaining);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		TP_NBIOT_STAT(stats_note_traffic(0, recv_len));
+
+		/** The module may have announced less than it holds, i.e. if a 
+		 *  +NSONMI was missed, so never let the count go negative
+		 */
+		_socket_pending[socket] = _socket_pending[socket] > recv_len ? _socket_pending[socket] - recv_len : remaining;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Sleep until data arrives on a socket, waking only when the modem
+	 *  sends something
+	 *
+	 * @param socket Socket number returned by socket_open()
+	 * @param timeout_ms Maximum time to wait in milliseconds
+	 * @return Indicates success or failure reason, NO_DATA on timeout
+	 */
+	int TP_NBIoT_Interface::socket_wait(int socket, uint32_t timeout_ms)
+	{
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			if(!socket_is_open(socket))
+			{
+				return TP_NBIoT_Interface::INVALID_SOCKET;
+			}
+
+			uint64_t deadline = Kernel::get_ms_count() + timeout_ms;
+
+			while(true)
+			{
+				/** Only hold the lock while reading URCs so that other threads
+				 *  can use the module while this one sleeps
+				 */
+				{
+					TP_NBIOT_LOCK();
+
+					_urc_flags.clear(URC_FLAG_UART_ACTIVITY | URC_FLAG_SOCKET_DATA);
+					_modem.process_oob();
+
+					if(_socket_pending[socket] > 0)
+					{
+						return TP_NBIoT_Interface::NBIOT_OK;
+					}
+				}
+
+				uint64_t now = Kernel::get_ms_count();
+				if(now >= deadline)
+				{
+					return TP_NBIoT_Interface::NO_DATA;
+				}
+
+				_urc_flags.wait_any(URC_FLAG_UART_ACTIVITY | URC_FLAG_SOCKET_DATA, (uint32_t)(deadline - now));
+			}
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	}
+
+	/** Out-of-band handler for +NSONMI, recording the bytes waiting
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::urc_nsonmi()
+	{
+		int socket = 0;
+		int length = 0;
+
+		if(urc_read_fields(socket, length) == 2 && socket >= 0 && socket < TP_NBIOT_MAX_SOCKETS && length > 0)
+		{
+			_socket_pending[socket] += length;
+			_urc_flags.set(URC_FLAG_SOCKET_DATA);
+
+			#if TP_NBIOT_ASYNC
+				if(_downlink_enabled)
+				{
+					downlink_notify();
+				}
+			#endif /* #if TP_NBIOT_ASYNC */
+		}
+	}
+
+	/** Forget open sockets and waiting data, i.e. because the modem has
+	 *  been reset
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::socket_reset()
+	{
+		_sockets_open = 0;
+		memset(_socket_pending, 0, sizeof(_socket_pending));
+	}
+
+	/** Attach the +NSONMI out-of-band handler if it isn't already
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::socket_oob_attach()
+	{
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			if(!_socket_oob_attached)
+			{
+				_modem.oob("+NSONMI:", callback(this, &TP_NBIoT_Interface::urc_nsonmi));
+				_socket_oob_attached = true;
+			}
+		}
+	}
+
+	/** Is socket a socket number opened by socket_open()?
+	 * 
+	 * @param socket Socket number
+	 * @return True if open
+	 */
+	bool TP_NBIoT_Interface::socket_is_open(int socket)
+	{
+		return socket >= 0 && socket < TP_NBIOT_MAX_SOCKETS && (_sockets_open & (1 << socket));
+	}
+#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+/** Perform a HTTP GET request over CoAP and capture the server
+ *  response in recv_data
+ *
+ * @param *recv_data Pointer to a byte array that will be populated
+ *              	 with the response from the server
+ * @param &response_code Address of integer where CoAP operation response code
+ *                       will be stored
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::coap_get(char *recv_data, int &response_code)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::COAP_GET, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = coap_session_begin(false);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		status = _modem.coap_get(recv_data, response_code);
+		TP_NBIOT_STAT(stats_note_coap(status, response_code, 0, status == TP_NBIoT_Interface::NBIOT_OK ? strlen(recv_data) : 0));
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			coap_session_reset();
+			return status;
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+	
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+#if TP_NBIOT_DRIVER_COAP_BUFFERS
+	/** Perform a HTTP GET request over CoAP and decode the server response
+	 *  directly into a caller-supplied buffer of known capacity
+	 *
+	 * @param *recv_buf Pointer to a byte array into which the response 
+	 *                  will be decoded
+	 * @param recv_cap Capacity of recv_buf in bytes
+	 * @param &recv_len Address of integer in which to store the length of
+	 *                  the response. If greater than recv_cap then only 
+	 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+	 *                  returned
+	 * @param &response_code Address of integer where CoAP operation response code
+	 *                       will be stored
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_get(uint8_t *recv_buf, size_t recv_cap, size_t &recv_len, int &response_code)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+		TP_NBIOT_TRACE(TP_Perf_Operation::COAP_GET, status);
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			status = coap_session_begin(false);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			status = _modem.coap_get(recv_buf, recv_cap, recv_len, response_code);
+			TP_NBIOT_STAT(stats_note_coap(status, response_code, 0, recv_len));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			if(recv_len > recv_cap)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::BUFFER_TOO_SMALL);
+			}
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	}
+
+	/** Perform a HTTP GET request over CoAP and stream the server response
+	 *  to writer in chunks as it is decoded
+	 *
+	 * @param writer Callback to which each chunk of the response is passed
+	 * @param &response_code Address of integer where CoAP operation response code
+	 *                       will be stored
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_get(TP_CoAP_Response_Writer writer, int &response_code)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+		TP_NBIOT_TRACE(TP_Perf_Operation::COAP_GET, status);
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			status = coap_session_begin(false);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			status = _modem.coap_get(writer, response_code);
+			TP_NBIOT_STAT(stats_note_coap(status, response_code, 0, 0));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	}
+#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
+/** Perform a HTTP DELETE request over CoAP and capture the server
+ *  response in recv_data
+ *
+ * @param *recv_data Pointer to a byte array that will be populated
+ *              	 with the response from the server
+ * @param &response_code Address of integer where CoAP operation response code
+ *                       will be stored
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::coap_delete(char *recv_data, int &response_code)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::COAP_DELETE, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = coap_session_begin(false);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		status = _modem.coap_delete(recv_data, response_code);
+		TP_NBIOT_STAT(stats_note_coap(status, response_code, 0, status == TP_NBIoT_Interface::NBIOT_OK ? strlen(recv_data) : 0));
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			coap_session_reset();
+			return status;
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+	
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+#if TP_NBIOT_DRIVER_COAP_BUFFERS
+	/** Perform a HTTP DELETE request over CoAP and decode the server response
+	 *  directly into a caller-supplied buffer of known capacity
+	 *
+	 * @param *recv_buf Pointer to a byte array into which the response 
+	 *                  will be decoded
+	 * @param recv_cap Capacity of recv_buf in bytes
+	 * @param &recv_len Address of integer in which to store the length of
+	 *                  the response. If greater than recv_cap then only 
+	 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+	 *                  returned
+	 * @param &response_code Address of integer where CoAP operation response code
+	 *                       will be stored
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_delete(uint8_t *recv_buf, size_t recv_cap, size_t &recv_len, int &response_code)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+		TP_NBIOT_TRACE(TP_Perf_Operation::COAP_DELETE, status);
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			status = coap_session_begin(false);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			status = _modem.coap_delete(recv_buf, recv_cap, recv_len, response_code);
+			TP_NBIOT_STAT(stats_note_coap(status, response_code, 0, recv_len));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			if(recv_len > recv_cap)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::BUFFER_TOO_SMALL);
+			}
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	}
+#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
+/** Perform a PUT request using CoAP and save the returned 
+ *  data into recv_data
+ * 
+ * @param *send_data Pointer to a byte array containing the 
+ *                   data to be sent to the server
+ * @param *recv_data Pointer to a byte array where the data 
+ *                   returned from the server will be stored
+ * @param data_intenfier Integer value representing the data 
+ *                       format type. Possible values are enumerated
+ *                       in the driver header file, i.e. TEXT_PLAIN
+ * @param &response_code Address of integer where CoAP operation response code
+ *                       will be stored
+ * @return Indicates success or failure reason
+ */ 
+int TP_NBIoT_Interface::coap_put(char *send_data, char *recv_data, int data_indentifier, int &response_code)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::COAP_PUT, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = coap_session_begin(true);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		status = _modem.coap_put(send_data, recv_data, data_indentifier, response_code);
+		TP_NBIOT_STAT(stats_note_coap(status, response_code, strlen(send_data), status == TP_NBIoT_Interface::NBIOT_OK ? strlen(recv_data) : 0));
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			coap_session_reset();
+			return status;
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+#if TP_NBIOT_DRIVER_COAP_BUFFERS
+	/** Perform a PUT request using CoAP and decode the server response
+	 *  directly into a caller-supplied buffer of known capacity
+	 * 
+	 * @param *send_data Pointer to a byte array containing the 
+	 *                   data to be sent to the server
+	 * @param data_intenfier Integer value representing the data 
+	 *                       format type. Possible values are enumerated
+	 *                       in the driver header file, i.e. TEXT_PLAIN
+	 * @param *recv_buf Pointer to a byte array into which the response 
+	 *                  will be decoded
+	 * @param recv_cap Capacity of recv_buf in bytes
+	 * @param &recv_len Address of integer in which to store the length of
+	 *                  the response. If greater than recv_cap then only 
+	 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+	 *                  returned
+	 * @param &response_code Address of integer where CoAP operation response code
+	 *                       will be stored
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_put(char *send_data, int data_indentifier, uint8_t *recv_buf, size_t recv_cap, 
+									 size_t &recv_len, int &response_code)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+		TP_NBIOT_TRACE(TP_Perf_Operation::COAP_PUT, status);
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			status = coap_session_begin(true);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			status = _modem.coap_put(send_data, data_indentifier, recv_buf, recv_cap, recv_len, response_code);
+			TP_NBIOT_STAT(stats_note_coap(status, response_code, strlen(send_data), recv_len));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			if(recv_len > recv_cap)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::BUFFER_TOO_SMALL);
+			}
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	}
+#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
+/** Perform a POST request using CoAP and save the returned 
+ *  data into recv_data
+ * 
+ * @param *send_data Pointer to a byte array containing the 
+ *                   data to be sent to the server
+ * @param *recv_data Pointer to a byte array where the data 
+ *                   returned from the server will be stored
+ * @param data_intenfier Integer value representing the data 
+ *                       format type. Possible values are enumerated
+ *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+ * @param &response_code Address of integer where CoAP operation response code
+ *                       will be stored
+ * @param priority Traffic priority, only the first block of a Block1
+ *                 upload being subject to the coverage gate
+ * @param endpoint Endpoint handle returned by register_endpoint(), 
+ *                 whose profile is loaded for this request only, or
+ *                 SELECTED_ENDPOINT
+ * @return Indicates success or failure reason, INVALID_ENDPOINT if 
+ *         the handle isn't registered
+ */ 
+int TP_NBIoT_Interface::coap_post(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
+                                    uint8_t send_block_number, uint8_t send_more_block, int &response_code,
+                                    TP_Traffic_Priority priority, int endpoint)
+{
+    TP_NBIOT_LOCK();
+
+    int status = -1;
+    TP_NBIOT_TRACE(TP_Perf_Operation::COAP_POST, status);
+    if(_driver == TP_NBIoT_Interface::SARAN2)
+    {
+        int profile = 0;
+        status = endpoint_profile(endpoint, profile);
+        if(status != TP_NBIoT_Interface::NBIOT_OK)
+        {
+            return status;
+        }
+
+        if(send_block_number == 0)
+        {
+            status = coverage_gate(priority);
+            if(status != TP_NBIoT_Interface::NBIOT_OK)
+            {
+                return status;
+            }
+        }
+
+        status = coap_session_begin(true, profile);
+        if(status != TP_NBIoT_Interface::NBIOT_OK)
+        {
+            return status;
+        }
+
+        status = _modem.coap_post(send_data, buffer_len, recv_data, data_indentifier, send_block_number, 
+                                send_more_block, response_code);
+        TP_NBIOT_STAT(stats_note_coap(status, response_code, buffer_len, status == TP_NBIoT_Interface::NBIOT_OK ? strlen(recv_data) : 0));
+
+        if(status != TP_NBIoT_Interface::NBIOT_OK)
+        {
+            coap_session_reset();
+            return status;
+        }
+        TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+    }
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+#if TP_NBIOT_DRIVER_COAP_BUFFERS
+	/** Perform a POST request using CoAP and decode the server response
+	 *  directly into a caller-supplied buffer of known capacity
+	 * 
+	 * @param *send_data Pointer to a byte array containing the 
+	 *                   data to be sent to the server
+	 * @param buffer_len Number of bytes in send_data
+	 * @param data_intenfier Integer value representing the data 
+	 *                       format type. Possible values are enumerated
+	 *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+	 * @param send_block_number Block1 block number
+	 * @param send_more_block Block1 more-blocks flag
+	 * @param *recv_buf Pointer to a byte array into which the response 
+	 *                  will be decoded
+	 * @param recv_cap Capacity of recv_buf in bytes
+	 * @param &recv_len Address of integer in which to store the length of
+	 *                  the response. If greater than recv_cap then only 
+	 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+	 *                  returned
+	 * @param &response_code Address of integer where CoAP operation response code
+	 *                       will be stored
+	 * @param priority Traffic priority, only the first block of a Block1
+	 *                 upload being subject to the coverage gate
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_post(uint8_t *send_data, size_t buffer_len, int data_indentifier, uint8_t send_block_number, 
+									  uint8_t send_more_block, uint8_t *recv_buf, size_t recv_cap, size_t &recv_len, 
+									  int &response_code, TP_Traffic_Priority priority)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+		TP_NBIOT_TRACE(TP_Perf_Operation::COAP_POST, status);
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			if(send_block_number == 0)
+			{
+				status = coverage_gate(priority);
+				if(status != TP_NBIoT_Interface::NBIOT_OK)
+				{
+					return status;
+				}
+			}
+
+			status = coap_session_begin(true);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			status = _modem.coap_post(send_data, buffer_len, data_indentifier, send_block_number, send_more_block,
+									  recv_buf, recv_cap, recv_len, response_code);
+			TP_NBIOT_STAT(stats_note_coap(status, response_code, buffer_len, recv_len));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			if(recv_len > recv_cap)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::BUFFER_TOO_SMALL);
+			}
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	}
+#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
+/** Perform a single POST request using CoAP with a payload produced by the
+ *  encoding stage, i.e. TP_SenML_Encoder or TP_Frame_Compressor. The data
+ *  format is taken from the payload
+ * 
+ * @param &payload Encoded payload to send
+ * @param *recv_data Pointer to a byte array where the data 
+ *                   returned from the server will be stored
+ * @param &response_code Address of integer where CoAP operation response code
+ *                       will be stored
+ * @param priority Traffic priority, see TP_Traffic_Priority
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::coap_post(const TP_Encoded_Payload &payload, char *recv_data, int &response_code,
+								  TP_Traffic_Priority priority)
+{
+	return coap_post((uint8_t *)payload.data, payload.length, recv_data, payload.data_identifier, 0, 0, 
+					 response_code, priority);
+}
+
+/** Upload data as a series of CoAP Block1 POST requests of 
+ *  MODULE_BLOCK_SIZE, sent back to back on the one loaded profile. 
+ *  Blocks are passed to the driver straight from the memory handed out
+ *  by reader, without copying. The total length isn't known up front,
+ *  so an upload that turns out to need more than MAX_COAP_STREAM_BLOCKS
+ *  blocks, or a reader returning more than max_length bytes, fails with
+ *  EXCEEDS_MAX_VALUE having already sent the blocks before it, and the
+ *  partial upload is left for the server to discard
+ * 
+ * @param reader Callback providing each block in turn, see
+ *               TP_CoAP_Block_Reader
+ * @param *recv_data Pointer to a byte array where the data 
+ *                   returned from the server will be stored
+ * @param data_intenfier Integer value representing the data 
+ *                       format type. Possible values are enumerated
+ *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+ * @param &response_code Address of integer where the response code of
+ *                       the final block, or of the first block the 
+ *                       server rejected, will be stored
+ * @param &stats Address of TP_CoAP_Stream_Stats in which to store
+ *               aggregated statistics of the upload
+ * @param *block_stats Optional array in which to store statistics of 
+ *                     each block sent
+ * @param max_block_stats Number of elements in block_stats
+ * @param priority Traffic priority, the upload being subject to the
+ *                 coverage gate before its first block
+ * @return Indicates success or failure reason, COAP_REJECTED if 
+ *         the server answered a block with a 4.xx or 5.xx code
+ */
+int TP_NBIoT_Interface::coap_post_stream(TP_CoAP_Block_Reader reader, char *recv_data,
+										 int data_indentifier, int &response_code, TP_CoAP_Stream_Stats &stats,
+										 TP_CoAP_Block_Stats *block_stats, size_t max_block_stats,
+										 TP_Traffic_Priority priority)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::COAP_POST_STREAM, status);
+
+	stats.blocks_sent = 0;
+	stats.bytes_sent = 0;
+	stats.duration_ms = 0;
+
+	size_t max_length = (size_t)1 << ((int)TP_NBIoT_Interface::MODULE_BLOCK_SIZE + 4);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		uint64_t stream_start = Kernel::get_ms_count();
+
+		status = coverage_gate(priority);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		status = coap_session_begin(true);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		/** Each block is sent before the next is read, so a short block 
+		 *  is the last one and data that ends on a block boundary is 
+		 *  closed by an empty final block
+		 */
+		bool final_block = false;
+
+		for(uint16_t block_number = 0; !final_block; block_number++)
+		{
+			uint8_t *block = NULL;
+			size_t length = reader(block, max_length);
+
+			if(length == 0 && block_number == 0)
+			{
+				break;
+			}
+
+			if(block_number >= TP_NBIoT_Interface::MAX_COAP_STREAM_BLOCKS || length > max_length)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::EXCEEDS_MAX_VALUE);
+			}
+
+			final_block = length < max_length;
+			uint64_t block_start = Kernel::get_ms_count();
+
+			status = _modem.coap_post(block, length, recv_data, data_indentifier, (uint8_t)block_number, 
+									  final_block ? 0 : 1, response_code);
+			TP_NBIOT_STAT(stats_note_coap(status, response_code, length, 
+										  status == TP_NBIoT_Interface::NBIOT_OK && recv_data != NULL ? strlen(recv_data) : 0));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			uint64_t block_end = Kernel::get_ms_count();
+
+			if(block_stats != NULL && block_number < max_block_stats)
+			{
+				block_stats[block_number].block_number = block_number;
+				block_stats[block_number].length = (uint16_t)length;
+				block_stats[block_number].response_code = response_code;
+				block_stats[block_number].duration_ms = (uint32_t)(block_end - block_start);
+			}
+
+			stats.blocks_sent++;
+			stats.bytes_sent += length;
+			stats.duration_ms = (uint32_t)(block_end - stream_start);
+
+			/** Client and server errors (4.xx and 5.xx) end the upload, the
+			 *  failing response code is left for the application to inspect
+			 */
+			if(response_code >= 400)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::COAP_REJECTED);
+			}
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Upload a chain of caller-owned buffers as a series of CoAP Block1
+ *  POST requests. Every buffer except the last must hold a multiple 
+ *  of MODULE_BLOCK_SIZE bytes so that no block straddles two buffers.
+ *  The chain is checked against MAX_COAP_STREAM_BLOCKS before 
+ *  anything is sent
+ * 
+ * @param *chain Pointer to the first TP_CoAP_Buffer of the chain
+ * @param *recv_data Pointer to a byte array where the data 
+ *                   returned from the server will be stored
+ * @param data_intenfier Integer value representing the data 
+ *                       format type. Possible values are enumerated
+ *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+ * @param &response_code Address of integer where the response code of
+ *                       the final block, or of the first block the 
+ *                       server rejected, will be stored
+ * @param &stats Address of TP_CoAP_Stream_Stats in which to store
+ *               aggregated statistics of the upload
+ * @param *block_stats Optional array in which to store statistics of 
+ *                     each block sent
+ * @param max_block_stats Number of elements in block_stats
+ * @param priority Traffic priority, the upload being subject to the
+ *                 coverage gate before its first block
+ * @return Indicates success or failure reason, COAP_REJECTED if 
+ *         the server answered a block with a 4.xx or 5.xx code
+ */
+int TP_NBIoT_Interface::coap_post_stream(TP_CoAP_Buffer *chain, char *recv_data,
+										 int data_indentifier, int &response_code, TP_CoAP_Stream_Stats &stats,
+										 TP_CoAP_Block_Stats *block_stats, size_t max_block_stats,
+										 TP_Traffic_Priority priority)
+{
+	TP_NBIOT_LOCK();
+
+	size_t max_length = (size_t)1 << ((int)TP_NBIoT_Interface::MODULE_BLOCK_SIZE + 4);
+	size_t total_length = 0;
+
+	for(TP_CoAP_Buffer *buffer = chain; buffer != NULL; buffer = buffer->next)
+	{
+		if(buffer->next != NULL && buffer->length % max_length != 0)
+		{
+			return TP_NBIoT_Interface::INVALID_BLOCK_SIZE;
+		}
+
+		total_length += buffer->length;
+	}
+
+	/** Full blocks plus the short, or empty, final block
+	 */
+	if(total_length > 0 && total_length / max_length + 1 > TP_NBIoT_Interface::MAX_COAP_STREAM_BLOCKS)
+	{
+		return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+	}
+
+	TP_CoAP_Chain_Cursor cursor = { chain, 0 };
+
+	return coap_post_stream(callback(&cursor, &TP_CoAP_Chain_Cursor::read), recv_data, 
+							data_indentifier, response_code, stats, block_stats, max_block_stats, priority);
+}
+
+#if TP_NBIOT_BATCHING
+	/** Configure the uplink batching stage. Records appended with batch_append()
+	 *  are collected and sent as one coap_post_stream() upload once 
+	 *  flush_threshold bytes are pending, or once a deadline expires. The
+	 *  deadline is placed before the end of the current T3324 active window
+	 *  if the modem is awake when the first record is appended, and is 
+	 *  never later than one T3412 period or max_latency_s. A T3412 of 0,
+	 *  i.e. deactivated, sets no deadline of its own. If URCs are 
+	 *  enabled a pending batch is also flushed as soon as the modem leaves 
+	 *  PSM of its own accord, i.e. for a periodic TAU. The T3412 and T3324 
+	 *  timers are read from the modem once, here
+	 * 
+	 * @param flush_threshold Number of pending bytes at which to flush, no
+	 *                        greater than TP_NBIOT_BATCH_BUFFER_SIZE
+	 * @param max_latency_s Maximum time in seconds a record may be held
+	 * @param *recv_data Pointer to a byte array where the data returned 
+	 *                   from the server on flush will be stored
+	 * @param data_intenfier Integer value representing the data 
+	 *                       format type. Possible values are enumerated
+	 *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::configure_batching(size_t flush_threshold, uint32_t max_latency_s, char *recv_data, 
+											   int data_indentifier)
+	{
+		TP_NBIOT_LOCK();
+
+		if(flush_threshold == 0 || flush_threshold > TP_NBIOT_BATCH_BUFFER_SIZE)
+		{
+			return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+		}
+
+		int status = read_psm_timers();
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		_batch_threshold = flush_threshold;
+		_batch_max_latency_s = max_latency_s;
+		_batch_recv_data = recv_data;
+		_batch_data_indentifier = data_indentifier;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Append a record to the pending batch. Records are concatenated as
+	 *  given so any framing is up to the application. The batch is flushed
+	 *  first if the record would not otherwise fit, and afterwards if the 
+	 *  flush threshold or deadline has been reached
+	 * 
+	 * @param *record Pointer to record data, copied into the batch buffer
+	 * @param length Number of bytes in record
+	 * @return Indicates success or failure reason, COVERAGE_DEFERRED if
+	 *         the batch is full and the coverage gate holds it, in which
+	 *         case the record is not appended
+	 */
+	int TP_NBIoT_Interface::batch_append(const uint8_t *record, size_t length)
+	{
+		TP_NBIOT_LOCK();
+
+		int status = -1;
+
+		if(_batch_threshold == 0)
+		{
+			return TP_NBIoT_Interface::BATCH_NOT_READY;
+		}
+
+		if(length > TP_NBIOT_BATCH_BUFFER_SIZE)
+		{
+			return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+		}
+
+		if(_batch_length + length > TP_NBIOT_BATCH_BUFFER_SIZE)
+		{
+			status = batch_flush(_batch_response_code);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+		}
+
+		if(_batch_length == 0)
+		{
+			TP_Connection_Snapshot snapshot;
+			get_connection_snapshot(snapshot);
+
+			_batch_started_in_psm = snapshot.valid && snapshot.psm == 1;
+			_batch_deadline_ms = batch_deadline();
+		}
+
+		memcpy(&_batch_buffer[_batch_length], record, length);
+		_batch_length += length;
+
+		return batch_poll();
+	}
+
+	/** Flush the pending batch if its flush threshold or deadline has been
+	 *  reached. Should be called periodically, see batch_time_to_deadline()
+	 * 
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::batch_poll()
+	{
+		TP_NBIOT_LOCK();
+
+		if(_batch_length == 0)
+		{
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		bool flush = _batch_length >= _batch_threshold || Kernel::get_ms_count() >= _batch_deadline_ms;
+
+		/** If the modem has woken up by itself since the batch was begun then
+		 *  this active window is the cheapest chance to send it
+		 */
+		if(!flush && _batch_started_in_psm && _urc_oob_attached)
+		{
+			process_urcs();
+			flush = _snapshot.psm == 0;
+		}
+
+		if(!flush)
+		{
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		/** Held by the gate, the batch stays pending rather than the poll
+		 *  failing
+		 */
+		int status = batch_flush(_batch_response_code);
+		if(status == TP_NBIoT_Interface::COVERAGE_DEFERRED)
+		{
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return status;
+	}
+
+	/** Flush the pending batch now. The batch is only cleared once the
+	 *  server has accepted it, otherwise it is kept to be retried
+	 * 
+	 * @param &response_code Address of integer where CoAP operation response code
+	 *                       will be stored
+	 * @param priority Traffic priority, see TP_Traffic_Priority
+	 * @return Indicates success or failure reason, COAP_REJECTED if the
+	 *         server answered with a 4.xx or 5.xx code
+	 */
+	int TP_NBIoT_Interface::batch_flush(int &response_code, TP_Traffic_Priority priority)
+	{
+		TP_NBIOT_LOCK();
+
+		if(_batch_length == 0)
+		{
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		TP_CoAP_Buffer buffer;
+		buffer.data = _batch_buffer;
+		buffer.length = _batch_length;
+		buffer.next = NULL;
+
+		TP_CoAP_Stream_Stats stats;
+
+		int status = coap_post_stream(&buffer, _batch_recv_data, _batch_data_indentifier, 
+									  response_code, stats, NULL, 0, priority);
+		if(status == TP_NBIoT_Interface::NBIOT_OK && response_code >= 400)
+		{
+			status = TP_NBIoT_Interface::COAP_REJECTED;
+		}
+
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			/** Keep the batch so that it can be retried, including one the
+			 *  server rejected
+			 */
+			return status;
+		}
+
+		_batch_length = 0;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Return time until the pending batch is due to be flushed
+	 * 
+	 * @return Milliseconds until the deadline, 0 if it has passed or 
+	 *         UINT32_MAX if nothing is pending
+	 */
+	uint32_t TP_NBIoT_Interface::batch_time_to_deadline()
+	{
+		TP_NBIOT_LOCK();
+
+		if(_batch_length == 0)
+		{
+			return UINT32_MAX;
+		}
+
+		uint64_t now = Kernel::get_ms_count();
+		uint64_t deadline = _batch_deadline_ms;
+
+		/** While the coverage gate holds the batch, the next chance to send
+		 *  is a fresh measurement or the end of the maximum deferral
+		 */
+		if(_gate_holding && now >= deadline)
+		{
+			uint64_t release = _gate_held_ms + (uint64_t)_gate_config.max_deferral_s * 1000;
+			uint64_t recheck = now + TP_NBIOT_COVERAGE_RECHECK_MS;
+
+			deadline = release < recheck ? release : recheck;
+		}
+
+		if(now >= deadline)
+		{
+			return 0;
+		}
+
+		uint64_t remaining = deadline - now;
+
+		return remaining > UINT32_MAX ? UINT32_MAX : (uint32_t)remaining;
+	}
+
+	/** Return the response code of the last batch flushed
+	 * 
+	 * @return CoAP operation response code
+	 */
+	int TP_NBIoT_Interface::batch_last_response_code()
+	{
+		TP_NBIOT_LOCK();
+
+		return _batch_response_code;
+	}
+#endif /* #if TP_NBIOT_BATCHING */
+
+#if TP_NBIOT_ASYNC
+	/** Queue a HTTP GET request over CoAP for the modem worker thread,
+	 *  which is started on first use. The calling thread is not blocked
+	 *
+	 * @param *recv_data Pointer to a byte array that will be populated
+	 *              	 with the response from the server. Must remain
+	 *                   valid until the callback is called
+	 * @param cb Callback to be called on completion
+	 * @param &handle Address of integer in which to store the handle that
+	 *                identifies this request in TP_Async_Result
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_get_async(char *recv_data, TP_Async_Callback cb, uint32_t &handle)
+	{
+		TP_Async_Request *request = async_alloc(TP_Async_Operation::COAP_GET, cb);
+		if(request == NULL)
+		{
+			return TP_NBIoT_Interface::QUEUE_FULL;
+		}
+
+		request->recv_data = recv_data;
+
+		return async_submit(request, handle);
+	}
+
+	/** Queue start() for the modem worker thread, which is started on
+	 *  first use, so that several modules can attach at the same time.
+	 *  The calling thread is not blocked
+	 *
+	 * @param timeout_s Timeout period in seconds
+	 * @param cb Callback to be called on completion
+	 * @param &handle Address of integer in which to store the handle that
+	 *                identifies this request in TP_Async_Result
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::start_async(uint16_t timeout_s, TP_Async_Callback cb, uint32_t &handle)
+	{
+		TP_Async_Request *request = async_alloc(TP_Async_Operation::START, cb);
+		if(request == NULL)
+		{
+			return TP_NBIoT_Interface::QUEUE_FULL;
+		}
+
+		request->timeout_s = timeout_s;
+
+		return async_submit(request, handle);
+	}
+
+	/** Queue a HTTP DELETE request over CoAP for the modem worker thread,
+	 *  which is started on first use. The calling thread is not blocked
+	 *
+	 * @param *recv_data Pointer to a byte array that will be populated
+	 *              	 with the response from the server. Must remain
+	 *                   valid until the callback is called
+	 * @param cb Callback to be called on completion
+	 * @param &handle Address of integer in which to store the handle that
+	 *                identifies this request in TP_Async_Result
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::coap_delete_async(char *recv_data, TP_Async_Callback cb, uint32_t &handle)
+	{
+		TP_Async_Request *request = async_alloc(TP_Async_Operation::COAP_DELETE, cb);
+		if(request == NULL)
+		{
+			return TP_NBIoT_Interface::QUEUE_FULL;
+		}
+
+		request->recv_data = recv_data;
+
+		return async_submit(request, handle);
+	}
+
+	/** Queue a PUT request using CoAP for the modem worker thread, which 
+	 *  is started on first use. The calling thread is not blocked
+	 * 
+	 * @param *send_data Pointer to a byte array containing the 
+	 *                   data to be sent to the server. Copied if
+	 *                   TP_NBIOT_ASYNC_PAYLOAD_SIZE is non-zero, 
+	 *                   otherwise must remain valid until the 
+	 *                   callback is called
+	 * @param *recv_data Pointer to a byte array where the data 
+	 *                   returned from the server will be stored. Must 
+	 *                   remain valid until the callback is called
+	 * @param data_intenfier Integer value representing the data 
+	 *                       format type. Possible values are enumerated
+	 *                       in the header file, i.e. TEXT_PLAIN
+	 * @param cb Callback to be called on completion
+	 * @param &handle Address of integer in which to store the handle that
+	 *                identifies this request in TP_Async_Result
+	 * @return Indicates success or failure reason
+	 */ 
+	int TP_NBIoT_Interface::coap_put_async(char *send_data, char *recv_data, int data_indentifier, 
+										   TP_Async_Callback cb, uint32_t &handle)
+	{
+		#if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0
+			size_t send_len = strlen(send_data) + 1;
+			if(send_len > TP_NBIOT_ASYNC_PAYLOAD_SIZE)
+			{
+				return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+			}
+		#endif /* #if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0 */
+
+		TP_Async_Request *request = async_alloc(TP_Async_Operation::COAP_PUT, cb);
+		if(request == NULL)
+		{
+			return TP_NBIoT_Interface::QUEUE_FULL;
+		}
+
+		#if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0
+			memcpy(request->payload, send_data, send_len);
+			request->send_data = request->payload;
+		#else
+			request->send_data = (uint8_t *)send_data;
+		#endif /* #if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0 */
+
+		request->recv_data = recv_data;
+		request->data_indentifier = data_indentifier;
+
+		return async_submit(request, handle);
+	}
+
+	/** Queue a POST request using CoAP for the modem worker thread, which 
+	 *  is started on first use. The calling thread is not blocked
+	 * 
+	 * @param *send_data Pointer to a byte array containing the 
+	 *                   data to be sent to the server. Copied if
+	 *                   TP_NBIOT_ASYNC_PAYLOAD_SIZE is non-zero, 
+	 *                   otherwise must remain valid until the 
+	 *                   callback is called
+	 * @param *recv_data Pointer to a byte array where the data 
+	 *                   returned from the server will be stored. Must 
+	 *                   remain valid until the callback is called
+	 * @param data_intenfier Integer value representing the data 
+	 *                       format type. Possible values are enumerated
+	 *                       in the header file, i.e. TEXT_PLAIN
+	 * @param cb Callback to be called on completion
+	 * @param &handle Address of integer in which to store the handle that
+	 *                identifies this request in TP_Async_Result
+	 * @param endpoint Endpoint handle returned by register_endpoint() or
+	 *                 SELECTED_ENDPOINT, in which case the endpoint 
+	 *                 selected when the request is queued is used
+	 * @return Indicates success or failure reason, INVALID_ENDPOINT if 
+	 *         the handle isn't registered
+	 */ 
+	int TP_NBIoT_Interface::coap_post_async(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
+											uint8_t send_block_number, uint8_t send_more_block, 
+											TP_Async_Callback cb, uint32_t &handle, int endpoint)
+	{
+		#if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0
+			if(buffer_len > TP_NBIOT_ASYNC_PAYLOAD_SIZE)
+			{
+				return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+			}
+		#endif /* #if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0 */
+
+		int profile = 0;
+		int status = endpoint_profile(endpoint, profile);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		TP_Async_Request *request = async_alloc(TP_Async_Operation::COAP_POST, cb);
+		if(request == NULL)
+		{
+			return TP_NBIoT_Interface::QUEUE_FULL;
+		}
+
+		#if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0
+			memcpy(request->payload, send_data, buffer_len);
+			request->send_data = request->payload;
+		#else
+			request->send_data = send_data;
+		#endif /* #if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0 */
+
+		request->buffer_len = buffer_len;
+		request->recv_data = recv_data;
+		request->data_indentifier = data_indentifier;
+		request->send_block_number = send_block_number;
+		request->send_more_block = send_more_block;
+		request->profile = profile;
+
+		return async_submit(request, handle);
+	}
+
+	/** Return the number of asynchronous requests that have been queued
+	 *  but whose callbacks have not yet been called. Doesn't wait for the
+	 *  interface lock, so it can be called while the worker is busy
+	 * 
+	 * @return Number of outstanding requests
+	 */
+	uint32_t TP_NBIoT_Interface::async_pending()
+	{
+		return _async_pending;
+	}
+
+	/** Allocate a request from the pool and initialise its common fields
+	 * 
+	 * @param operation Operation to perform
+	 * @param cb Callback to be called on completion
+	 * @return Pointer to request or NULL if the pool is exhausted
+	 */
+	TP_NBIoT_Interface::TP_Async_Request *TP_NBIoT_Interface::async_alloc(TP_Async_Operation operation, TP_Async_Callback cb)
+	{
+		void *memory = _async_pool.alloc();
+		if(memory == NULL)
+		{
+			return NULL;
+		}
+
+		/** Pool memory is uninitialised, construct in place so that the
+		 *  callback member is valid before it is assigned
+		 */
+		TP_Async_Request *request = new (memory) TP_Async_Request();
+		request->operation = operation;
+		request->profile = _coap_selected_profile;
+		request->cb = cb;
+
+		return request;
+	}
+
+	/** Serve a queued CoAP request on the endpoint it was queued for.
+	 *  The selection is swapped for the request under the interface
+	 *  lock, so other threads never see it
+	 * 
+	 * @param *request Pointer to request taken from the queue
+	 * @param &response_code Address of integer where CoAP operation 
+	 *                       response code will be stored
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::async_coap(TP_Async_Request *request, int &response_code)
+	{
+		TP_NBIOT_LOCK();
+
+		int selected = _coap_selected_profile;
+		_coap_selected_profile = request->profile;
+
+		int status = -1;
+		switch(request->operation)
+		{
+			case TP_Async_Operation::COAP_GET:
+			{
+				status = coap_get(request->recv_data, response_code);
+				break;
+			}
+			case TP_Async_Operation::COAP_DELETE:
+			{
+				status = coap_delete(request->recv_data, response_code);
+				break;
+			}
+			case TP_Async_Operation::COAP_PUT:
+			{
+				status = coap_put((char *)request->send_data, request->recv_data, 
+								  request->data_indentifier, response_code);
+				break;
+			}
+			case TP_Async_Operation::COAP_POST:
+			{
+				status = coap_post(request->send_data, request->buffer_len, request->recv_data, 
+								   request->data_indentifier, request->send_block_number, 
+								   request->send_more_block, response_code);
+				break;
+			}
+			default:
+			{
+				status = TP_NBIoT_Interface::DRIVER_UNKNOWN;
+				break;
+			}
+		}
+
+		_coap_selected_profile = selected;
+
+		return status;
+	}
+
+	/** Start the worker thread if necessary and queue the request. The
+	 *  pool, queue and handle counter are safe to use from any thread, so
+	 *  requests are queued without waiting for the interface lock, which 
+	 *  the worker may hold for as long as a request takes
+	 * 
+	 * @param *request Pointer to request allocated by async_alloc()
+	 * @param &handle Address of integer in which to store the request handle
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::async_submit(TP_Async_Request *request, uint32_t &handle)
+	{
+		int status = async_start();
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			request->~TP_Async_Request();
+			_async_pool.free(request);
+			return status;
+		}
+
+		core_util_critical_section_enter();
+		request->handle = _async_next_handle++;
+		if(_async_next_handle == 0)
+		{
+			_async_next_handle = 1;
+		}
+		_async_pending++;
+		core_util_critical_section_exit();
+
+		handle = request->handle;
+
+		/** The queue is deeper than the pool so this cannot fail once a
+		 *  request has been allocated
+		 */
+		_async_queue.put(request);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Start the worker thread if it isn't running
+	 * 
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::async_start()
+	{
+		/** Not left to TP_NBIOT_LOCK, which may be compiled out, so that the
+		 *  worker can never be started twice
+		 */
+		ScopedLock<Mutex> worker_lock(_worker_mutex);
+
+		if(!_worker_started)
+		{
+			if(_worker.start(callback(this, &TP_NBIoT_Interface::async_worker)) != osOK)
+			{
+				return TP_NBIoT_Interface::QUEUE_FULL;
+			}
+
+			_worker_started = true;
+		}
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	#if TP_NBIOT_DRIVER_SOCKETS
+		/** Deliver datagrams received on open sockets to cb. As soon as 
+		 *  +NSONMI announces data the worker thread, started if necessary,
+		 *  reads it into the downlink pool and calls cb, so that commands
+		 *  sent by the server in the active window after an uplink arrive
+		 *  without polling. While a callback is set, received data goes 
+		 *  to it rather than being left for socket_recv_from()
+		 * 
+		 * @param cb Callback to be called with each datagram
+		 * @return Indicates success or failure reason
+		 */
+		int TP_NBIoT_Interface::set_downlink_callback(TP_Downlink_Callback cb)
+		{
+			TP_NBIOT_LOCK();
+
+			int status = async_start();
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			_downlink_cb = cb;
+			_downlink_enabled = true;
+
+			/** Deliver anything that arrived before the callback was set
+			 */
+			downlink_notify();
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		/** Stop delivering downlinks, leaving received data for 
+		 *  socket_recv_from()
+		 * 
+		 * @return Indicates success or failure reason
+		 */
+		int TP_NBIoT_Interface::clear_downlink_callback()
+		{
+			TP_NBIOT_LOCK();
+
+			_downlink_enabled = false;
+			_downlink_cb = TP_Downlink_Callback();
+
+			_downlink_settle.detach();
+			_downlink_settling = false;
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		/** Wake the worker thread to read downlinks, at most once until it
+		 *  has done so. Safe to call from interrupt context
+		 * 
+		 * @return None
+		 */
+		void TP_NBIoT_Interface::downlink_notify()
+		{
+			core_util_critical_section_enter();
+			bool notify = !_downlink_queued;
+			_downlink_queued = true;
+			core_util_critical_section_exit();
+
+			if(notify && _async_queue.put(&_downlink_request) != osOK)
+			{
+				_downlink_queued = false;
+			}
+		}
+
+		/** Called once the UART has been quiet for 
+		 *  TP_NBIOT_DOWNLINK_SETTLE_MS after activity, waking the worker
+		 *  to dispatch any +NSONMI nobody else has. Called from interrupt
+		 *  context
+		 * 
+		 * @return None
+		 */
+		void TP_NBIoT_Interface::downlink_settled()
+		{
+			core_util_critical_section_enter();
+			uint32_t quiet_ms = (uint32_t)Kernel::get_ms_count() - _downlink_activity_ms;
+			bool settled = quiet_ms >= TP_NBIOT_DOWNLINK_SETTLE_MS;
+			_downlink_settling = !settled;
+			core_util_critical_section_exit();
+
+			/** Activity since the timeout was armed pushes it back rather than
+			 *  rearming it on every byte
+			 */
+			if(!settled)
+			{
+				_downlink_settle.attach_us(callback(this, &TP_NBIoT_Interface::downlink_settled), 
+										   (TP_NBIOT_DOWNLINK_SETTLE_MS - quiet_ms) * 1000);
+				return;
+			}
+
+			if(_downlink_enabled)
+			{
+				downlink_notify();
+			}
+		}
+
+		/** Read announced downlinks into the pool and deliver them. Run by
+		 *  the worker thread
+		 * 
+		 * @return None
+		 */
+		void TP_NBIoT_Interface::downlink_drain()
+		{
+			/** Cleared first so that data announced from here on wakes the 
+			 *  worker again
+			 */
+			core_util_critical_section_enter();
+			_downlink_queued = false;
+			core_util_critical_section_exit();
+
+			TP_Downlink *received[TP_NBIOT_DOWNLINK_POOL_DEPTH];
+			size_t count = 0;
+			bool more = false;
+			TP_Downlink_Callback cb;
+
+			{
+				/** Only the reads hold the modem, the callbacks are free to use it
+				 */
+				TP_NBIOT_LOCK();
+
+				if(!_downlink_enabled)
+				{
+					return;
+				}
+
+				cb = _downlink_cb;
+				process_urcs();
+
+				for(int socket = 0; socket < TP_NBIOT_MAX_SOCKETS; socket++)
+				{
+					while(socket_is_open(socket) && _socket_pending[socket] > 0)
+					{
+						if(count == TP_NBIOT_DOWNLINK_POOL_DEPTH)
+						{
+							more = true;
+							break;
+						}
+
+						TP_Downlink *downlink = _downlink_pool.alloc();
+						if(downlink == NULL)
+						{
+							more = true;
+							break;
+						}
+
+						if(downlink_read(socket, *downlink) != TP_NBIoT_Interface::NBIOT_OK)
+						{
+							_downlink_pool.free(downlink);
+							break;
+						}
+
+						received[count++] = downlink;
+					}
+				}
+			}
+
+			for(size_t i = 0; i < count; i++)
+			{
+				if(cb)
+				{
+					cb(*received[i]);
+				}
+
+				_downlink_pool.free(received[i]);
+			}
+
+			/** Whatever didn't fit in the pool is read on the next pass
+			 */
+			if(more)
+			{
+				downlink_notify();
+			}
+		}
+
+		/** Read a single datagram into a downlink, discarding whatever
+		 *  does not fit
+		 * 
+		 * @param socket Socket number
+		 * @param &downlink Address of TP_Downlink in which to store it
+		 * @return Indicates success or failure reason, NO_DATA if nothing
+		 *         was waiting
+		 */
+		int TP_NBIoT_Interface::downlink_read(int socket, TP_Downlink &downlink)
+		{
+			size_t remaining = 0;
+
+			downlink.socket = socket;
+			downlink.truncated = false;
+
+			int status = socket_read(socket, downlink.data, sizeof(downlink.data), downlink.length,
+									 downlink.ipv4, downlink.port, remaining);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			if(downlink.length == 0)
+			{
+				return TP_NBIoT_Interface::NO_DATA;
+			}
+
+			/** The module returns the rest of a datagram that didn't fit on the
+			 *  next read, which would otherwise look like a datagram of its own
+			 */
+			while(remaining > 0)
+			{
+				TP_NBIOT_SCRATCH(TP_Discard_Buffer, discard, discard);
+				size_t length = 0;
+				char ipv4[16];
+				uint16_t port = 0;
+
+				downlink.truncated = true;
+
+				status = socket_read(socket, discard, sizeof(discard), length, ipv4, port, remaining);
+				if(status != TP_NBIoT_Interface::NBIOT_OK || length == 0)
+				{
+					break;
+				}
+			}
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+	#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+	/** Modem worker thread, serves queued requests in order. Requests 
+	 *  queued while another is in progress are drained back to back, 
+	 *  within the same radio-active window
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::async_worker()
+	{
+		while(true)
+		{
+			osEvent event = _async_queue.get();
+			if(event.status != osEventMessage)
+			{
+				continue;
+			}
+
+			TP_Async_Request *request = (TP_Async_Request *)event.value.p;
+
+			#if TP_NBIOT_DRIVER_SOCKETS
+				if(request == &_downlink_request)
+				{
+					downlink_drain();
+					continue;
+				}
+			#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+			TP_Async_Result result;
+			result.handle = request->handle;
+			result.operation = request->operation;
+			result.response_code = 0;
+
+			switch(request->operation)
+			{
+				case TP_Async_Operation::COAP_GET:
+				case TP_Async_Operation::COAP_DELETE:
+				case TP_Async_Operation::COAP_PUT:
+				case TP_Async_Operation::COAP_POST:
+				{
+					result.status = async_coap(request, result.response_code);
+					break;
+				}
+				case TP_Async_Operation::START:
+				{
+					result.status = start(request->timeout_s);
+					break;
+				}
+				default:
+				{
+					result.status = TP_NBIoT_Interface::DRIVER_UNKNOWN;
+					break;
+				}
+			}
+
+			TP_Async_Callback cb = request->cb;
+			request->~TP_Async_Request();
+			_async_pool.free(request);
+
+			core_util_critical_section_enter();
+			_async_pending--;
+			core_util_critical_section_exit();
+
+			if(cb)
+			{
+				cb(result);
+			}
+		}
+	}
+#endif /* #if TP_NBIOT_ASYNC */
+
+#if TP_NBIOT_PERF_TRACE
+	/** Return totals across all traced operations since the last reset
+	 * 
+	 * @param &counters Address of TP_Perf_Counters in which to store totals
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::get_perf_counters(TP_Perf_Counters &counters)
+	{
+		TP_NBIOT_LOCK();
+
+		core_util_critical_section_enter();
+		counters = _perf_totals;
+		core_util_critical_section_exit();
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Copy the most recent trace records, oldest first, and remove them
+	 *  from the ring
+	 * 
+	 * @param *records Pointer to array in which to store records
+	 * @param max_records Number of elements in records
+	 * @param &count Address of integer in which to store number of records copied
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::get_perf_records(TP_Perf_Record *records, size_t max_records, size_t &count)
+	{
+		TP_NBIOT_LOCK();
+
+		count = 0;
+
+		core_util_critical_section_enter();
+		while(_perf_count > 0 && count < max_records)
+		{
+			size_t oldest = (_perf_head + TP_NBIOT_PERF_RECORDS - _perf_count) % TP_NBIOT_PERF_RECORDS;
+			records[count++] = _perf_records[oldest];
+			_perf_count--;
+		}
+		core_util_critical_section_exit();
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Clear all trace records and totals
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::reset_perf_counters()
+	{
+		TP_NBIOT_LOCK();
+
+		core_util_critical_section_enter();
+		_perf_head = 0;
+		_perf_count = 0;
+		memset(&_perf_totals, 0, sizeof(_perf_totals));
+		core_util_critical_section_exit();
+	}
+
+	/** Register a callback to be called with each trace record as it
+	 *  completes, or an empty Callback to stop
+	 * 
+	 * @param cb Callback to register
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::set_perf_callback(TP_Perf_Callback cb)
+	{
+		TP_NBIOT_LOCK();
+
+		_perf_callback = cb;
+	}
+
+	/** Add a completed record to the ring and totals
+	 * 
+	 * @param &record Address of completed record
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::perf_record(const TP_Perf_Record &record)
+	{
+		core_util_critical_section_enter();
+		_perf_records[_perf_head] = record;
+		_perf_head = (_perf_head + 1) % TP_NBIOT_PERF_RECORDS;
+
+		if(_perf_count < TP_NBIOT_PERF_RECORDS)
+		{
+			_perf_count++;
+		}
+		else
+		{
+			_perf_totals.records_dropped++;
+		}
+
+		_perf_totals.operations++;
+		_perf_totals.failures += record.result != TP_NBIoT_Interface::NBIOT_OK ? 1 : 0;
+		_perf_totals.busy_ms += record.duration_ms;
+		_perf_totals.at_commands += record.at_commands;
+		_perf_totals.uart_tx_bytes += record.uart_tx_bytes;
+		_perf_totals.uart_rx_bytes += record.uart_rx_bytes;
+		core_util_critical_section_exit();
+
+		if(_perf_callback)
+		{
+			_perf_callback(record);
+		}
+	}
+
+	/** Start tracing an operation, snapshotting the driver's counters
+	 * 
+	 * @param &interface Address of the interface performing the operation
+	 * @param operation Operation being traced
+	 * @param &result Address of the operation's status variable
+	 */
+	TP_NBIoT_Interface::TP_Perf_Scope::TP_Perf_Scope(TP_NBIoT_Interface &interface, TP_Perf_Operation operation, int &result) :
+													 _interface(interface), _operation(operation), _result(result)
+	{
+		_start_ms = Kernel::get_ms_count();
+
+		#if TP_NBIOT_DRIVER_AT_STATISTICS
+			_interface._modem.get_at_statistics(_at_commands, _uart_tx_bytes, _uart_rx_bytes);
+		#else
+			_at_commands = 0;
+			_uart_tx_bytes = 0;
+			_uart_rx_bytes = 0;
+		#endif /* #if TP_NBIOT_DRIVER_AT_STATISTICS */
+	}
+
+	/** Complete the trace of an operation
+	 */
+	TP_NBIoT_Interface::TP_Perf_Scope::~TP_Perf_Scope()
+	{
+		uint32_t at_commands = 0;
+		uint32_t uart_tx_bytes = 0;
+		uint32_t uart_rx_bytes = 0;
+
+		#if TP_NBIOT_DRIVER_AT_STATISTICS
+			_interface._modem.get_at_statistics(at_commands, uart_tx_bytes, uart_rx_bytes);
+		#endif /* #if TP_NBIOT_DRIVER_AT_STATISTICS */
+
+		TP_Perf_Record record;
+		record.operation = _operation;
+		record.start_ms = (uint32_t)_start_ms;
+		record.duration_ms = (uint32_t)(Kernel::get_ms_count() - _start_ms);
+		record.at_commands = (uint16_t)(at_commands - _at_commands);
+		record.uart_tx_bytes = uart_tx_bytes - _uart_tx_bytes;
+		record.uart_rx_bytes = uart_rx_bytes - _uart_rx_bytes;
+		record.result = _result;
+
+		_interface.perf_record(record);
+	}
+#endif /* #if TP_NBIOT_PERF_TRACE */
+
+#if TP_NBIOT_STATS
+	/** Return the counters since the last reset, time in the current
+	 *  connection status being counted up to now
+	 * 
+	 * @param &stats Address of TP_Modem_Stats in which to store counters
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::get_stats(TP_Modem_Stats &stats)
+	{
+		TP_NBIOT_LOCK();
+
+		stats_note_status();
+
+		_stats.period_s = (uint32_t)((Kernel::get_ms_count() - _stats_reset_ms) / 1000);
+		stats = _stats;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Write the counters as a compact binary summary to piggyback on an
+	 *  uplink: a version byte of 1 followed by each TP_Modem_Stats field, in
+	 *  declaration order, as an unsigned LEB128 varint. attach_time_total_ms
+	 *  is replaced by the mean attach time
+	 * 
+	 * @param *buffer Pointer to buffer into which to write the summary
+	 * @param capacity Capacity of buffer in bytes, STATS_SUMMARY_MAX always
+	 *                 being enough
+	 * @param &length Address of size_t in which to store the summary length
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::get_stats_summary(uint8_t *buffer, size_t capacity, size_t &length)
+	{
+		TP_NBIOT_LOCK();
+
+		TP_Modem_Stats stats;
+		get_stats(stats);
+
+		stats.attach_time_total_ms = stats.attach_successes > 0 ? 
+									 stats.attach_time_total_ms / stats.attach_successes : 0;
+
+		/** Written to a scratch buffer of the largest size so the caller's
+		 *  buffer need only be as large as this summary
+		 */
+		static_assert(1 + 5 * (sizeof(TP_Modem_Stats) / sizeof(uint32_t)) <= TP_NBIoT_Interface::STATS_SUMMARY_MAX,
+					  "STATS_SUMMARY_MAX must hold every field as a 5 byte varint");
+
+		uint8_t summary[TP_NBIoT_Interface::STATS_SUMMARY_MAX];
+		const uint32_t *fields = (const uint32_t *)&stats;
+
+		length = 0;
+		summary[length++] = 1;
+
+		for(size_t i = 0; i < sizeof(stats) / sizeof(uint32_t); i++)
+		{
+			write_varint(summary, length, fields[i]);
+		}
+
+		if(length > capacity)
+		{
+			return TP_NBIoT_Interface::BUFFER_TOO_SMALL;
+		}
+
+		memcpy(buffer, summary, length);
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Sample the RADIO and BLER NUESTATS categories into the TX power and
+	 *  BLER distributions. Samples are also taken whenever get_nuestats() is
+	 *  called, so this is only needed if nothing else queries them. Best
+	 *  called while the module is awake, i.e. straight after an uplink
+	 * 
+	 * @return Indicates success or failure reason
+	 */
+	int TP_NBIoT_Interface::sample_stats()
+	{
+		TP_NBIOT_LOCK();
+
+		TP_NBIOT_SCRATCH(TP_Nuestats_Radio, radio, radio);
+
+		int status = get_nuestats(radio);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		TP_NBIOT_SCRATCH(TP_Nuestats_BLER, bler, bler);
+
+		return get_nuestats(bler);
+	}
+
+	/** Clear all counters
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::reset_stats()
+	{
+		TP_NBIOT_LOCK();
+
+		memset(&_stats, 0, sizeof(_stats));
+		_stats_reset_ms = Kernel::get_ms_count();
+		_stats_status_ms = _stats_reset_ms;
+	}
+
+	/** Credit the time since the last call to the current connection
+	 *  status. Called before the status changes
+	 * 
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::stats_note_status()
+	{
+		uint64_t now = Kernel::get_ms_count();
+
+		/** Only whole seconds are credited, the remainder carrying over to
+		 *  the next call
+		 */
+		uint64_t seconds = (now - _stats_status_ms) / 1000;
+		_stats_status_ms += seconds * 1000;
+
+		if(_snapshot.valid && (int)_snapshot.status < 8)
+		{
+			_stats.status_time_s[(int)_snapshot.status] += (uint32_t)seconds;
+		}
+	}
+
+	/** Count a CoAP request
+	 * 
+	 * @param status Status returned by the driver
+	 * @param response_code CoAP response code, valid if status is NBIOT_OK
+	 * @param sent Number of bytes sent
+	 * @param received Number of bytes received
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::stats_note_coap(int status, int response_code, size_t sent, size_t received)
+	{
+		size_t index = TP_NBIoT_Interface::STATS_COAP_FAILED;
+
+		if(status == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			switch(response_code / 100)
+			{
+				case 2:  index = TP_NBIoT_Interface::STATS_COAP_SUCCESS;      break;
+				case 4:  index = TP_NBIoT_Interface::STATS_COAP_CLIENT_ERROR; break;
+				case 5:  index = TP_NBIoT_Interface::STATS_COAP_SERVER_ERROR; break;
+				default: index = TP_NBIoT_Interface::STATS_COAP_OTHER;        break;
+			}
+		}
+
+		_stats.coap[index]++;
+		stats_note_traffic(status == TP_NBIoT_Interface::NBIOT_OK ? sent : 0, received);
+	}
+
+	/** Count bytes sent and received
+	 * 
+	 * @param sent Number of bytes sent
+	 * @param received Number of bytes received
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::stats_note_traffic(size_t sent, size_t received)
+	{
+		_stats.bytes_sent += sent;
+		_stats.bytes_received += received;
+	}
+
+	/** Add NUESTATS values to the distributions
+	 * 
+	 * @param type NUESTATS category
+	 * @param *values Pointer to the parsed values of that category
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::stats_note_nuestats(TP_Nuestats_Type type, const void *values)
+	{
+		/** TX power in tenths of a dBm and BLER in the module's units of 
+		 *  tenths of a percent
+		 */
+		static const int32_t tx_power_edges[TP_NBIoT_Interface::STATS_BUCKETS - 1] = { 0, 100, 200 };
+		static const int32_t bler_edges[TP_NBIoT_Interface::STATS_BUCKETS - 1] = { 10, 50, 100 };
+
+		if(type == TP_Nuestats_Type::RADIO)
+		{
+			const TP_Nuestats_Radio *radio = (const TP_Nuestats_Radio *)values;
+			_stats.tx_power[stats_bucket(radio->tx_power, tx_power_edges)]++;
+		}
+		else if(type == TP_Nuestats_Type::BLER)
+		{
+			const TP_Nuestats_BLER *bler = (const TP_Nuestats_BLER *)values;
+			_stats.bler[stats_bucket((int32_t)bler->rlc_ul_bler, bler_edges)]++;
+		}
+	}
+
+	/** Index of the bucket of a distribution that a sample falls into
+	 * 
+	 * @param value Sample
+	 * @param *edges Pointer to the STATS_BUCKETS - 1 ascending bucket edges
+	 * @return Bucket index
+	 */
+	size_t TP_NBIoT_Interface::stats_bucket(int32_t value, const int32_t *edges)
+	{
+		size_t bucket = 0;
+
+		while(bucket < TP_NBIoT_Interface::STATS_BUCKETS - 1 && value >= edges[bucket])
+		{
+			bucket++;
+		}
+
+		return bucket;
+	}
+
+	/** Write an unsigned LEB128 varint
+	 * 
+	 * @param *buffer Pointer to buffer
+	 * @param &length Address of size_t holding the current length, advanced
+	 * @param value Value
+	 * @return None
+	 */
+	void TP_NBIoT_Interface::write_varint(uint8_t *buffer, size_t &length, uint32_t value)
+	{
+		while(value >= 0x80)
+		{
+			buffer[length++] = (uint8_t)(value | 0x80);
+			value >>= 7;
+		}
+
+		buffer[length++] = (uint8_t)value;
+	}
+#endif /* #if TP_NBIOT_STATS */
+
+/** Set T3412 timer to multiples of given units
+ * 
+ * @param unit Enumerated value within T3412_units enum class
+ * @param multiples Value no greater than 31 that determines
+ *                  how many multiples of unit to set the
+ *                  timer to
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::set_tau_timer(T3412_units unit, uint8_t multiples)
+{
+    TP_NBIOT_LOCK();
+
+    if(multiples > 31)
+    {
+        return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+    }
+
+	if(unit > T3412_units::DEACT)
+	{
+		return TP_NBIoT_Interface::INVALID_UNIT_VALUE;
+	}
+
+	return write_tau_timer((uint8_t)((T3412_TABLE[(int)unit].code << 5) | multiples));
+}   
+
+/** Retrieve T3412 timer value as binary string
+ * 
+ * @param *timer Pointer to char array in which to store
+ *               timer value as binary string
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_tau_timer(char *timer)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::GET_TAU_TIMER, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.get_t3412_timer(timer);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+	
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Retrieve T3412 timer value as units and multiples
+ * 
+ * @param &unit Address of T3412_units value into which
+ *              the determined timer unit will be stored
+ * @param &multiples Address of uint8_t into which 
+ *                   the determined multiples value will be 
+ *                   stored
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_tau_timer(T3412_units &unit, uint8_t &multiples)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+    TP_NBIOT_SCRATCH(TP_Timer_String, timer, timer[0]);
+
+    status = get_tau_timer(timer);
+    if(status != TP_NBIoT_Interface::NBIOT_OK)
+    {
+        return status;
+    }
+
+	uint8_t octet = 0;
+	status = timer_string_to_octet(timer, octet);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		unit = TP_NBIoT_Interface::T3412_units::INVALID;
+		return status;
+	}
+
+	unit = T3412_UNITS[octet >> 5];
+	multiples = octet & 0x1F;
+    
+    return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Set T3324 timer to multiples of given units
+ * 
+ * @param unit Enumerated value within T3324_units enum class
+ * @param multiples Value no greater than 31 that determines
+ *                  how many multiples of unit to set the
+ *                  timer to
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::set_active_time(T3324_units unit, uint8_t multiples)
+{
+	TP_NBIOT_LOCK();
+
+	if(multiples > 31)
+	{
+		return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+	}
+
+	if(unit > T3324_units::DEACT)
+	{
+		return TP_NBIoT_Interface::INVALID_UNIT_VALUE;
+	}
+
+	return write_active_time((uint8_t)((T3324_TABLE[(int)unit].code << 5) | multiples));
+}
+
+/** Retrieve T3324 timer value as binary string
+ * 
+ * @param *timer Pointer to char array in which to store
+ *               timer value as binary string
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_active_time(char *timer)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::GET_ACTIVE_TIME, status);
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.get_t3324_timer(timer);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
+	
+	TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+}
+
+/** Retrieve T3324 timer value as units and multiples
+ * 
+ * @param &unit Address of T3324_units value into which
+ *              the determined timer unit will be stored
+ * @param &multiples Address of uint8_t into which 
+ *                   the determined multiples value will be 
+ *                   stored
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_active_time(T3324_units &unit, uint8_t &multiples)
+{
+	TP_NBIOT_LOCK();
+
+	int status = -1;
+    TP_NBIOT_SCRATCH(TP_Timer_String, timer, timer[1]);
+
+    status = get_active_time(timer);
+    if(status != TP_NBIoT_Interface::NBIOT_OK)
+    {
+        return status;
+    }
+
+	uint8_t octet = 0;
+	status = timer_string_to_octet(timer, octet);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		unit = TP_NBIoT_Interface::T3324_units::INVALID;
+		return status;
+	}
+
+	unit = T3324_UNITS[octet >> 5];
+	multiples = octet & 0x1F;
+    
+    return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Set T3412 and T3324 timers to the closest values that can be encoded,
+ *  i.e. set_psm_timers(std::chrono::hours(24), std::chrono::seconds(10))
+ * 
+ * @param tau Requested T3412 timer value
+ * @param active Requested T3324 timer value
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::set_psm_timers(std::chrono::seconds tau, std::chrono::seconds active)
+{
+	TP_NBIOT_LOCK();
+
+	return set_psm_timers(tau_timer_octet(tau), active_time_octet(active));
+}
+
+/** Set T3412 and T3324 timers from already encoded values. Passing 
+ *  constants from tau_timer_octet() and active_time_octet() leaves
+ *  no encoding to be done at runtime
+ * 
+ * @param tau_octet T3412 value encoded as a GPRS timer 3 octet
+ * @param active_octet T3324 value encoded as a GPRS timer 2 octet
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::set_psm_timers(uint8_t tau_octet, uint8_t active_octet)
+{
+	TP_NBIOT_LOCK();
+
+	TP_NBIOT_SCRATCH(TP_Timer_String, tau, timer[0]);
+	TP_NBIOT_SCRATCH(TP_Timer_String, active, timer[1]);
+	timer_octet_to_string(tau_octet, tau);
+	timer_octet_to_string(active_octet, active);
+
+	const TP_AT_Step steps[] =
+	{
+		{ TP_AT_Command::SET_T3412_TIMER, 0, 0, tau    },
+		{ TP_AT_Command::SET_T3324_TIMER, 0, 0, active }
+	};
+
+	int status = run_at_batch(steps, sizeof(steps) / sizeof(steps[0]));
+
+	/** Keep the batch deadline in step with whichever timers are now in use
+	 */
+	if(_at_batch.completed > 0)
+	{
+		_t3412_s = tau_timer_seconds(tau_octet);
+	}
+
+	if(_at_batch.completed > 1)
+	{
+		_t3324_s = active_time_seconds(active_octet);
+	}
+
+	return status;
+}
+
+/** Enable the adaptive PSM controller. The controller measures the
+ *  interval between uplinks and, on each adaptive_psm_poll(), 
+ *  picks the T3324 and T3412 values within config that minimise the 
+ *  expected energy spent per uplink, weighting time awake by the
+ *  signal power and SNR of the last AT+NUESTATS="RADIO" query. T3324 
+ *  is kept at 
+ *  min_active_s, i.e. the window in which downlinks are expected, 
+ *  unless uplinks come often enough that staying awake is cheaper 
+ *  than waking from PSM. T3412 is set well beyond the uplink 
+ *  interval so periodic TAUs are rarely needed. Uplinks are 
+ *  socket_send_to(), coap_put() and coap_post() requests
+ * 
+ * @param &config Address of limits within which to set the timers
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::configure_adaptive_psm(const TP_Adaptive_PSM_Config &config)
+{
+	TP_NBIOT_LOCK();
+
+	if(config.min_active_s > config.max_active_s || config.min_tau_s > config.max_tau_s ||
+	   config.max_tau_s <= config.min_active_s)
+	{
+		return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+	}
+
+	int status = read_psm_timers();
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	_psm_config = config;
+	_psm_last_uplink_ms = 0;
+	_psm_interval_ms = 0;
+	_psm_uplinks = 0;
+	_psm_enabled = true;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Disable the adaptive PSM controller, leaving the timers as they are
+ * 
+ * @return None
+ */
+void TP_NBIoT_Interface::disable_adaptive_psm()
+{
+	TP_NBIOT_LOCK();
+
+	_psm_enabled = false;
+}
+
+/** Re-evaluate the PSM timers and reprogram them if the saving 
+ *  expected over TP_NBIOT_PSM_HORIZON_S outweighs the cost of
+ *  renegotiating them with the network. Nothing is changed until
+ *  TP_NBIOT_PSM_MIN_SAMPLES uplink intervals have been measured
+ * 
+ * @param &reprogrammed Address of boolean set true if the timers
+ *                      were changed
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::adaptive_psm_poll(bool &reprogrammed)
+{
+	TP_NBIOT_LOCK();
+
+	reprogrammed = false;
+
+	if(!_psm_enabled || _psm_uplinks <= TP_NBIOT_PSM_MIN_SAMPLES)
+	{
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	/** Paging and cell measurements take more repetitions the weaker the
+	 *  signal, so each second awake costs more in poor coverage. A module
+	 *  in PSM isn't woken to measure, the last measurement is used
+	 */
+	if(!modem_in_psm())
+	{
+		TP_NBIOT_SCRATCH(TP_Nuestats_Radio, radio, radio);
+		get_nuestats(radio);
+	}
+
+	uint32_t coverage = 1;
+
+	if(_psm_radio_valid)
+	{
+		if(_psm_rsrp_dbm < TP_NBIOT_PSM_RSRP_CE1_DBM || _psm_snr_db < TP_NBIOT_PSM_SNR_CE1_DB)
+		{
+			coverage = 4;
+		}
+		else if(_psm_rsrp_dbm < TP_NBIOT_PSM_RSRP_CE0_DBM || _psm_snr_db < TP_NBIOT_PSM_SNR_CE0_DB)
+		{
+			coverage = 2;
+		}
+	}
+
+	uint32_t interval_s = (_psm_interval_ms + 500) / 1000;
+	if(interval_s == 0)
+	{
+		interval_s = 1;
+	}
+
+	uint64_t active_s = _psm_config.min_active_s;
+	if((uint64_t)interval_s * coverage < TP_NBIOT_PSM_WAKE_COST_S)
+	{
+		active_s = interval_s + interval_s / 4;
+	}
+
+	if(active_s < _psm_config.min_active_s)
+	{
+		active_s = _psm_config.min_active_s;
+	}
+	else if(active_s > _psm_config.max_active_s)
+	{
+		active_s = _psm_config.max_active_s;
+	}
+
+	uint64_t tau_s = (uint64_t)interval_s * 4;
+	if(tau_s <= active_s)
+	{
+		tau_s = active_s + 1;
+	}
+
+	if(tau_s < _psm_config.min_tau_s)
+	{
+		tau_s = _psm_config.min_tau_s;
+	}
+	else if(tau_s > _psm_config.max_tau_s)
+	{
+		tau_s = _psm_config.max_tau_s;
+	}
+
+	uint8_t tau_octet = tau_timer_octet(std::chrono::seconds(tau_s));
+	uint8_t active_octet = active_time_octet(std::chrono::seconds(active_s));
+
+	uint32_t new_tau_s = tau_timer_seconds(tau_octet);
+	uint32_t new_active_s = active_time_seconds(active_octet);
+
+	if(new_tau_s == _t3412_s && new_active_s == _t3324_s)
+	{
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	uint64_t current_cost = psm_uplink_cost(interval_s, _t3324_s, _t3412_s, coverage);
+	uint64_t new_cost = psm_uplink_cost(interval_s, new_active_s, new_tau_s, coverage);
+
+	uint64_t uplinks = TP_NBIOT_PSM_HORIZON_S / interval_s;
+	if(new_cost >= current_cost || (current_cost - new_cost) * uplinks <= TP_NBIOT_PSM_RENEGOTIATE_COST_S)
+	{
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	int status = set_psm_timers(tau_octet, active_octet);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	reprogrammed = true;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Enable the coverage gate. While the serving cell's signal power is
+ *  below config.min_rsrp_dbm, or its coverage enhancement level above
+ *  config.max_ecl, NORMAL priority coap_post() and coap_post_stream() 
+ *  requests return COVERAGE_DEFERRED and batch_poll() holds the pending 
+ *  batch. Radio conditions are measured with one AT+NUESTATS="RADIO" query
+ *  and measured again after a +CEREG URC, i.e. on reselection to another 
+ *  cell or a change of registration. A module in PSM isn't woken to measure
+ *  again, the last measurement stands until the module is next awake. Held
+ *  traffic is let through once it has been held for config.max_deferral_s
+ * 
+ * @param &config Thresholds and maximum deferral
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::configure_coverage_gate(const TP_Coverage_Gate_Config &config)
+{
+	TP_NBIOT_LOCK();
+
+	if(config.max_ecl > 2)
+	{
+		return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+	}
+
+	_gate_config = config;
+	_gate_enabled = true;
+	_gate_measured = false;
+	_gate_holding = false;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Disable the coverage gate
+ * 
+ * @return None
+ */
+void TP_NBIoT_Interface::disable_coverage_gate()
+{
+	TP_NBIOT_LOCK();
+
+	_gate_enabled = false;
+	_gate_holding = false;
+}
+
+/** Would traffic of the given priority pass the coverage gate now?
+ *  Also starts the deferral period if it would not
+ * 
+ * @param priority Traffic priority
+ * @param &open Address of bool in which to store whether traffic may be sent
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::coverage_gate_open(TP_Traffic_Priority priority, bool &open)
+{
+	TP_NBIOT_LOCK();
+
+	open = coverage_gate(priority) == TP_NBIoT_Interface::NBIOT_OK;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Ensure that the CoAP profile is loaded and the CoAP AT interface
+ *  is selected before a CoAP request. Each step is only performed if
+ *  the modem state is not already known to be correct
+ *
+ * @param uplink Whether the request carries a payload, i.e. counts as
+ *               an uplink for the adaptive PSM controller
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::coap_session_begin(bool uplink)
+{
+	return coap_session_begin(uplink, _coap_selected_profile);
+}
+
+/** Ensure that a CoAP profile is loaded and the CoAP AT interface
+ *  is selected before a CoAP request to that profile, leaving the
+ *  selected profile as is
+ *
+ * @param uplink Whether the request carries a payload, i.e. counts as
+ *               an uplink for the adaptive PSM controller
+ * @param profile CoAP profile to load
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::coap_session_begin(bool uplink, int profile)
+{
+	int status = -1;
+
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		if(_coap_loaded_profile != profile)
+		{
+			/** Loading a profile deselects the CoAP AT interface
+			 */
+			_coap_interface_selected = false;
+
+			status = _modem.load_profile(profile);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			_coap_loaded_profile = profile;
+		}
+
+		if(!_coap_interface_selected)
+		{
+			status = _modem.select_coap_at_interface();
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				coap_session_reset();
+				return status;
+			}
+
+			_coap_interface_selected = true;
+		}
+
+		if(uplink)
+		{
+			psm_note_uplink();
+		}
+
+		run_deferred_queries();
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+}
+
+/** Forget which CoAP profile is loaded and whether the CoAP AT
+ *  interface is selected, forcing both to be set up again before
+ *  the next CoAP request
+ *
+ * @return None
+ */
+void TP_NBIoT_Interface::coap_session_reset()
+{
+	_coap_loaded_profile = TP_NBIoT_Interface::NO_COAP_PROFILE;
+	_coap_interface_selected = false;
+}
+
+/** TP_CoAP_Block_Reader used to walk the chain of TP_CoAP_Buffer
+ *  elements of one coap_post_stream() upload
+ *
+ * @param *&block Address of pointer to set to the start of the block
+ * @param max_length Block size
+ * @return Number of bytes in the block
+ */
+size_t TP_NBIoT_Interface::TP_CoAP_Chain_Cursor::read(uint8_t *&block, size_t max_length)
+{
+	/** Skip exhausted and empty buffers
+	 */
+	while(buffer != NULL && offset >= buffer->length)
+	{
+		buffer = buffer->next;
+		offset = 0;
+	}
+
+	if(buffer == NULL)
+	{
+		return 0;
+	}
+
+	size_t length = buffer->length - offset;
+	if(length > max_length)
+	{
+		length = max_length;
+	}
+
+	block = &buffer->data[offset];
+	offset += length;
+
+	return length;
+}
+
+/** Apply a complete UE configuration. The configuration is compared
+ *  against the last known state of the module, read once if unknown,
+ *  and only settings that differ are written. If reboot is true and
+ *  anything was written the modem is rebooted once so that the new 
+ *  settings take effect. Without TP_NBIOT_DRIVER_NCONFIG a setting is
+ *  known once it has been written, so the first call after an MCU 
+ *  reset writes every setting and later calls only those that differ
+ * 
+ * @param &config Address of TP_UE_Config holding desired configuration
+ * @param reboot Reboot the modem if any setting was written
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::apply_ue_config(const TP_UE_Config &config, bool reboot)
+{
+	TP_NBIOT_LOCK();
+
+	bool changed = false;
+
+	return apply_ue_flags(ue_config_to_flags(config), UE_ALL, reboot, changed);
+}
+
+/** Return the UE configuration of the module, from the cached state
+ *  if known or otherwise by reading it from the module
+ * 
+ * @param &config Address of TP_UE_Config in which to store configuration
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::get_ue_config(TP_UE_Config &config)
+{
+	TP_NBIOT_LOCK();
+
+	uint8_t flags = 0;
+	uint8_t known = 0;
+
+	int status = ue_config_current(flags, known);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	config.autoconnect = (flags & UE_AUTOCONNECT) != 0;
+	config.scrambling = (flags & UE_SCRAMBLING) != 0;
+	config.si_avoid = (flags & UE_SI_AVOID) != 0;
+	config.combine_attach = (flags & UE_COMBINE_ATTACH) != 0;
+	config.cell_reselection = (flags & UE_CELL_RESELECTION) != 0;
+	config.bip = (flags & UE_BIP) != 0;
+	config.sim_psm = (flags & UE_SIM_PSM) != 0;
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Write every UE setting in mask that differs from the cached state
+ *  of the module, or every setting in mask if the state is unknown,
+ *  then reboot once if requested and anything was written. Settings
+ *  outside mask are never written
+ * 
+ * @param desired UE_* flags of the settings that should be TRUE
+ * @param mask UE_* flags of the settings to write
+ * @param reboot Reboot the modem if any setting was written
+ * @param &changed Address of bool set to true if any setting was written
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::apply_ue_flags(uint8_t desired, uint8_t mask, bool reboot, bool &changed)
+{
+	uint8_t current = 0;
+	uint8_t known = 0;
+	changed = false;
+
+	/** Settings whose state is unknown, i.e. because the read failed or
+	 *  was truncated, are written if in mask
+	 */
+	int status = -1;
+
+	ue_config_current(current, known);
+	uint8_t differ = ((desired ^ current) | ~known) & mask & UE_ALL;
+
+	TP_NBIOT_SCRATCH(TP_AT_Batch, steps, steps);
+	uint8_t count = 0;
+
+	for(uint8_t flag = UE_AUTOCONNECT; flag & UE_ALL; flag <<= 1)
+	{
+		if(differ & flag)
+		{
+			steps[count++] = { TP_AT_Command::CONFIGURE_UE, flag, (desired & flag) != 0, NULL };
+		}
+	}
+
+	if(count > 0)
+	{
+		run_at_batch(steps, count);
+	}
+
+	/** Settings written by the batch are recorded, any from the first that
+	 *  failed onwards are written once more one at a time, with a retry
+	 */
+	for(uint8_t i = 0; i < count; i++)
+	{
+		uint8_t flag = (uint8_t)steps[i].value;
+		bool enable = steps[i].option != 0;
+
+		if(i >= _at_batch.completed)
+		{
+			status = write_ue_configuration(flag, enable);
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+		}
+
+		ue_config_cache(flag, enable);
+		changed = true;
+	}
+
+	if(changed && reboot)
+	{
+		return reboot_modem();
+	}
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Return the UE_* flags of the settings that are TRUE, from the
+ *  cached state if every setting is known or otherwise by reading it
+ *  from the module, retrying a failed read once. Settings that have
+ *  been written stay known if the read fails, i.e. without 
+ *  TP_NBIOT_DRIVER_NCONFIG
+ * 
+ * @param &flags Address of integer in which to store flags
+ * @param &known Address of integer in which to store the UE_* flags
+ *               of settings whose state is known
+ * @return Indicates success or failure reason, INVALID_RESPONSE 
+ *         unless every setting is known
+ */
+int TP_NBIoT_Interface::ue_config_current(uint8_t &flags, uint8_t &known)
+{
+	if(_ue_config_known == UE_ALL)
+	{
+		flags = _ue_config;
+		known = UE_ALL;
+
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	int status = read_ue_configuration(flags, known);
+	if(status != TP_NBIoT_Interface::NBIOT_OK && status != TP_NBIoT_Interface::NOT_SUPPORTED)
+	{
+		status = read_ue_configuration(flags, known);
+	}
+
+	/** Settings that were read take the place of those cached, the rest 
+	 *  are filled in from earlier writes
+	 */
+	_ue_config = (flags & known) | (_ue_config & _ue_config_known & ~known);
+	_ue_config_known |= known;
+
+	flags = _ue_config;
+	known = _ue_config_known;
+
+	if(known == UE_ALL)
+	{
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return status;
+}
+
+/** Record a setting that has been successfully written
+ * 
+ * @param flag UE_* flag of setting
+ * @param enable Value written
+ * @return None
+ */
+void TP_NBIoT_Interface::ue_config_cache(uint8_t flag, bool enable)
+{
+	_ue_config_known |= flag;
+
+	if(enable)
+	{
+		_ue_config |= flag;
+	}
+	else
+	{
+		_ue_config &= ~flag;
+	}
+}
+
+/** Convert TP_UE_Config to UE_* flags
+ * 
+ * @param &config Address of TP_UE_Config to convert
+ * @return UE_* flags of the settings that are TRUE
+ */
+uint8_t TP_NBIoT_Interface::ue_config_to_flags(const TP_UE_Config &config)
+{
+	uint8_t flags = 0;
+
+	flags |= config.autoconnect ? UE_AUTOCONNECT : 0;
+	flags |= config.scrambling ? UE_SCRAMBLING : 0;
+	flags |= config.si_avoid ? UE_SI_AVOID : 0;
+	flags |= config.combine_attach ? UE_COMBINE_ATTACH : 0;
+	flags |= config.cell_reselection ? UE_CELL_RESELECTION : 0;
+	flags |= config.bip ? UE_BIP : 0;
+	flags |= config.sim_psm ? UE_SIM_PSM : 0;
+
+	return flags;
+}
+
+/** Read the current AT+NCONFIG settings of the module. Settings 
+ *  missing from the response, i.e. because it was truncated, are 
+ *  left out of known rather than assumed FALSE
+ * 
+ * @param &flags Address of integer in which to store the UE_*
+ *               flags of settings that are TRUE
+ * @param &known Address of integer in which to store the UE_*
+ *               flags of settings that were read
+ * @return Indicates success or failure reason, INVALID_RESPONSE
+ *         unless every setting was read and NOT_SUPPORTED if built 
+ *         without TP_NBIOT_DRIVER_NCONFIG
+ */
+int TP_NBIoT_Interface::read_ue_configuration(uint8_t &flags, uint8_t &known)
+{
+	#if TP_NBIOT_DRIVER_NCONFIG
+		int status = -1;
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			static const struct
+			{
+				uint8_t flag;
+				const char *name;
+			} settings[] = 
+			{
+				{ UE_AUTOCONNECT,      "\"AUTOCONNECT\"" },
+				{ UE_SCRAMBLING,       "\"CR_0354_0338_SCRAMBLING\"" },
+				{ UE_SI_AVOID,         "\"CR_0859_SI_AVOID\"" },
+				{ UE_COMBINE_ATTACH,   "\"COMBINE_ATTACH\"" },
+				{ UE_CELL_RESELECTION, "\"CELL_RESELECTION\"" },
+				{ UE_BIP,              "\"ENABLE_BIP\"" },
+				{ UE_SIM_PSM,          "\"NAS_SIM_POWER_SAVING_ENABLE\"" }
+			};
+
+			char data[TP_NBIoT_Interface::NCONFIG_BUFFER_SIZE];
+
+			flags = 0;
+			known = 0;
+
+			status = _modem.nconfig(data, sizeof(data));
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			/** Each line is of the form +NCONFIG: "<name>","<TRUE|FALSE>". A 
+			 *  line cut short matches neither value and is left unknown
+			 */
+			for(size_t i = 0; i < sizeof(settings) / sizeof(settings[0]); i++)
+			{
+				const char *entry = strstr(data, settings[i].name);
+				if(entry == NULL)
+				{
+					continue;
+				}
+
+				entry += strlen(settings[i].name);
+				if(strncmp(entry, ",\"TRUE\"", 7) == 0)
+				{
+					flags |= settings[i].flag;
+					known |= settings[i].flag;
+				}
+				else if(strncmp(entry, ",\"FALSE\"", 8) == 0)
+				{
+					known |= settings[i].flag;
+				}
+			}
+
+			if(known != UE_ALL)
+			{
+				return TP_NBIoT_Interface::INVALID_RESPONSE;
+			}
+
+			return TP_NBIoT_Interface::NBIOT_OK;
+		}
+
+		return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	#else
+		/** Without a driver that reads AT+NCONFIG? every setting is unknown,
+		 *  so callers write the settings they need
+		 */
+		flags = 0;
+		known = 0;
+
+		return TP_NBIoT_Interface::NOT_SUPPORTED;
+	#endif /* #if TP_NBIOT_DRIVER_NCONFIG */
+}
+
+/** Write a single AT+NCONFIG setting, retrying once on failure
+ * 
+ * @param flag UE_* flag of setting to write
+ * @param enable Value to write
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::write_ue_configuration(uint8_t flag, bool enable)
+{
+	int status = -1;
+
+	for(int attempt = 0; attempt < 2; attempt++)
+	{
+		switch(flag)
+		{
+			case UE_AUTOCONNECT:
+			{
+				status = enable ? enable_autoconnect() : disable_autoconnect();
+				break;
+			}
+			case UE_SCRAMBLING:
+			{
+				status = enable ? enable_scrambling() : disable_scrambling();
+				break;
+			}
+			case UE_SI_AVOID:
+			{
+				status = enable ? enable_si_avoid() : disable_si_avoid();
+				break;
+			}
+			case UE_COMBINE_ATTACH:
+			{
+				status = enable ? enable_combine_attach() : disable_combine_attach();
+				break;
+			}
+			case UE_CELL_RESELECTION:
+			{
+				status = enable ? enable_cell_reselection() : disable_cell_reselection();
+				break;
+			}
+			case UE_BIP:
+			{
+				status = enable ? enable_bip() : disable_bip();
+				break;
+			}
+			case UE_SIM_PSM:
+			{
+				status = enable ? enable_sim_power_save_mode() : disable_sim_power_save_mode();
+				break;
+			}
+			default:
+			{
+				return TP_NBIoT_Interface::INVALID_UNIT_VALUE;
+			}
+		}
+
+		if(status == TP_NBIoT_Interface::NBIOT_OK)
+		{
+			break;
+		}
+	}
+
+	return status;
+}
+
+#if TP_NBIOT_BATCHING
+	/** Work out when the batch begun by a record appended now must be flushed
+	 * 
+	 * @return Deadline in Kernel::get_ms_count() time
+	 */
+	uint64_t TP_NBIoT_Interface::batch_deadline()
+	{
+		uint64_t now = Kernel::get_ms_count();
+		uint64_t deadline = now + (uint64_t)_batch_max_latency_s * 1000;
+
+		/** The modem wakes for a periodic TAU at least once per T3412 so
+		 *  waiting any longer gains nothing. A T3412 of 0 means periodic TAU
+		 *  is deactivated rather than due straight away
+		 */
+		if(_t3412_s != UINT32_MAX && _t3412_s > 0)
+		{
+			uint64_t tau_deadline = now + (uint64_t)_t3412_s * 1000;
+			if(tau_deadline < deadline)
+			{
+				deadline = tau_deadline;
+			}
+		}
+
+		/** If the modem is awake then land the flush inside this active window.
+		 *  T3324 runs from RRC release, which is when the snapshot last changed 
+		 *  if the connection is already released
+		 */
+		TP_Connection_Snapshot snapshot;
+		get_connection_snapshot(snapshot);
+
+		if(snapshot.valid && _t3324_s > 0 &&
+		   (snapshot.status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_CONNECTED ||
+			snapshot.status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED))
+		{
+			uint64_t window_start = now;
+			if(snapshot.status == TP_Connection_Status::ACTIVE_REGISTERED_RRC_RELEASED && _urc_oob_attached)
+			{
+				window_start = snapshot.timestamp_ms;
+			}
+
+			uint64_t window_end = window_start + (uint64_t)_t3324_s * 1000;
+			if(window_end > now + TP_NBIOT_BATCH_GUARD_MS && window_end - TP_NBIOT_BATCH_GUARD_MS < deadline)
+			{
+				deadline = window_end - TP_NBIOT_BATCH_GUARD_MS;
+			}
+		}
+
+		return deadline;
+	}
+#endif /* #if TP_NBIOT_BATCHING */
+
+/** Query a single NUESTATS category, parsing each line of the 
+ *  response as it arrives into target
+ * 
+ * @param type NUESTATS category
+ * @param *target Pointer to the TP_Nuestats_* struct of type
+ * @return Indicates success or failure reason, NOT_SUPPORTED if built
+ *         without TP_NBIOT_DRIVER_NUESTATS
+ */
+int TP_NBIoT_Interface::query_nuestats(TP_Nuestats_Type type, void *target)
+{
+	#if TP_NBIOT_DRIVER_NUESTATS
+		static const char *const types[] = { "RADIO", "CELL", "BLER", "THP", "APPSMEM" };
+
+		int status = -1;
+		TP_NBIOT_TRACE(TP_Perf_Operation::NUESTATS, status);
+
+		if(_driver == TP_NBIoT_Interface::SARAN2)
+		{
+			_nuestats_type = type;
+			_nuestats_target = target;
+			_nuestats_fields = 0;
+
+			status = _modem.nuestats(types[(int)type], callback(this, &TP_NBIoT_Interface::nuestats_line));
+			_nuestats_target = NULL;
+
+			if(status != TP_NBIoT_Interface::NBIOT_OK)
+			{
+				return status;
+			}
+
+			/** No neighbouring cells is a valid CELL response, anything else 
+			 *  must contain at least one value
+			 */
+			if(_nuestats_fields == 0 && type != TP_Nuestats_Type::CELL)
+			{
+				TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::INVALID_RESPONSE);
+			}
+
+			TP_NBIOT_STAT(stats_note_nuestats(type, target));
+
+			TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+		}
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
+	#else
+		(void)type;
+		(void)target;
+
+		return TP_NBIoT_Interface::NOT_SUPPORTED;
+	#endif /* #if TP_NBIOT_DRIVER_NUESTATS */
+}
+
+/** Parse one line of a NUESTATS response into _nuestats_target
+ * 
+ * @param *line Pointer to null terminated line
+ * @return None
+ */
+void TP_NBIoT_Interface::nuestats_line(const char *line)
+{
+	if(_nuestats_target == NULL)
+	{
+		return;
+	}
+
+	const TP_Nuestats_Field *fields = NULL;
+
+	switch(_nuestats_type)
+	{
+		case TP_Nuestats_Type::RADIO:   fields = NUESTATS_RADIO_FIELDS;   break;
+		case TP_Nuestats_Type::BLER:    fields = NUESTATS_BLER_FIELDS;    break;
+		case TP_Nuestats_Type::THP:     fields = NUESTATS_THP_FIELDS;     break;
+		case TP_Nuestats_Type::APPSMEM: fields = NUESTATS_APPSMEM_FIELDS; break;
+		case TP_Nuestats_Type::CELL:
+		{
+			/** CELL lines are of the form "CELL",earfcn,pci,primary,rsrp,rsrq,rssi,snr
+			 */
+			TP_Nuestats_Cell *cell = static_cast<TP_Nuestats_Cell *>(_nuestats_target);
+			const char *values = strstr(line, "\"CELL\",");
+			if(values == NULL || cell->count >= TP_NBIOT_NUESTATS_MAX_CELLS)
+			{
+				return;
+			}
+
+			TP_Nuestats_Cell_Entry &entry = cell->cells[cell->count];
+			if(sscanf(values + 7, "%d,%d,%d,%d,%d,%d,%d", &entry.earfcn, &entry.pci, &entry.primary,
+					  &entry.rsrp, &entry.rsrq, &entry.rssi, &entry.snr) == 7)
+			{
+				cell->count++;
+				_nuestats_fields++;
+			}
+
+			return;
+		}
+		default:
+		{
+			return;
+		}
+	}
+
+	/** Other lines are of the form "TYPE","Name",value
+	 */
+	const char *name = strstr(line, "\",\"");
+	if(name == NULL)
+	{
+		return;
+	}
+
+	name += 3;
+	const char *end = strchr(name, '"');
+	if(end == NULL || end[1] != ',')
+	{
+		return;
+	}
+
+	size_t length = end - name;
+
+	for(const TP_Nuestats_Field *field = fields; field->name != NULL; field++)
+	{
+		if(strncmp(field->name, name, length) == 0 && field->name[length] == '\0')
+		{
+			/** Fields are all 32 bits wide, signed values keep their two's 
+			 *  complement representation
+			 */
+			uint32_t value = (uint32_t)strtoll(end + 2, NULL, 10);
+			memcpy((uint8_t *)_nuestats_target + field->offset, &value, sizeof(value));
+			_nuestats_fields++;
+			return;
+		}
+	}
+}
+
+/** Map an EARFCN onto its band
+ * 
+ * @param earfcn LTE channel number
+ * @return Band
+ */
+TP_NBIoT_Interface::TP_NBIoT_Band TP_NBIoT_Interface::band_from_earfcn(int earfcn)
+{
+	if(earfcn >= EARFCN_B8_LOW && earfcn <= EARFCN_B8_HIGH)
+	{
+		return TP_NBIoT_Interface::TP_NBIoT_Band::BAND_8;
+	}
+	else if(earfcn >= EARFCN_B20_LOW && earfcn <= EARFCN_B20_HIGH)
+	{
+		return TP_NBIoT_Interface::TP_NBIoT_Band::BAND_20;
+	}
+
+	return TP_NBIoT_Interface::TP_NBIoT_Band::BAND_UNKNOWN;
+}
+
+/** Read the T3412 and T3324 values in use into _t3412_s and _t3324_s
+ * 
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::read_psm_timers()
+{
+	T3412_units tau_unit;
+	uint8_t tau_multiples = 0;
+
+	int status = get_tau_timer(tau_unit, tau_multiples);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	T3324_units active_unit;
+	uint8_t active_multiples = 0;
+
+	status = get_active_time(active_unit, active_multiples);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
+
+	_t3412_s = tau_timer_seconds(tau_unit, tau_multiples);
+	_t3324_s = active_time_seconds(active_unit, active_multiples);
+
+	return TP_NBIoT_Interface::NBIOT_OK;
+}
+
+/** Record an uplink for the adaptive PSM controller
+ * 
+ * @return None
+ */
+void TP_NBIoT_Interface::psm_note_uplink()
+{
+	if(!_psm_enabled)
+	{
+		return;
+	}
+
+	uint64_t now = Kernel::get_ms_count();
+
+	if(_psm_uplinks > 0)
+	{
+		uint64_t elapsed = now - _psm_last_uplink_ms;
+
+		/** Requests of one exchange, i.e. the blocks of a stream, count once
+		 */
+		if(elapsed < TP_NBIOT_PSM_BURST_MS)
+		{
+			_psm_last_uplink_ms = now;
+			return;
+		}
+
+		uint32_t sample = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+		if(_psm_uplinks == 1)
+		{
+			_psm_interval_ms = sample;
+		}
+		else
+		{
+			_psm_interval_ms = _psm_interval_ms - _psm_interval_ms / 4 + sample / 4;
+		}
+	}
 
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	_psm_last_uplink_ms = now;
+	if(_psm_uplinks < UINT32_MAX)
+	{
+		_psm_uplinks++;
+	}
 }
 
-/** Set T3412 timer to multiples of given units
+/** Is the module known to be in PSM? Only known if URCs are enabled
  * 
- * @param unit Enumerated value within T3412_units enum class
- * @param multiples Value no greater than 31 that determines
- *                  how many multiples of unit to set the
- *                  timer to
- * @return Indicates success or failure reason
+ * @return True if in PSM
  */
-int TP_NBIoT_Interface::set_tau_timer(T3412_units unit, uint8_t multiples)
+bool TP_NBIoT_Interface::modem_in_psm()
 {
-    if(multiples > 31)
-    {
-        return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
-    }
+	return _urc_enabled && _snapshot.valid && _snapshot.psm == 1;
+}
 
-    char binary[8];
-    dec_to_bin_5_bit(multiples, binary);
+/** Run queries deferred while the module was in PSM, refreshing the
+ *  snapshot. Called whenever the module is awake anyway
+ * 
+ * @return None
+ */
+void TP_NBIoT_Interface::run_deferred_queries()
+{
+	/** Cleared first, a query that fails is not retried until asked for
+	 *  again
+	 */
+	uint8_t queries = _deferred_queries;
+	_deferred_queries = 0;
 
-    char data[9];
-	memcpy(&data[8], &"\0", 1);
+	if(queries & TP_NBIoT_Interface::DEFERRED_CSQ)
+	{
+		int power = 0;
+		int quality = 0;
 
-    char unit_char[3];
+		get_csq(power, quality, TP_Query_Mode::URGENT);
+	}
 
-    switch(unit)
-    {
-        case T3412_units::HR_320: 
-        {
-            memcpy(&unit_char[0], &"110", 3);
-            break;
-        }
-        case T3412_units::HR_10: 
-        {
-            memcpy(&unit_char[0], &"010", 3);
-            break;
-        }
-        case T3412_units::HR_1: 
-        {
-            memcpy(&unit_char[0], &"001", 3);
-            break;
-        }
-        case T3412_units::MIN_10: 
-        {
-            memcpy(&unit_char[0], &"000", 3);
-            break;
-        }
-        case T3412_units::MIN_1: 
-        {
-            memcpy(&unit_char[0], &"101", 3);
-            break;
-        }
-        case T3412_units::SEC_30: 
-        {
-            memcpy(&unit_char[0], &"100", 3);
-            break;
-        }
-        case T3412_units::SEC_2: 
-        {
-            memcpy(&unit_char[0], &"011", 3);
-            break;
-        }
-        case T3412_units::DEACT: 
-        {
-            memcpy(&unit_char[0], &"111", 3);
-            break;
-        }
-		default:
-		{
-			return TP_NBIoT_Interface::INVALID_UNIT_VALUE;
-		}
-    }
-    
-    memcpy(&data[0], unit_char, 3);
-    memcpy(&data[3], &binary[0], 5);
+	if(queries & TP_NBIoT_Interface::DEFERRED_BAND)
+	{
+		TP_NBIoT_Band band;
 
-	int status = -1;
+		get_band(band, 0, TP_Query_Mode::URGENT);
+	}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	if(queries & TP_NBIoT_Interface::DEFERRED_COVERAGE)
 	{
-		status = _modem.set_t3412_timer(data);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
-		{
-			return status;
-		}
+		coverage_measure();
+	}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+	if(queries & TP_NBIoT_Interface::DEFERRED_RADIO)
+	{
+		int radio_status = 0;
+
+		get_radio_status(radio_status, TP_Query_Mode::URGENT);
 	}
 
-    return TP_NBIoT_Interface::DRIVER_UNKNOWN;
-}   
+	if(queries & TP_NBIoT_Interface::DEFERRED_PSM)
+	{
+		int power_save_mode = 0;
 
-/** Retrieve T3412 timer value as binary string
+		query_power_save_mode(power_save_mode, TP_Query_Mode::URGENT);
+	}
+}
+
+/** Let traffic of the given priority through the coverage gate, or not
  * 
- * @param *timer Pointer to char array in which to store
- *               timer value as binary string
- * @return Indicates success or failure reason
+ * @param priority Traffic priority
+ * @return NBIOT_OK to send or COVERAGE_DEFERRED to hold
  */
-int TP_NBIoT_Interface::get_tau_timer(char *timer)
+int TP_NBIoT_Interface::coverage_gate(TP_Traffic_Priority priority)
 {
-	int status = -1;
+	if(!_gate_enabled || priority == TP_Traffic_Priority::CRITICAL)
+	{
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	uint64_t now = Kernel::get_ms_count();
+
+	if(!_gate_measured || ((!_urc_enabled || _gate_holding) && now - _gate_measured_ms > TP_NBIOT_COVERAGE_RECHECK_MS))
 	{
-		status = _modem.get_t3412_timer(timer);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		/** Measuring again would wake a module in PSM just to measure, the
+		 *  last measurement stands until it next wakes. Traffic isn't held
+		 *  on the strength of a failed measurement
+		 */
+		if(_gate_measured && modem_in_psm())
 		{
-			return status;
+			_deferred_queries |= TP_NBIoT_Interface::DEFERRED_COVERAGE;
+		}
+		else if(coverage_measure() != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return TP_NBIoT_Interface::NBIOT_OK;
 		}
+	}
 
+	if(_gate_rsrp_dbm >= _gate_config.min_rsrp_dbm && _gate_ecl <= _gate_config.max_ecl)
+	{
+		_gate_holding = false;
 		return TP_NBIoT_Interface::NBIOT_OK;
 	}
-	
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+
+	if(!_gate_holding)
+	{
+		_gate_holding = true;
+		_gate_held_ms = now;
+	}
+
+	if(now - _gate_held_ms >= (uint64_t)_gate_config.max_deferral_s * 1000)
+	{
+		_gate_holding = false;
+		return TP_NBIoT_Interface::NBIOT_OK;
+	}
+
+	return TP_NBIoT_Interface::COVERAGE_DEFERRED;
 }
 
-/** Retrieve T3412 timer value as units and multiples
+/** Measure radio conditions for the coverage gate
  * 
- * @param &unit Address of T3412_units value into which
- *              the determined timer unit will be stored
- * @param &multiples Address of uint8_t into which 
- *                   the determined multiples value will be 
- *                   stored
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::get_tau_timer(T3412_units &unit, uint8_t &multiples)
+int TP_NBIoT_Interface::coverage_measure()
 {
-	int status = -1;
-    char timer[10];
-
-    status = get_tau_timer(timer);
-    if(status != TP_NBIoT_Interface::NBIOT_OK)
-    {
-        return status;
-    }
+	TP_NBIOT_SCRATCH(TP_Nuestats_Radio, radio, radio);
 
-    if(strncmp(timer, "110", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::HR_320;
-    }
-    else if(strncmp(timer, "010", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::HR_10;
-    }
-    else if(strncmp(timer, "001", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::HR_1;
-    }
-    else if(strncmp(timer, "000", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::MIN_10;
-    }
-    else if(strncmp(timer, "101", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::MIN_1;
-    }
-    else if(strncmp(timer, "100", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::SEC_30;
-    }
-    else if(strncmp(timer, "011", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::SEC_2;
-    }
-    else if(strncmp(timer, "111", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3412_units::DEACT;
-    }
-    else
-    {
-        unit = TP_NBIoT_Interface::T3412_units::INVALID;
-    }
+	int status = get_nuestats(radio);
+	if(status != TP_NBIoT_Interface::NBIOT_OK)
+	{
+		return status;
+	}
 
-    uint8_t binary_value = 16;
-    for(int i = 3; i < 8; i++)
-    {
-        if((int)timer[i] == 49) // 1
-        {
-            multiples = multiples + binary_value;
-        }
-        
-        if(binary_value == 1)
-        {
-            break;
-        }
+	_gate_rsrp_dbm = radio.signal_power / 10;
+	_gate_ecl = radio.ecl;
+	_gate_measured = true;
+	_gate_measured_ms = Kernel::get_ms_count();
 
-        binary_value = binary_value / 2;
-    }
-    
-    return TP_NBIoT_Interface::NBIOT_OK;
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Set T3324 timer to multiples of given units
+/** Expected energy spent per uplink for given timer values
  * 
- * @param unit Enumerated value within T3324_units enum class
- * @param multiples Value no greater than 31 that determines
- *                  how many multiples of unit to set the
- *                  timer to
- * @return Indicates success or failure reason
+ * @param interval_s Time between uplinks
+ * @param active_s T3324 value
+ * @param tau_s T3412 value, UINT32_MAX if deactivated
+ * @param coverage Cost of a second awake relative to good coverage
+ * @return Cost in seconds awake in idle mode in good coverage
  */
-int TP_NBIoT_Interface::set_active_time(T3324_units unit, uint8_t multiples)
+uint64_t TP_NBIoT_Interface::psm_uplink_cost(uint32_t interval_s, uint32_t active_s, uint32_t tau_s, uint32_t coverage)
 {
-	if(multiples > 31)
+	/** The module never reaches PSM if the next uplink comes first
+	 */
+	if(interval_s <= active_s)
 	{
-		return TP_NBIoT_Interface::EXCEEDS_MAX_VALUE;
+		return (uint64_t)interval_s * coverage;
 	}
 
-	char binary[8];
-    dec_to_bin_5_bit(multiples, binary);
+	uint64_t cost = (uint64_t)active_s * coverage + TP_NBIOT_PSM_WAKE_COST_S;
 
-    char data[9];
-	memcpy(&data[8], &"\0", 1);
+	/** Each periodic TAU between uplinks is a further wake and active window
+	 */
+	if(tau_s != UINT32_MAX && tau_s > 0)
+	{
+		cost += (uint64_t)(interval_s / tau_s) * ((uint64_t)active_s * coverage + TP_NBIOT_PSM_WAKE_COST_S);
+	}
 
-    char unit_char[3];
+	return cost;
+}
 
-	switch(unit)
+/** Write a timer octet as the bit string expected by the driver, 
+ *  i.e. 0x2A = "00101010"
+ * 
+ * @param octet Encoded timer value
+ * @param *timer Pointer to a char array of at least 9 bytes
+ * @return None
+ */
+void TP_NBIoT_Interface::timer_octet_to_string(uint8_t octet, char *timer)
+{
+	for(int i = 0; i < 8; i++)
 	{
-		case T3324_units::MIN_6:
-		{
-			memcpy(&unit_char[0], &"010", 3);
-			break;
-		}
-		case T3324_units::MIN_1:
-		{
-			memcpy(&unit_char[0], &"001", 3);
-			break;
-		}
-		case T3324_units::SEC_2:
-		{
-			memcpy(&unit_char[0], &"000", 3);
-			break;
-		}
-		case T3324_units::DEACT:
-		{
-			memcpy(&unit_char[0], &"111", 3);
-			break;
-		}
-		default:
-		{
-			return TP_NBIoT_Interface::INVALID_UNIT_VALUE;
-		}
+		timer[i] = (octet & (0x80 >> i)) ? '1' : '0';
 	}
 
-	memcpy(&data[0], unit_char, 3);
-    memcpy(&data[3], &binary[0], 5);
+	timer[8] = '\0';
+}
 
-    int status = -1;
+/** Parse the bit string returned by the driver into a timer octet
+ * 
+ * @param *timer Pointer to bit string
+ * @param &octet Address of uint8_t in which to store encoded timer value
+ * @return Indicates success or failure reason
+ */
+int TP_NBIoT_Interface::timer_string_to_octet(const char *timer, uint8_t &octet)
+{
+	octet = 0;
 
-	if(_driver == TP_NBIoT_Interface::SARAN2)
+	for(int i = 0; i < 8; i++)
 	{
-		status = _modem.set_t3324_timer(data);
-		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		if(timer[i] != '0' && timer[i] != '1')
 		{
-			return status;
+			return TP_NBIoT_Interface::INVALID_RESPONSE;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		octet = (uint8_t)((octet << 1) | (timer[i] - '0'));
 	}
 
-    return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+	return TP_NBIoT_Interface::NBIOT_OK;
 }
 
-/** Retrieve T3324 timer value as binary string
+/** Write an encoded T3412 value to the module
  * 
- * @param *timer Pointer to char array in which to store
- *               timer value as binary string
+ * @param octet T3412 value encoded as a GPRS timer 3 octet
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::get_active_time(char *timer)
+int TP_NBIoT_Interface::write_tau_timer(uint8_t octet)
 {
+	TP_NBIOT_SCRATCH(TP_Timer_String, data, timer[0]);
+	timer_octet_to_string(octet, data);
+
 	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::SET_TAU_TIMER, status);
 
 	if(_driver == TP_NBIoT_Interface::SARAN2)
 	{
-		status = _modem.get_t3324_timer(timer);
+		status = _modem.set_t3412_timer(data);
 		if(status != TP_NBIoT_Interface::NBIOT_OK)
 		{
 			return status;
 		}
 
-		return TP_NBIoT_Interface::NBIOT_OK;
+		/** Keep the batch deadline in step with the timer now in use
+		 */
+		_t3412_s = tau_timer_seconds(octet);
+
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
 	}
-	
-	return TP_NBIoT_Interface::DRIVER_UNKNOWN;
+
+    TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
-/** Retrieve T3324 timer value as units and multiples
+/** Write an encoded T3324 value to the module
  * 
- * @param &unit Address of T3324_units value into which
- *              the determined timer unit will be stored
- * @param &multiples Address of uint8_t into which 
- *                   the determined multiples value will be 
- *                   stored
+ * @param octet T3324 value encoded as a GPRS timer 2 octet
  * @return Indicates success or failure reason
  */
-int TP_NBIoT_Interface::get_active_time(T3324_units &unit, uint8_t &multiples)
+int TP_NBIoT_Interface::write_active_time(uint8_t octet)
 {
-	int status = -1;
-    char timer[10];
-
-    status = get_active_time(timer);
-    if(status != TP_NBIoT_Interface::NBIOT_OK)
-    {
-        return status;
-    }
-
-    if(strncmp(timer, "010", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3324_units::MIN_6;
-    }
-    else if(strncmp(timer, "001", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3324_units::MIN_1;
-    }
-    else if(strncmp(timer, "000", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3324_units::SEC_2;
-    }
-    else if(strncmp(timer, "111", 3) == 0)
-    {
-        unit = TP_NBIoT_Interface::T3324_units::DEACT;
-    }
-    else
-    {
-        unit = TP_NBIoT_Interface::T3324_units::INVALID;
-    }
-
-    uint8_t binary_value = 16;
-    for(int i = 3; i < 8; i++)
-    {
-        if((int)timer[i] == 49) // 1
-        {
-            multiples = multiples + binary_value;
-        }
-        
-        if(binary_value == 1)
-        {
-            break;
-        }
-
-        binary_value = binary_value / 2;
-    }
-    
-    return TP_NBIoT_Interface::NBIOT_OK;
-}
+	TP_NBIOT_SCRATCH(TP_Timer_String, data, timer[1]);
+	timer_octet_to_string(octet, data);
 
-/** Convert decimal number (with max value of 5-bits) to a binary string,
- *  i.e. 10 = "01010"
- * 
- * @param multiples Decimal value to convert to binary
- * @param *binary Pointer to a char array to which to return 
- *                the binary string
- * @return None
- */
-void TP_NBIoT_Interface::dec_to_bin_5_bit(uint8_t multiples, char *binary)
-{
-    int buffer[8];
-    int i = 0;
+	int status = -1;
+	TP_NBIOT_TRACE(TP_Perf_Operation::SET_ACTIVE_TIME, status);
 
-    for(i; multiples > 0; i++)
-    {
-        buffer[i] = multiples % 2;
-        multiples = multiples / 2;
-    }
+	if(_driver == TP_NBIoT_Interface::SARAN2)
+	{
+		status = _modem.set_t3324_timer(data);
+		if(status != TP_NBIoT_Interface::NBIOT_OK)
+		{
+			return status;
+		}
 
-    int padding = 5 - i;
+		/** Keep the batch deadline in step with the timer now in use
+		 */
+		_t3324_s = active_time_seconds(octet);
 
-    for(int j = 0; j < padding; j++)
-    {
-        sprintf(&binary[j], "%d", 0);
-    }
+		TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::NBIOT_OK);
+	}
 
-    int index = 4 - padding;
-    for(padding; padding < 5; padding++)
-    {
-        sprintf(&binary[padding], "%d", buffer[index]);
-        index--;
-    }
+    TP_NBIOT_TRACE_RETURN(status, TP_NBIoT_Interface::DRIVER_UNKNOWN);
 }
 
 #endif /* #if BOARD == WRIGHT_V1_0_0 || BOARD == DEVELOPMENT_BOARD_V1_1_0 */
@@ -1,6 +1,6 @@
 /**
   * @file    tp_nbiot_interface.h
-  * @version 0.4.0
+  * @version 0.5.0
   * @author  Adam Mitchell
   * @brief   Header file of the Thingpilot NB-IoT interface. This interface is hardware agnostic
   *          and depends on the underlying modem drivers exposing an identical interface
@@ -13,6 +13,9 @@
 /** Includes 
  */
 #include <mbed.h>
+#include <chrono>
+#include "tp_coap_message.h"
+#include "tp_payload_encoder.h"
 
 /** NB-IoT #defines 
  */
@@ -21,6 +24,368 @@
 #define EARFCN_B20_LOW  6150
 #define EARFCN_B20_HIGH 6449
 
+/** Driver capability #defines. The baseline SaraN2 driver provides only 
+ *  the calls made by the core interface; set each of these to 1 when the
+ *  driver in the build also provides the AT commands a feature depends 
+ *  on. TP_NBIOT_DRIVER_NCONFIG reads the UE configuration back with 
+ *  nconfig() so that start() only writes settings that differ; without it
+ *  only settings written since construction or resume() are known, so the
+ *  first start() after an MCU reset writes every setting it needs and 
+ *  reboots. TP_NBIOT_DRIVER_NUESTATS adds the typed
+ *  get_nuestats() queries, needing the nuestats() call that takes a 
+ *  category and a line callback; without it the EARFCN is read with the
+ *  baseline nuestats() and the coverage gate and adaptive PSM controller
+ *  have no signal measurements to act on. TP_NBIOT_DRIVER_COAP_BUFFERS 
+ *  adds the length-aware and streaming coap_get/delete/put/post() 
+ *  overloads, needing driver overloads of the same form. 
+ *  TP_NBIOT_DRIVER_URCS tracks connection state from +CSCON, +CEREG and 
+ *  +NPSMR, needing sigio(), oob(), recv(), process_oob(), set_cscon(), 
+ *  set_cereg() and set_npsmr(); without it the state is polled. 
+ *  TP_NBIOT_DRIVER_SOCKETS adds the UDP socket API and downlink delivery,
+ *  needing nsocr(), nsost(), nsostf(), nsorf() and nsocl() as well as 
+ *  URCs. TP_NBIOT_DRIVER_LINK_SPEED adds set_link_speed(), needing 
+ *  set_uart_speed(), set_flow_control(), set_serial_baud() and 
+ *  set_serial_flow_control(); without it the link stays at the rate the
+ *  interface was constructed with. TP_NBIOT_DRIVER_AT_STATISTICS counts
+ *  AT commands and UART bytes in performance traces, needing 
+ *  get_at_statistics()
+ */
+#ifndef TP_NBIOT_DRIVER_NCONFIG
+	#define TP_NBIOT_DRIVER_NCONFIG 0
+#endif /* #ifndef TP_NBIOT_DRIVER_NCONFIG */
+
+#ifndef TP_NBIOT_DRIVER_NUESTATS
+	#define TP_NBIOT_DRIVER_NUESTATS 0
+#endif /* #ifndef TP_NBIOT_DRIVER_NUESTATS */
+
+#ifndef TP_NBIOT_DRIVER_COAP_BUFFERS
+	#define TP_NBIOT_DRIVER_COAP_BUFFERS 0
+#endif /* #ifndef TP_NBIOT_DRIVER_COAP_BUFFERS */
+
+#ifndef TP_NBIOT_DRIVER_URCS
+	#define TP_NBIOT_DRIVER_URCS 0
+#endif /* #ifndef TP_NBIOT_DRIVER_URCS */
+
+#ifndef TP_NBIOT_DRIVER_SOCKETS
+	#define TP_NBIOT_DRIVER_SOCKETS 0
+#endif /* #ifndef TP_NBIOT_DRIVER_SOCKETS */
+
+#ifndef TP_NBIOT_DRIVER_LINK_SPEED
+	#define TP_NBIOT_DRIVER_LINK_SPEED 0
+#endif /* #ifndef TP_NBIOT_DRIVER_LINK_SPEED */
+
+#ifndef TP_NBIOT_DRIVER_AT_STATISTICS
+	#define TP_NBIOT_DRIVER_AT_STATISTICS 0
+#endif /* #ifndef TP_NBIOT_DRIVER_AT_STATISTICS */
+
+#if TP_NBIOT_DRIVER_SOCKETS && !TP_NBIOT_DRIVER_URCS
+	#error "TP_NBIOT_DRIVER_SOCKETS needs TP_NBIOT_DRIVER_URCS for +NSONMI"
+#endif /* #if TP_NBIOT_DRIVER_SOCKETS && !TP_NBIOT_DRIVER_URCS */
+
+/** Memory #defines. Set TP_NBIOT_STATIC_MEMORY to 1 to hold the transient
+ *  buffers of long call chains, i.e. NUESTATS results, timer strings and AT
+ *  batches, in the interface rather than on the caller's stack, so that RAM
+ *  use is fixed at link time. TP_NBIOT_MAX_PAYLOAD, if defined, sizes the 
+ *  uplink batch and downlink buffers. A non-zero TP_NBIOT_RAM_BUDGET fails
+ *  the build if the interface is larger, in bytes, and TP_NBIOT_RAM_REPORT
+ *  set to 1 keeps TP_NBIoT_Interface::ram_footprint() in the image as the
+ *  const symbol tp_nbiot_ram_report, to be read from the map file or with
+ *  e.g. arm-none-eabi-gdb -batch -ex "p tp_nbiot_ram_report" firmware.elf
+ */
+#ifndef TP_NBIOT_STATIC_MEMORY
+	#define TP_NBIOT_STATIC_MEMORY 0
+#endif /* #ifndef TP_NBIOT_STATIC_MEMORY */
+
+#ifndef TP_NBIOT_RAM_BUDGET
+	#define TP_NBIOT_RAM_BUDGET 0
+#endif /* #ifndef TP_NBIOT_RAM_BUDGET */
+
+#ifndef TP_NBIOT_RAM_REPORT
+	#define TP_NBIOT_RAM_REPORT 0
+#endif /* #ifndef TP_NBIOT_RAM_REPORT */
+
+#if TP_NBIOT_STATIC_MEMORY
+	#define TP_NBIOT_SCRATCH(type, name, member) type &name = _scratch.member
+#else
+	#define TP_NBIOT_SCRATCH(type, name, member) type name
+#endif /* #if TP_NBIOT_STATIC_MEMORY */
+
+/** Asynchronous request #defines. Set TP_NBIOT_ASYNC to 1 to add the modem
+ *  worker thread, its stack and request queue to the build, as needed by 
+ *  the coap_*_async() calls, set_downlink_callback() and TP_NBIoT_Gateway.
+ *  A non-zero TP_NBIOT_ASYNC_PAYLOAD_SIZE gives each of the 
+ *  TP_NBIOT_ASYNC_QUEUE_DEPTH requests its own copy of a PUT or POST 
+ *  payload of up to that many bytes, so the queue is sized with the rest
+ *  of the interface. It follows TP_NBIOT_MAX_PAYLOAD if defined and is 
+ *  0, i.e. the caller's buffer is queued, otherwise
+ */
+#ifndef TP_NBIOT_ASYNC
+	#define TP_NBIOT_ASYNC 0
+#endif /* #ifndef TP_NBIOT_ASYNC */
+
+#ifndef TP_NBIOT_ASYNC_QUEUE_DEPTH
+	#define TP_NBIOT_ASYNC_QUEUE_DEPTH 4
+#endif /* #ifndef TP_NBIOT_ASYNC_QUEUE_DEPTH */
+
+#ifndef TP_NBIOT_ASYNC_PAYLOAD_SIZE
+	#if defined(TP_NBIOT_MAX_PAYLOAD)
+		#define TP_NBIOT_ASYNC_PAYLOAD_SIZE TP_NBIOT_MAX_PAYLOAD
+	#else
+		#define TP_NBIOT_ASYNC_PAYLOAD_SIZE 0
+	#endif /* #if defined(TP_NBIOT_MAX_PAYLOAD) */
+#endif /* #ifndef TP_NBIOT_ASYNC_PAYLOAD_SIZE */
+
+#ifndef TP_NBIOT_WORKER_STACK_SIZE
+	#define TP_NBIOT_WORKER_STACK_SIZE 2048
+#endif /* #ifndef TP_NBIOT_WORKER_STACK_SIZE */
+
+/** Downlink #defines. Datagrams received on open sockets are read by the
+ *  worker thread into a pool of TP_NBIOT_DOWNLINK_POOL_DEPTH buffers of
+ *  TP_NBIOT_DOWNLINK_MAX_SIZE bytes before being delivered. The worker is
+ *  woken to look for +NSONMI once the UART has been quiet for 
+ *  TP_NBIOT_DOWNLINK_SETTLE_MS. Built with TP_NBIOT_ASYNC and 
+ *  TP_NBIOT_DRIVER_SOCKETS set
+ */
+#ifndef TP_NBIOT_DOWNLINK_POOL_DEPTH
+	#define TP_NBIOT_DOWNLINK_POOL_DEPTH 2
+#endif /* #ifndef TP_NBIOT_DOWNLINK_POOL_DEPTH */
+
+#ifndef TP_NBIOT_DOWNLINK_SETTLE_MS
+	#define TP_NBIOT_DOWNLINK_SETTLE_MS 50
+#endif /* #ifndef TP_NBIOT_DOWNLINK_SETTLE_MS */
+
+#ifndef TP_NBIOT_DOWNLINK_MAX_SIZE
+	#if defined(TP_NBIOT_MAX_PAYLOAD)
+		#define TP_NBIOT_DOWNLINK_MAX_SIZE TP_NBIOT_MAX_PAYLOAD
+	#else
+		#define TP_NBIOT_DOWNLINK_MAX_SIZE 256
+	#endif /* #if defined(TP_NBIOT_MAX_PAYLOAD) */
+#endif /* #ifndef TP_NBIOT_DOWNLINK_MAX_SIZE */
+
+/** Uplink batching #defines. Set TP_NBIOT_BATCHING to 1 to build the
+ *  batching stage and its buffer of TP_NBIOT_BATCH_BUFFER_SIZE bytes. 
+ *  TP_NBIOT_BATCH_GUARD_MS is how long before the end of the T3324 active
+ *  window a batch is flushed
+ */
+#ifndef TP_NBIOT_BATCHING
+	#define TP_NBIOT_BATCHING 0
+#endif /* #ifndef TP_NBIOT_BATCHING */
+
+#ifndef TP_NBIOT_BATCH_BUFFER_SIZE
+	#if defined(TP_NBIOT_MAX_PAYLOAD)
+		#define TP_NBIOT_BATCH_BUFFER_SIZE TP_NBIOT_MAX_PAYLOAD
+	#else
+		#define TP_NBIOT_BATCH_BUFFER_SIZE 512
+	#endif /* #if defined(TP_NBIOT_MAX_PAYLOAD) */
+#endif /* #ifndef TP_NBIOT_BATCH_BUFFER_SIZE */
+
+#ifndef TP_NBIOT_BATCH_GUARD_MS
+	#define TP_NBIOT_BATCH_GUARD_MS 2000
+#endif /* #ifndef TP_NBIOT_BATCH_GUARD_MS */
+
+/** Adaptive PSM #defines. Costs are expressed as the energy of one second 
+ *  awake in idle mode in good coverage. TP_NBIOT_PSM_WAKE_COST_S is the cost 
+ *  of waking from PSM to send, TP_NBIOT_PSM_RENEGOTIATE_COST_S that of 
+ *  reprogramming the timers and TP_NBIOT_PSM_HORIZON_S the period over 
+ *  which a saving must outweigh it. Uplinks closer together than 
+ *  TP_NBIOT_PSM_BURST_MS are counted as one
+ */
+#ifndef TP_NBIOT_PSM_WAKE_COST_S
+	#define TP_NBIOT_PSM_WAKE_COST_S 20
+#endif /* #ifndef TP_NBIOT_PSM_WAKE_COST_S */
+
+#ifndef TP_NBIOT_PSM_RENEGOTIATE_COST_S
+	#define TP_NBIOT_PSM_RENEGOTIATE_COST_S 60
+#endif /* #ifndef TP_NBIOT_PSM_RENEGOTIATE_COST_S */
+
+#ifndef TP_NBIOT_PSM_HORIZON_S
+	#define TP_NBIOT_PSM_HORIZON_S 86400
+#endif /* #ifndef TP_NBIOT_PSM_HORIZON_S */
+
+#ifndef TP_NBIOT_PSM_MIN_SAMPLES
+	#define TP_NBIOT_PSM_MIN_SAMPLES 4
+#endif /* #ifndef TP_NBIOT_PSM_MIN_SAMPLES */
+
+#ifndef TP_NBIOT_PSM_BURST_MS
+	#define TP_NBIOT_PSM_BURST_MS 1000
+#endif /* #ifndef TP_NBIOT_PSM_BURST_MS */
+
+/** Signal power, in dBm, and SNR, in dB, below which a second awake is 
+ *  weighted as in coverage enhancement level 1 and 2, i.e. twice and 
+ *  four times the cost of good coverage
+ */
+#ifndef TP_NBIOT_PSM_RSRP_CE0_DBM
+	#define TP_NBIOT_PSM_RSRP_CE0_DBM -105
+#endif /* #ifndef TP_NBIOT_PSM_RSRP_CE0_DBM */
+
+#ifndef TP_NBIOT_PSM_RSRP_CE1_DBM
+	#define TP_NBIOT_PSM_RSRP_CE1_DBM -115
+#endif /* #ifndef TP_NBIOT_PSM_RSRP_CE1_DBM */
+
+#ifndef TP_NBIOT_PSM_SNR_CE0_DB
+	#define TP_NBIOT_PSM_SNR_CE0_DB 0
+#endif /* #ifndef TP_NBIOT_PSM_SNR_CE0_DB */
+
+#ifndef TP_NBIOT_PSM_SNR_CE1_DB
+	#define TP_NBIOT_PSM_SNR_CE1_DB -5
+#endif /* #ifndef TP_NBIOT_PSM_SNR_CE1_DB */
+
+/** CoAP endpoint cache #defines. TP_NBIOT_COAP_PROFILES is the number of
+ *  CoAP profiles the module can save, each holding one endpoint
+ */
+#ifndef TP_NBIOT_COAP_PROFILES
+	#define TP_NBIOT_COAP_PROFILES 4
+#endif /* #ifndef TP_NBIOT_COAP_PROFILES */
+
+/** Longest URI held by the endpoint cache, i.e. accepted by 
+ *  configure_coap() and register_endpoint()
+ */
+#ifndef TP_NBIOT_COAP_URI_MAX_LENGTH
+	#define TP_NBIOT_COAP_URI_MAX_LENGTH 200
+#endif /* #ifndef TP_NBIOT_COAP_URI_MAX_LENGTH */
+
+/** UDP socket #defines. TP_NBIOT_MAX_SOCKETS is the number of sockets the
+ *  module can have open at once
+ */
+#ifndef TP_NBIOT_MAX_SOCKETS
+	#define TP_NBIOT_MAX_SOCKETS 7
+#endif /* #ifndef TP_NBIOT_MAX_SOCKETS */
+
+/** Connection recovery #defines. Each recovery step waits up to
+ *  TP_NBIOT_RECOVERY_STEP_TIMEOUT_S for registration, failed steps being
+ *  followed by a jittered backoff doubling from TP_NBIOT_RECOVERY_BACKOFF_MS
+ *  to TP_NBIOT_RECOVERY_MAX_BACKOFF_MS. History is kept for the last
+ *  TP_NBIOT_RECOVERY_CELLS cells, which needs TP_NBIOT_DRIVER_NUESTATS to
+ *  learn the serving cell. Without it a single history entry is kept
+ */
+#ifndef TP_NBIOT_RECOVERY_STEP_TIMEOUT_S
+	#define TP_NBIOT_RECOVERY_STEP_TIMEOUT_S 60
+#endif /* #ifndef TP_NBIOT_RECOVERY_STEP_TIMEOUT_S */
+
+#ifndef TP_NBIOT_RECOVERY_BACKOFF_MS
+	#define TP_NBIOT_RECOVERY_BACKOFF_MS 2000
+#endif /* #ifndef TP_NBIOT_RECOVERY_BACKOFF_MS */
+
+#ifndef TP_NBIOT_RECOVERY_MAX_BACKOFF_MS
+	#define TP_NBIOT_RECOVERY_MAX_BACKOFF_MS 300000
+#endif /* #ifndef TP_NBIOT_RECOVERY_MAX_BACKOFF_MS */
+
+#ifndef TP_NBIOT_RECOVERY_CELLS
+	#if TP_NBIOT_DRIVER_NUESTATS
+		#define TP_NBIOT_RECOVERY_CELLS 4
+	#else
+		#define TP_NBIOT_RECOVERY_CELLS 1
+	#endif /* #if TP_NBIOT_DRIVER_NUESTATS */
+#endif /* #ifndef TP_NBIOT_RECOVERY_CELLS */
+
+/** NUESTATS #defines. TP_NBIOT_NUESTATS_MAX_CELLS is how many cells are kept
+ *  from a CELL query and TP_NBIOT_BAND_MAX_AGE_MS the age of the cached EARFCN
+ *  that get_band() will accept
+ */
+#ifndef TP_NBIOT_NUESTATS_MAX_CELLS
+	#define TP_NBIOT_NUESTATS_MAX_CELLS 4
+#endif /* #ifndef TP_NBIOT_NUESTATS_MAX_CELLS */
+
+#ifndef TP_NBIOT_BAND_MAX_AGE_MS
+	#define TP_NBIOT_BAND_MAX_AGE_MS 60000
+#endif /* #ifndef TP_NBIOT_BAND_MAX_AGE_MS */
+
+/** Coverage gate #defines. Radio conditions are measured again once the
+ *  last measurement is older than TP_NBIOT_COVERAGE_RECHECK_MS if there are
+ *  no URCs to report a change of cell, or while traffic is being held
+ */
+#ifndef TP_NBIOT_COVERAGE_RECHECK_MS
+	#define TP_NBIOT_COVERAGE_RECHECK_MS 60000
+#endif /* #ifndef TP_NBIOT_COVERAGE_RECHECK_MS */
+
+/** AT batch #defines. Multi-step sequences, i.e. writing a CoAP profile, are
+ *  run as batches of at most TP_NBIOT_AT_BATCH_MAX commands, at least 7. Set 
+ *  TP_NBIOT_AT_PIPELINE to 1 to write the commands of a batch back to back
+ *  and match their responses in order afterwards, rather than waiting for 
+ *  each response in turn. Requires a driver providing begin_pipeline() and
+ *  end_pipeline(), which the SaraN2 driver does not yet, so by default 
+ *  batches only add the first-error report and take as long as before
+ */
+#ifndef TP_NBIOT_AT_BATCH_MAX
+	#define TP_NBIOT_AT_BATCH_MAX 8
+#endif /* #ifndef TP_NBIOT_AT_BATCH_MAX */
+
+#ifndef TP_NBIOT_AT_PIPELINE
+	#define TP_NBIOT_AT_PIPELINE 0
+#endif /* #ifndef TP_NBIOT_AT_PIPELINE */
+
+/** Link speed #defines. After AT+NATSPEED the module falls back to the 
+ *  previous rate unless it receives an AT command at the new rate within
+ *  TP_NBIOT_LINK_FALLBACK_S, 3 to 30 seconds. The new rate is verified 
+ *  with up to TP_NBIOT_LINK_VERIFY_ATTEMPTS AT commands
+ */
+#ifndef TP_NBIOT_LINK_FALLBACK_S
+	#define TP_NBIOT_LINK_FALLBACK_S 3
+#endif /* #ifndef TP_NBIOT_LINK_FALLBACK_S */
+
+#ifndef TP_NBIOT_LINK_VERIFY_ATTEMPTS
+	#define TP_NBIOT_LINK_VERIFY_ATTEMPTS 3
+#endif /* #ifndef TP_NBIOT_LINK_VERIFY_ATTEMPTS */
+
+/** Performance tracing #defines. Set TP_NBIOT_PERF_TRACE to 1 to record the
+ *  duration, AT command count, UART traffic and result of each modem 
+ *  operation into a ring of TP_NBIOT_PERF_RECORDS records. AT command and
+ *  UART byte counts are read from the driver, with 
+ *  TP_NBIOT_DRIVER_AT_STATISTICS set, and are 0 otherwise
+ */
+#ifndef TP_NBIOT_PERF_TRACE
+	#define TP_NBIOT_PERF_TRACE 0
+#endif /* #ifndef TP_NBIOT_PERF_TRACE */
+
+#ifndef TP_NBIOT_PERF_RECORDS
+	#define TP_NBIOT_PERF_RECORDS 16
+#endif /* #ifndef TP_NBIOT_PERF_RECORDS */
+
+/** A traced call records the value of result when it returns, so every
+ *  return other than of result itself goes through TP_NBIOT_TRACE_RETURN
+ */
+#if TP_NBIOT_PERF_TRACE
+	#define TP_NBIOT_TRACE(operation, result) TP_Perf_Scope perf_scope(*this, operation, result)
+	#define TP_NBIOT_TRACE_RETURN(result, value) return (result = (value))
+#else
+	#define TP_NBIOT_TRACE(operation, result)
+	#define TP_NBIOT_TRACE_RETURN(result, value) return (value)
+#endif /* #if TP_NBIOT_PERF_TRACE */
+
+/** Thread safety #defines. With TP_NBIOT_THREAD_SAFE set, every public call
+ *  that talks to the module holds a recursive mutex for its duration, so calls
+ *  from different RTOS threads, including the async worker, never interleave
+ *  AT commands. Set to 0 when the interface is only ever used from one thread,
+ *  which rules out TP_NBIOT_ASYNC as the worker is a second thread
+ */
+#ifndef TP_NBIOT_THREAD_SAFE
+	#define TP_NBIOT_THREAD_SAFE 1
+#endif /* #ifndef TP_NBIOT_THREAD_SAFE */
+
+#if TP_NBIOT_THREAD_SAFE
+	#define TP_NBIOT_LOCK() ScopedLock<Mutex> tp_nbiot_lock(_mutex)
+#else
+	#define TP_NBIOT_LOCK()
+#endif /* #if TP_NBIOT_THREAD_SAFE */
+
+#if TP_NBIOT_ASYNC && !TP_NBIOT_THREAD_SAFE
+	#error "TP_NBIOT_ASYNC needs TP_NBIOT_THREAD_SAFE to serialise the worker with other callers"
+#endif /* #if TP_NBIOT_ASYNC && !TP_NBIOT_THREAD_SAFE */
+
+/** Statistics #defines. Set TP_NBIOT_STATS to 1 to keep fixed-size, long
+ *  running counters of attaches, reboots, CoAP responses, traffic, time in
+ *  each connection status and NUESTATS distributions, see get_stats() and
+ *  get_stats_summary()
+ */
+#ifndef TP_NBIOT_STATS
+	#define TP_NBIOT_STATS 0
+#endif /* #ifndef TP_NBIOT_STATS */
+
+#if TP_NBIOT_STATS
+	#define TP_NBIOT_STAT(statement) statement
+#else
+	#define TP_NBIOT_STAT(statement)
+#endif /* #if TP_NBIOT_STATS */
 
 #if BOARD == WRIGHT_V1_0_0 || BOARD == DEVELOPMENT_BOARD_V1_1_0
 	#include "SaraN2Driver.h"
@@ -49,7 +414,24 @@ class TP_NBIoT_Interface
 			DRIVER_UNKNOWN     = 60,
 			EXCEEDS_MAX_VALUE  = 61,
 			INVALID_UNIT_VALUE = 62,
-			FAIL_TO_CONNECT    = 63
+			FAIL_TO_CONNECT    = 63,
+			INVALID_BLOCK_SIZE = 64,
+			QUEUE_FULL         = 65,
+			BATCH_NOT_READY    = 66,
+			INVALID_RESPONSE   = 67,
+			BUFFER_TOO_SMALL   = 68,
+			NO_FREE_ENDPOINT   = 69,
+			INVALID_ENDPOINT   = 70,
+			INVALID_SOCKET     = 71,
+			NO_DATA            = 72,
+			NOT_RELEASED       = 73,
+			INVALID_CONTEXT    = 74,
+			QUERY_DEFERRED     = 75,
+			COVERAGE_DEFERRED  = 76,
+			LINK_FALLBACK      = 77,
+			ENDPOINT_IN_USE    = 78,
+			NOT_SUPPORTED      = 79,
+			COAP_REJECTED      = 80
 		};
 
 		/** LTE Bands
@@ -77,6 +459,220 @@ class TP_NBIoT_Interface
 			STATE_UNDEFINED                  = 7
 		};
 
+		/** How a status query is served while the module is in PSM, as known
+		 *  from URCs. A DEFERRED query is answered from state read from the 
+		 *  module since it was reset, or else returns QUERY_DEFERRED and is
+		 *  queued to run at the module's next natural wakeup,
+		 *  i.e. an uplink or the end of PSM, so as not to wake it. An URGENT 
+		 *  query always goes to the module
+		 */
+		enum class TP_Query_Mode
+		{
+			DEFERRED = 0,
+			URGENT   = 1
+		};
+
+		/** Connection recovery steps, in order of increasing cost
+		 */
+		enum class TP_Recovery_Step
+		{
+			WAIT_URC     = 0, // Wait for the module to re-register of its own accord
+			RADIO_TOGGLE = 1, // AT+CFUN=0 then AT+CFUN=1
+			REATTACH     = 2, // AT+CGATT=0 then AT+CGATT=1
+			REBOOT       = 3  // Reboot the module
+		};
+
+		/** Recovery history of one cell. step is the step that last 
+		 *  recovered the connection, the next recovery in this cell begins
+		 *  one step cheaper. sequence orders entries by last use
+		 */
+		struct TP_Recovery_Cell
+		{
+			uint32_t cell_id;
+			uint32_t sequence;
+			uint16_t recoveries;
+			uint16_t failures;
+			uint8_t step;
+			bool valid;
+		};
+
+		/** IP address, port and URI held by a CoAP profile. The URI is not
+		 *  terminated
+		 */
+		struct TP_CoAP_Endpoint
+		{
+			char ipv4[16];
+			uint16_t port;
+			uint8_t uri_length;
+			char uri[TP_NBIOT_COAP_URI_MAX_LENGTH];
+		};
+
+		/** Attach state saved by save_attach_context() and handed back to 
+		 *  resume() after an MCU reset, i.e. from retained RAM or flash. 
+		 *  checksum guards against a context that was never written or has
+		 *  been corrupted; the other fields should be treated as opaque
+		 */
+		struct TP_Attach_Context
+		{
+			uint32_t magic;
+			TP_Connection_Status status;
+			int32_t earfcn;
+			uint32_t t3412_s;
+			uint32_t t3324_s;
+			uint32_t coap_endpoint_hashes[TP_NBIOT_COAP_PROFILES];
+			uint8_t coap_endpoints_used;
+			uint8_t coap_endpoints_registered;
+			int8_t coap_selected_profile;
+			uint8_t ue_config;
+			uint8_t ue_config_known;
+			bool earfcn_valid;
+			uint32_t link_baud;
+			uint32_t link_boot_baud;
+			uint8_t link_flow_control;
+			uint8_t sockets_open;
+			uint32_t checksum;
+		};
+
+		/** Release assistance indication sent with a datagram, the values 
+		 *  being AT+NSOSTF flags. RELEASE tells the network that no further
+		 *  uplink or downlink data is expected, RELEASE_AFTER_REPLY that only
+		 *  a single downlink, i.e. a CoAP ACK, is expected
+		 */
+		enum class TP_Release_Assistance
+		{
+			NONE                = 0x000,
+			RELEASE             = 0x200,
+			RELEASE_AFTER_REPLY = 0x400
+		};
+
+		/** Last known connection state of the module, kept up to date from
+		 *  URCs and the results of status queries. timestamp_ms records when
+		 *  status, connected, registered and psm were last confirmed and 
+		 *  radio_timestamp_ms when rsrp and rsrq were and earfcn_timestamp_ms
+		 *  when earfcn was, all in Kernel::get_ms_count() time
+		 */
+		struct TP_Connection_Snapshot
+		{
+			TP_Connection_Status status;
+			int connected;
+			int registered;
+			int psm;
+			int rsrp;
+			int rsrq;
+			int earfcn;
+			uint64_t timestamp_ms;
+			uint64_t radio_timestamp_ms;
+			uint64_t earfcn_timestamp_ms;
+			bool valid;
+			bool radio_valid;
+			bool earfcn_valid;
+		};
+
+		/** NUESTATS categories that may be queried individually
+		 */
+		enum class TP_Nuestats_Type
+		{
+			RADIO   = 0,
+			CELL    = 1,
+			BLER    = 2,
+			THP     = 3,
+			APPSMEM = 4
+		};
+
+		/** AT+NUESTATS="RADIO" values. Powers are in tenths of a dBm, snr
+		 *  in tenths of a dB, rsrq in tenths of a dB and tx_time and rx_time
+		 *  in milliseconds since the last reboot
+		 */
+		struct TP_Nuestats_Radio
+		{
+			int32_t signal_power;
+			int32_t total_power;
+			int32_t tx_power;
+			uint32_t tx_time;
+			uint32_t rx_time;
+			uint32_t cell_id;
+			int32_t ecl;
+			int32_t snr;
+			int32_t earfcn;
+			int32_t pci;
+			int32_t rsrq;
+		};
+
+		/** One cell of AT+NUESTATS="CELL", primary being 1 for the serving
+		 *  cell. Units are as TP_Nuestats_Radio
+		 */
+		struct TP_Nuestats_Cell_Entry
+		{
+			int earfcn;
+			int pci;
+			int primary;
+			int rsrp;
+			int rsrq;
+			int rssi;
+			int snr;
+		};
+
+		/** AT+NUESTATS="CELL" values, the first count entries of cells 
+		 *  being valid
+		 */
+		struct TP_Nuestats_Cell
+		{
+			TP_Nuestats_Cell_Entry cells[TP_NBIOT_NUESTATS_MAX_CELLS];
+			size_t count;
+		};
+
+		/** AT+NUESTATS="BLER" values. Block error rates are as reported by
+		 *  the module, the remainder are totals since the last reboot
+		 */
+		struct TP_Nuestats_BLER
+		{
+			uint32_t rlc_ul_bler;
+			uint32_t rlc_dl_bler;
+			uint32_t mac_ul_bler;
+			uint32_t mac_dl_bler;
+			uint32_t total_tx_bytes;
+			uint32_t total_rx_bytes;
+			uint32_t total_tx_blocks;
+			uint32_t total_rx_blocks;
+			uint32_t total_rtx_blocks;
+			uint32_t total_ack_nack_rx;
+		};
+
+		/** AT+NUESTATS="THP" throughput values in bits per second
+		 */
+		struct TP_Nuestats_THP
+		{
+			uint32_t rlc_ul;
+			uint32_t rlc_dl;
+			uint32_t mac_ul;
+			uint32_t mac_dl;
+		};
+
+		/** AT+NUESTATS="APPSMEM" application core heap values in bytes
+		 */
+		struct TP_Nuestats_APPSMEM
+		{
+			uint32_t current_allocated;
+			uint32_t total_free;
+			uint32_t max_free;
+			uint32_t num_allocs;
+			uint32_t num_frees;
+		};
+
+		/** AT+NCONFIG settings of the module, see the corresponding enable_*
+		 *  and disable_* methods for a description of each
+		 */
+		struct TP_UE_Config
+		{
+			bool autoconnect      : 1;
+			bool scrambling       : 1;
+			bool si_avoid         : 1;
+			bool combine_attach   : 1;
+			bool cell_reselection : 1;
+			bool bip              : 1;
+			bool sim_psm          : 1;
+		};
+
 		/** List of possible T3412 timer units
 		 */
 		enum class T3412_units
@@ -103,6 +699,345 @@ class TP_NBIoT_Interface
             INVALID = 4
 		};
 
+		/** Limits within which the adaptive PSM controller may set 
+		 *  T3324 and T3412, in seconds
+		 */
+		struct TP_Adaptive_PSM_Config
+		{
+			uint32_t min_active_s;
+			uint32_t max_active_s;
+			uint32_t min_tau_s;
+			uint32_t max_tau_s;
+		};
+
+		/** Radio conditions below which the coverage gate holds traffic. 
+		 *  min_rsrp_dbm is compared with the NUESTATS signal power and max_ecl
+		 *  with the coverage enhancement level, 0 to 2. Traffic is never held
+		 *  for longer than max_deferral_s
+		 */
+		struct TP_Coverage_Gate_Config
+		{
+			int16_t min_rsrp_dbm;
+			uint8_t max_ecl;
+			uint32_t max_deferral_s;
+		};
+
+		/** Traffic priority classes. CRITICAL traffic, i.e. alarms, is never
+		 *  held by the coverage gate
+		 */
+		enum class TP_Traffic_Priority
+		{
+			NORMAL   = 0,
+			CRITICAL = 1
+		};
+
+		/** UART flow control between MCU and module. Only the module's CTS 
+		 *  line is connected, so CTS lets the module hold off the MCU while
+		 *  the MCU relies on its receive buffer
+		 */
+		enum class TP_Flow_Control
+		{
+			NONE = 0,
+			CTS  = 1
+		};
+
+		/** Commands that may be run as part of an AT batch
+		 */
+		enum class TP_AT_Command
+		{
+			SELECT_PROFILE       = 0,
+			SET_COAP_IP_PORT     = 1,
+			SET_COAP_URI         = 2,
+			ADD_URI_PATH         = 3,
+			SET_PROFILE_VALIDITY = 4,
+			SAVE_PROFILE         = 5,
+			CONFIGURE_UE         = 6,
+			SET_CSCON            = 7,
+			SET_CEREG            = 8,
+			SET_NPSMR            = 9,
+			SET_T3412_TIMER      = 10,
+			SET_T3324_TIMER      = 11
+		};
+
+		/** Outcome of the last AT batch. completed commands succeeded, in 
+		 *  order. If status is not NBIOT_OK, command at index completed is 
+		 *  the first to fail and is identified by failed_command. When 
+		 *  pipelined, commands after it have been sent but their outcome
+		 *  is unknown
+		 */
+		struct TP_AT_Batch_Report
+		{
+			uint8_t commands;
+			uint8_t completed;
+			TP_AT_Command failed_command;
+			int status;
+			bool pipelined;
+			uint32_t duration_ms;
+		};
+
+		/** RAM held by an interface, in bytes. interface is its size, which
+		 *  includes the fields that follow it. endpoints is the CoAP profile
+		 *  table, TP_NBIOT_COAP_PROFILES entries, and async_pool the 
+		 *  TP_NBIOT_ASYNC_QUEUE_DEPTH queued requests including their 
+		 *  payload copies. scratch is the buffers held in place of stack 
+		 *  with TP_NBIOT_STATIC_MEMORY, 0 without. worker_stack_peak is the 
+		 *  most of the worker stack used so far, 0 unless the RTOS keeps 
+		 *  stack watermarks. The driver's parser and serial buffers, 
+		 *  allocated by the driver itself, are not counted
+		 */
+		struct TP_RAM_Footprint
+		{
+			size_t interface;
+			size_t driver;
+			size_t endpoints;
+			size_t batch_buffer;
+			size_t worker_stack;
+			size_t async_pool;
+			size_t downlink_pool;
+			size_t perf_trace;
+			size_t stats;
+			size_t scratch;
+			size_t worker_stack_peak;
+		};
+
+		/** CoAP Block1 sizes, enumerated by their SZX value as defined 
+		 *  in RFC 7959. Block size in bytes is 2^(SZX + 4)
+		 */
+		enum class TP_CoAP_Block_Size
+		{
+			BLOCK_16   = 0,
+			BLOCK_32   = 1,
+			BLOCK_64   = 2,
+			BLOCK_128  = 3,
+			BLOCK_256  = 4,
+			BLOCK_512  = 5,
+			BLOCK_1024 = 6
+		};
+
+		/** Maximum number of blocks in a single streamed upload, limited 
+		 *  by the block number accepted by the driver
+		 */
+		static const uint16_t MAX_COAP_STREAM_BLOCKS = 256;
+
+		/** Block1 size of the module. The driver has no way of passing an 
+		 *  SZX, so the module numbers blocks by this size and streamed 
+		 *  uploads always use it
+		 */
+		static const TP_CoAP_Block_Size MODULE_BLOCK_SIZE = TP_CoAP_Block_Size::BLOCK_512;
+
+		/** Element of a chain of caller-owned buffers to be uploaded by 
+		 *  coap_post_stream(). Every element except the last must hold 
+		 *  a multiple of MODULE_BLOCK_SIZE
+		 */
+		struct TP_CoAP_Buffer
+		{
+			uint8_t *data;
+			size_t length;
+			TP_CoAP_Buffer *next;
+		};
+
+		/** Statistics of a single block sent by coap_post_stream()
+		 */
+		struct TP_CoAP_Block_Stats
+		{
+			uint16_t block_number;
+			uint16_t length;
+			int response_code;
+			uint32_t duration_ms;
+		};
+
+		/** Aggregated statistics of an upload sent by coap_post_stream()
+		 */
+		struct TP_CoAP_Stream_Stats
+		{
+			uint16_t blocks_sent;
+			size_t bytes_sent;
+			uint32_t duration_ms;
+		};
+
+		/** Reader used by coap_post_stream() to obtain each block. On each 
+		 *  call the reader must point block at up to max_length contiguous 
+		 *  bytes of its own memory and return how many bytes are available. 
+		 *  Fewer than max_length bytes marks the final block and 0 marks the 
+		 *  end of the data, in which case an empty final block is sent. Each
+		 *  block is sent before the reader is called again, so memory returned
+		 *  by one call need only remain valid until the next call, and a 
+		 *  single staging buffer may be reused
+		 */
+		typedef Callback<size_t(uint8_t *&block, size_t max_length)> TP_CoAP_Block_Reader;
+
+		/** Callback used to stream a CoAP response out of the driver in chunks
+		 *  as it is decoded, without buffering the whole response. Each chunk
+		 *  is only valid for the duration of the call
+		 */
+		typedef Callback<void(const uint8_t *chunk, size_t length)> TP_CoAP_Response_Writer;
+
+		#if TP_NBIOT_ASYNC
+			/** Operations that may be queued for the modem worker thread. The
+			 *  worker serves each request through the matching public call, 
+			 *  which holds the interface lock for its duration, so other 
+			 *  methods may be called from any thread while requests are 
+			 *  outstanding and simply wait for the request in progress
+			 */
+			enum class TP_Async_Operation
+			{
+				COAP_GET    = 0,
+				COAP_DELETE = 1,
+				COAP_PUT    = 2,
+				COAP_POST   = 3,
+				START       = 4
+			};
+
+			/** Outcome of an asynchronous request, passed to its completion callback
+			 */
+			struct TP_Async_Result
+			{
+				uint32_t handle;
+				TP_Async_Operation operation;
+				int status;
+				int response_code;
+			};
+
+			/** Completion callback of an asynchronous request. Called from the 
+			 *  modem worker thread
+			 */
+			typedef Callback<void(const TP_Async_Result &result)> TP_Async_Callback;
+
+			#if TP_NBIOT_DRIVER_SOCKETS
+				/** Datagram received on a socket outside of any request, i.e. a 
+				 *  server-initiated CoAP message, see TP_CoAP_Message::parse().
+				 *  truncated is set if the datagram was longer than 
+				 *  TP_NBIOT_DOWNLINK_MAX_SIZE, the rest having been discarded
+				 */
+				struct TP_Downlink
+				{
+					int socket;
+					char ipv4[16];
+					uint16_t port;
+					size_t length;
+					bool truncated;
+					uint8_t data[TP_NBIOT_DOWNLINK_MAX_SIZE];
+				};
+
+				/** Downlink callback. Called from the modem worker thread and only
+				 *  valid for the duration of the call
+				 */
+				typedef Callback<void(const TP_Downlink &downlink)> TP_Downlink_Callback;
+			#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+		#endif /* #if TP_NBIOT_ASYNC */
+
+		#if TP_NBIOT_PERF_TRACE
+			/** Traced modem operations
+			 */
+			enum class TP_Perf_Operation
+			{
+				READY             = 0,
+				START             = 1,
+				REBOOT            = 2,
+				NETWORK_URCS      = 3,
+				RADIO_STATUS      = 4,
+				NETWORK_STATUS    = 5,
+				CONNECTION_STATUS = 6,
+				PSM_STATUS        = 7,
+				PSM_QUERY         = 8,
+				CSQ               = 9,
+				BAND              = 10,
+				NUESTATS          = 11,
+				CONFIGURE_COAP    = 12,
+				COAP_GET          = 13,
+				COAP_DELETE       = 14,
+				COAP_PUT          = 15,
+				COAP_POST         = 16,
+				COAP_POST_STREAM  = 17,
+				SET_TAU_TIMER     = 18,
+				GET_TAU_TIMER     = 19,
+				SET_ACTIVE_TIME   = 20,
+				GET_ACTIVE_TIME   = 21,
+				RESUME            = 22,
+				AT_BATCH          = 23,
+				LINK_SPEED        = 24
+			};
+
+			/** Trace of a single operation. Operations that call other traced 
+			 *  operations, i.e. start(), are recorded after them and their
+			 *  counts include those of the nested operations
+			 */
+			struct TP_Perf_Record
+			{
+				TP_Perf_Operation operation;
+				uint32_t start_ms;
+				uint32_t duration_ms;
+				uint16_t at_commands;
+				uint32_t uart_tx_bytes;
+				uint32_t uart_rx_bytes;
+				int result;
+			};
+
+			/** Totals across all traced operations since the last reset
+			 */
+			struct TP_Perf_Counters
+			{
+				uint32_t operations;
+				uint32_t failures;
+				uint32_t busy_ms;
+				uint32_t at_commands;
+				uint32_t uart_tx_bytes;
+				uint32_t uart_rx_bytes;
+				uint32_t records_dropped;
+			};
+
+			/** Callback called with each record as it completes, i.e. for export. 
+			 *  Called from the thread that performed the operation
+			 */
+			typedef Callback<void(const TP_Perf_Record &record)> TP_Perf_Callback;
+		#endif /* #if TP_NBIOT_PERF_TRACE */
+
+		#if TP_NBIOT_STATS
+			/** CoAP response classes counted by TP_Modem_Stats
+			 */
+			enum
+			{
+				STATS_COAP_SUCCESS      = 0,
+				STATS_COAP_CLIENT_ERROR = 1,
+				STATS_COAP_SERVER_ERROR = 2,
+				STATS_COAP_OTHER        = 3,
+				STATS_COAP_FAILED       = 4,
+				STATS_COAP_CLASSES      = 5
+			};
+
+			/** Number of buckets in each NUESTATS distribution
+			 */
+			static const size_t STATS_BUCKETS = 4;
+
+			/** Largest summary written by get_stats_summary(), in bytes
+			 */
+			static const size_t STATS_SUMMARY_MAX = 160;
+
+			/** Long running counters since the last reset_stats(). coap counts
+			 *  responses by STATS_COAP_* class, STATS_COAP_FAILED being requests
+			 *  that got no response. status_time_s counts seconds spent in each
+			 *  TP_Connection_Status. bler counts RLC uplink BLER samples below
+			 *  1, 5, 10 and from 10 percent and tx_power TX power samples below
+			 *  0, 10, 20 and from 20 dBm
+			 */
+			struct TP_Modem_Stats
+			{
+				uint32_t period_s;
+				uint32_t attach_attempts;
+				uint32_t attach_successes;
+				uint32_t attach_time_total_ms;
+				uint32_t attach_time_max_ms;
+				uint32_t start_timeouts;
+				uint32_t reboots;
+				uint32_t coap[STATS_COAP_CLASSES];
+				uint32_t bytes_sent;
+				uint32_t bytes_received;
+				uint32_t status_time_s[8];
+				uint32_t bler[STATS_BUCKETS];
+				uint32_t tx_power[STATS_BUCKETS];
+			};
+		#endif /* #if TP_NBIOT_STATS */
+
 	    #if BOARD == WRIGHT_V1_0_0 || BOARD == DEVELOPMENT_BOARD_V1_1_0
 			/** Constructor for the TP_NBIoT_Interface class, specifically when 
 			 *  using a ublox Sara N2xx. Instantiates an ATCmdParser object
@@ -138,6 +1073,11 @@ class TP_NBIoT_Interface
 		 *  SIM_PSM = TRUE
 		 *  MODULE_PSM = TRUE
 		 * 
+		 *  The current configuration is read first and only settings that 
+		 *  differ are written. The modem is only rebooted if a setting that
+		 *  requires it has changed, so a modem that is already configured
+		 *  is not re-attached
+		 * 
 		 *  Then attempt to connect to a network for 5 minutes; if this is 
 		 *  unsuccessful then turn off the modem and report that status
 		 *  back to the application. If it is successful then the modem 
@@ -149,19 +1089,146 @@ class TP_NBIoT_Interface
 		 */
 		int start(uint16_t timeout_s = 300);
 
-		/** Power-cycle the NB-IoT modem
+		/** Recover a lost or failed connection, i.e. after start() returns 
+		 *  FAIL_TO_CONNECT or the module deregisters. Escalates through the 
+		 *  TP_Recovery_Step steps, waiting for registration after each and 
+		 *  backing off exponentially with jitter between them so that a fleet
+		 *  does not retry in step. The serving cell is queried first and 
+		 *  recovery begins one step cheaper than the step that last 
+		 *  recovered the connection in that cell, so that a cell which once
+		 *  needed a reboot isn't rebooted on every recovery from then on. 
+		 *  Cells are only told apart with TP_NBIOT_DRIVER_NUESTATS. The 
+		 *  interface lock is held for each step but released during the 
+		 *  backoff between them
+		 * 
+		 * @param timeout_s Overall timeout period in seconds
+		 * @param &step Address of TP_Recovery_Step in which to store the 
+		 *              step that recovered the connection
+		 * @return Indicates success or failure reason
+		 */
+		int recover(uint16_t timeout_s, TP_Recovery_Step &step);
+
+		/** Copy the recovery history, i.e. to persist it across MCU resets
+		 * 
+		 * @param *cells Pointer to an array of TP_NBIOT_RECOVERY_CELLS entries
+		 * @return None
+		 */
+		void get_recovery_history(TP_Recovery_Cell *cells);
+
+		/** Restore recovery history saved by get_recovery_history()
+		 * 
+		 * @param *cells Pointer to an array of TP_NBIOT_RECOVERY_CELLS entries
+		 * @return None
+		 */
+		void set_recovery_history(const TP_Recovery_Cell *cells);
+
+		/** Save the state needed by resume() to carry on after an MCU reset
+		 *  without restarting the modem: the last known connection status,
+		 *  EARFCN, T3412/T3324 timers, UE configuration, a hash of the endpoint
+		 *  held by each CoAP profile and open sockets. Made from cached state 
+		 *  only, so there is no AT traffic. Call once registered, i.e. before 
+		 *  entering MCU standby
+		 * 
+		 * @param &context Address of TP_Attach_Context in which to store the 
+		 *                 context, to be kept in retained RAM or flash
+		 * @return Indicates success or failure reason, FAIL_TO_CONNECT if the
+		 *         module is not known to be registered
+		 */
+		int save_attach_context(TP_Attach_Context &context);
+
+		/** Carry on from a context saved by save_attach_context() before an
+		 *  MCU reset, instead of calling start(). A single AT+CEREG? query 
+		 *  confirms that the module is still registered, after which the saved
+		 *  state is restored and data can be sent straight away. If this fails
+		 *  call start() as usual. The saved connection state and EARFCN are 
+		 *  restored as stale, so that the first request with a maximum age 
+		 *  queries the module. Sockets open at the time are still open in the
+		 *  module and are tracked again, but data announced before the MCU 
+		 *  reset is not counted by socket_pending(); socket_recv_from() reads
+		 *  it regardless. Endpoint handles stay valid. An endpoint passed to
+		 *  configure_coap() or register_endpoint() again is checked against the
+		 *  saved hash and, if it matches, its profile is reused without being
+		 *  rewritten
+		 * 
+		 * @param &context Context saved by save_attach_context()
+		 * @return Indicates success or failure reason, INVALID_CONTEXT if the 
+		 *         context is corrupt and FAIL_TO_CONNECT if the module is no 
+		 *         longer registered
+		 */
+		int resume(const TP_Attach_Context &context);
+
+		/** Enable +CSCON, +CEREG and +NPSMR unsolicited result codes (URCs)
+		 *  and track radio connection, network registration and PSM status
+		 *  from them rather than by polling. Once enabled, get_connection_status(),
+		 *  get_power_save_mode_status() and get_module_network_status() are 
+		 *  answered from the URC state without issuing AT commands. URCs are 
+		 *  disabled by the modem on reboot, after which reboot_modem() and 
+		 *  ready() re-enable them automatically
+		 * 
+		 * @return Indicates success or failure reason, NOT_SUPPORTED if built
+		 *         without TP_NBIOT_DRIVER_URCS
+		 */
+		int enable_network_urcs();
+
+		/** Dispatch any URCs waiting in the modem UART buffer. Only required
+		 *  if the application wants URC state to be updated while it is not
+		 *  otherwise calling into the interface
+		 * 
+		 * @return None
+		 */
+		void process_urcs();
+
+		/** Power-cycle the NB-IoT modem. AT+NRB is sent at the rate and flow
+		 *  control in use, then the MCU follows the module to the rate it 
+		 *  boots at, the link is verified and flow control reapplied
 		 * 
 		 * @return Indicates success or failure reason
 		 */
 		int reboot_modem();
 
-		/** Is the modem TX/RX circuitry turned on or off? 1 is on, 0 is off
+		/** Switch the UART between MCU and module to a different baud rate 
+		 *  and flow control mode, i.e. 460800 with CTS for large uploads. The
+		 *  module is switched with AT+NATSPEED, then the MCU, and the new 
+		 *  rate is verified. If it can't be, both return to the previous 
+		 *  rate. If persisted the module boots at the new rate, otherwise 
+		 *  reboot_modem() returns the MCU to the rate the module boots at. 
+		 *  After an MCU reset construct the interface at the persisted 
+		 *  rate, or call resume(), which restores it
+		 * 
+		 * @param baud Baud rate, one of 4800, 9600, 57600, 115200, 230400,
+		 *             460800 and 921600
+		 * @param flow_control Flow control mode
+		 * @param persist Store the baud rate in the module's NVM
+		 * @return Indicates success or failure reason, LINK_FALLBACK if the
+		 *         new rate could not be verified and the previous rate has
+		 *         been restored, NOT_SUPPORTED if built without 
+		 *         TP_NBIOT_DRIVER_LINK_SPEED
+		 */
+		int set_link_speed(uint32_t baud, TP_Flow_Control flow_control = TP_Flow_Control::NONE, 
+						   bool persist = true);
+
+		/** Return the baud rate and flow control mode in use between MCU and
+		 *  module, without communicating with the module
+		 * 
+		 * @param &baud Address of uint32_t in which to store the baud rate
+		 * @param &flow_control Address of TP_Flow_Control in which to store
+		 *                      the flow control mode
+		 * @return Indicates success or failure reason
+		 */
+		int get_link_speed(uint32_t &baud, TP_Flow_Control &flow_control);
+
+		/** Is the modem TX/RX circuitry turned on or off? 1 is on, 0 is off.
+		 *  A deferred query made in PSM is answered with the status last read
+		 *  or set since the module was reset or, if there is none, queued until
+		 *  the next wakeup
 		 * 
 		 * @param &status Address of integer value to which to return the status
 		 *                value of the radio
-		 * @return Indicates success or failure reason
+		 * @param mode Whether the module may be woken from PSM to answer
+		 * @return Indicates success or failure reason, QUERY_DEFERRED if 
+		 *         queued
 		 */
-		int get_radio_status(int &radio_status);
+		int get_radio_status(int &radio_status, TP_Query_Mode mode = TP_Query_Mode::DEFERRED);
 
 		/** Disable TX and RX RF circuits
 		 * 
@@ -229,6 +1296,55 @@ class TP_NBIoT_Interface
 		int get_module_network_status(TP_Connection_Status &status, int &connected, 
 									  int &registered, int &psm);
 
+		/** Return u-blox defined connection status, only querying the modem
+		 *  if the cached connection state is older than max_age_ms. If URCs
+		 *  are enabled the cached state is always current
+		 * 
+		 * @param &status Address of TP_Connection_Status to return u-blox defined connection
+		 *                status to
+		 * @param max_age_ms Maximum age of cached state, in milliseconds, that
+		 *                   the caller is willing to accept
+		 * @return Indicates success or failure reason
+		 */
+		int get_module_network_status(TP_Connection_Status &status, uint32_t max_age_ms);
+
+		/** Return a copy of the last known connection state without communicating
+		 *  with the modem. Never waits for another thread's operation to finish
+		 * 
+		 * @param &snapshot Address of TP_Connection_Snapshot in which to store
+		 *                  the last known connection state
+		 * @return Indicates success or failure reason
+		 */
+		int get_connection_snapshot(TP_Connection_Snapshot &snapshot);
+
+		/** Return the outcome of the last AT batch, i.e. which command of
+		 *  configure_coap(), start() or set_psm_timers() failed and with what
+		 *  status, without communicating with the modem
+		 * 
+		 * @param &report Address of TP_AT_Batch_Report in which to store the
+		 *                outcome of the last batch
+		 * @return Indicates success or failure reason
+		 */
+		int get_at_batch_report(TP_AT_Batch_Report &report);
+
+		/** Return the RAM held by this interface, broken down by buffer, 
+		 *  without communicating with the modem. Doesn't wait for the 
+		 *  interface lock, so it can be called while the worker is busy
+		 * 
+		 * @param &footprint Address of TP_RAM_Footprint in which to store
+		 *                   the sizes
+		 * @return Indicates success or failure reason
+		 */
+		int get_ram_footprint(TP_RAM_Footprint &footprint);
+
+		/** Return the RAM held by any interface of this build, broken down 
+		 *  by buffer, as a constant expression, e.g. for a static_assert. 
+		 *  worker_stack_peak is 0
+		 * 
+		 * @return Sizes of the interface and its buffers
+		 */
+		static constexpr TP_RAM_Footprint ram_footprint();
+
 		/** Query UE for radio connection and network registration status
 		 * 
 		 * @param &connected Address of integer in which to store radio 
@@ -239,17 +1355,22 @@ class TP_NBIoT_Interface
 		 */
         int get_connection_status(int &connected, int &reg_status);
 
-        /** Get last known RSRP and RSRQ
+        /** Get last known RSRP and RSRQ. A deferred query made in PSM is 
+        *  answered from the snapshot or, if there is nothing cached, queued 
+        *  until the next wakeup
         * 
         * @param &power Address of integer in which to return
         *               last known RSRP
         * @param &quality Address of integer in which to return
         *                 last known RSRQ
-        * @return Indicates success or failure reason
+        * @param mode Whether the module may be woken from PSM to answer
+        * @return Indicates success or failure reason, QUERY_DEFERRED if 
+        *         queued
         */
-        int get_csq(int &power, int &quality);
+        int get_csq(int &power, int &quality, TP_Query_Mode mode = TP_Query_Mode::DEFERRED);
 
-		/** Return LTE channel number, EARFCN
+		/** Return LTE channel number, EARFCN. The EARFCN of the snapshot is
+		 *  used if no older than TP_NBIOT_BAND_MAX_AGE_MS
 		 * 
 		 * @param &band Address of TP_NBIoT_Band value in which to store
 		 *              determined EARFCN
@@ -257,6 +1378,22 @@ class TP_NBIoT_Interface
 		 */
 		int get_band(TP_NBIoT_Band &band);
 
+		/** Return LTE channel number, EARFCN. The EARFCN of the snapshot is
+		 *  used if no older than max_age_ms, otherwise only the RADIO 
+		 *  NUESTATS category is queried. A deferred query made in PSM uses
+		 *  the snapshot regardless of age or, if there is nothing cached, is
+		 *  queued until the next wakeup
+		 * 
+		 * @param &band Address of TP_NBIoT_Band value in which to store
+		 *              determined EARFCN
+		 * @param max_age_ms Maximum age of cached EARFCN, in milliseconds, 
+		 *                   that the caller is willing to accept
+		 * @param mode Whether the module may be woken from PSM to answer
+		 * @return Indicates success or failure reason, QUERY_DEFERRED if 
+		 *         queued
+		 */
+		int get_band(TP_NBIoT_Band &band, uint32_t max_age_ms, TP_Query_Mode mode = TP_Query_Mode::DEFERRED);
+
 		/** Return operation stats, of a given type, of the module
          * 
          * @param *data Point to .data parameter of Nuestats_t struct
@@ -265,6 +1402,69 @@ class TP_NBIoT_Interface
          */
         int get_nuestats(char *data);
 
+		/** Query only the RADIO NUESTATS category of the module. The
+		 *  snapshot EARFCN is updated from the result
+		 * 
+		 * @param &radio Address of TP_Nuestats_Radio in which to store values
+		 * @return Indicates success or failure reason, NOT_SUPPORTED if built
+		 *         without TP_NBIOT_DRIVER_NUESTATS
+		 */
+		int get_nuestats(TP_Nuestats_Radio &radio);
+
+		/** Query only the CELL NUESTATS category of the module
+		 * 
+		 * @param &cell Address of TP_Nuestats_Cell in which to store values
+		 * @return Indicates success or failure reason, NOT_SUPPORTED if built
+		 *         without TP_NBIOT_DRIVER_NUESTATS
+		 */
+		int get_nuestats(TP_Nuestats_Cell &cell);
+
+		/** Query only the BLER NUESTATS category of the module
+		 * 
+		 * @param &bler Address of TP_Nuestats_BLER in which to store values
+		 * @return Indicates success or failure reason, NOT_SUPPORTED if built
+		 *         without TP_NBIOT_DRIVER_NUESTATS
+		 */
+		int get_nuestats(TP_Nuestats_BLER &bler);
+
+		/** Query only the THP NUESTATS category of the module
+		 * 
+		 * @param &thp Address of TP_Nuestats_THP in which to store values
+		 * @return Indicates success or failure reason, NOT_SUPPORTED if built
+		 *         without TP_NBIOT_DRIVER_NUESTATS
+		 */
+		int get_nuestats(TP_Nuestats_THP &thp);
+
+		/** Query only the APPSMEM NUESTATS category of the module
+		 * 
+		 * @param &appsmem Address of TP_Nuestats_APPSMEM in which to store values
+		 * @return Indicates success or failure reason, NOT_SUPPORTED if built
+		 *         without TP_NBIOT_DRIVER_NUESTATS
+		 */
+		int get_nuestats(TP_Nuestats_APPSMEM &appsmem);
+
+		/** Apply a complete UE configuration. The configuration is compared
+		 *  against the last known state of the module, read once if unknown,
+		 *  and only settings that differ are written. If reboot is true and
+		 *  anything was written the modem is rebooted once so that the new 
+		 *  settings take effect. Without TP_NBIOT_DRIVER_NCONFIG a setting is
+		 *  known once it has been written, so the first call after an MCU 
+		 *  reset writes every setting and later calls only those that differ
+		 * 
+		 * @param &config Address of TP_UE_Config holding desired configuration
+		 * @param reboot Reboot the modem if any setting was written
+		 * @return Indicates success or failure reason
+		 */
+		int apply_ue_config(const TP_UE_Config &config, bool reboot = true);
+
+		/** Return the UE configuration of the module, from the cached state
+		 *  if known or otherwise by reading it from the module
+		 * 
+		 * @param &config Address of TP_UE_Config in which to store configuration
+		 * @return Indicates success or failure reason
+		 */
+		int get_ue_config(TP_UE_Config &config);
+
 		/** Allow the platform to automatically attempt to connect to the 
 		 *  network after power-on or reboot. Will set AT+CFUN=1 and read
 		 *  the SIM PLMN. Will use APN provided by network.
@@ -358,15 +1558,20 @@ class TP_NBIoT_Interface
 		 */
 		int disable_sim_power_save_mode();
 
-        /** Query whether or not Power Save Mode (PSM) is enabled
+        /** Query whether or not Power Save Mode (PSM) is enabled. A deferred
+		 *  query made in PSM is answered with the setting last read or written
+		 *  since the module was reset or, if there is none, queued until the 
+		 *  next wakeup
 		 *  
 		 * @param &power_save_mode Address of integer in which to store
 		 *                         value of power save mode setting. 1 
 		 *                         means that PSM is enabled, 0 means 
 		 *                         that PSM is disable
-		 * @return Indicates success or failure reason
+		 * @param mode Whether the module may be woken from PSM to answer
+		 * @return Indicates success or failure reason, QUERY_DEFERRED if 
+		 *         queued
 		 */
-        int query_power_save_mode(int &power_save_mode);
+        int query_power_save_mode(int &power_save_mode, TP_Query_Mode mode = TP_Query_Mode::DEFERRED);
 
 		/** Determine whether or not the modem is in power save mode or not
 		 * 
@@ -376,7 +1581,10 @@ class TP_NBIoT_Interface
 		 */ 
 		int get_power_save_mode_status(int &psm);
 
-        /** Configure CoAP profile 0 with a given IP address, port and URI
+        /** Configure CoAP profile 0 with a given IP address, port and URI and
+		 *  select it for subsequent CoAP requests. Profile 0 is only written
+		 *  if it does not already hold this endpoint and never while another 
+		 *  endpoint registered with register_endpoint() holds it
          *
          * @param *ipv4 Pointer to a byte array storing the IPv4 address of the 
          *              destination server as a string, for example:
@@ -385,11 +1593,146 @@ class TP_NBIoT_Interface
          * @param *uri Pointer to a byte array storing the URI, for example:
          *             char uri[] = "http://coap.me:5683/sink";
 		 * @param uri_length Number of characters in URI, cannot be greater
- 		 *                   than 200
-         * @return Indicates success or failure reason
+ 		 *                   than TP_NBIOT_COAP_URI_MAX_LENGTH
+         * @return Indicates success or failure reason, ENDPOINT_IN_USE if
+         *         profile 0 holds a registered endpoint
          */
 		int configure_coap(char *ipv4, uint16_t port, char *uri, uint8_t uri_length);
 
+		/** Save an endpoint into a free CoAP profile of the module so that it 
+		 *  can later be selected with select_endpoint() without reconfiguring. 
+		 *  If the endpoint is already registered its existing handle is 
+		 *  returned without communicating with the modem
+		 *
+		 * @param *ipv4 Pointer to a byte array storing the IPv4 address of the 
+		 *              destination server as a string
+		 * @param port Destination server port
+		 * @param *uri Pointer to a byte array storing the URI
+		 * @param uri_length Number of characters in URI, cannot be greater
+		 *                   than TP_NBIOT_COAP_URI_MAX_LENGTH
+		 * @param &handle Address of integer in which to store the endpoint handle
+		 * @return Indicates success or failure reason
+		 */
+		int register_endpoint(char *ipv4, uint16_t port, char *uri, uint8_t uri_length, int &handle);
+
+		/** Release the CoAP profile held by an endpoint so that it can be reused
+		 *  by register_endpoint(). The profile saved in the module is left as is
+		 *
+		 * @param handle Endpoint handle returned by register_endpoint()
+		 * @return Indicates success or failure reason
+		 */
+		int unregister_endpoint(int handle);
+
+		/** Value of the endpoint parameter of coap_post() and coap_post_async()
+		 *  by which the request is sent to the endpoint selected by 
+		 *  configure_coap() or select_endpoint()
+		 */
+		static const int SELECTED_ENDPOINT = -1;
+
+		/** Direct subsequent CoAP requests made without an endpoint handle to
+		 *  an endpoint. Asynchronous requests already queued keep the endpoint
+		 *  selected when they were queued. The profile is only loaded by the 
+		 *  next request and only if not already loaded, so switching costs at
+		 *  most one AT command. Threads sharing the interface should pass 
+		 *  their endpoint handle to coap_post() or coap_post_async() instead
+		 *
+		 * @param handle Endpoint handle returned by register_endpoint()
+		 * @return Indicates success or failure reason
+		 */
+		int select_endpoint(int handle);
+
+		/** Wait for the module to leave RRC connected mode, i.e. to confirm 
+		 *  that a release assistance indication took effect. The wait is on
+		 *  +CSCON/+NPSMR URCs if enabled, otherwise the module is polled
+		 *
+		 * @param timeout_ms Maximum time to wait in milliseconds
+		 * @param &elapsed_ms Address of integer in which to store the time 
+		 *                    taken for the connection to be released
+		 * @return Indicates success or failure reason, NOT_RELEASED if still
+		 *         connected on timeout
+		 */
+		int wait_for_rrc_release(uint32_t timeout_ms, uint32_t &elapsed_ms);
+
+		#if TP_NBIOT_DRIVER_SOCKETS
+			/** Open a UDP socket. Datagrams can then be sent without CoAP AT 
+			 *  framing and many may share one RRC connection. Arriving data is 
+			 *  announced by +NSONMI, see socket_wait() and socket_recv_from()
+			 *
+			 * @param local_port Local port to bind to, 0 to let the module choose
+			 * @param &socket Address of integer in which to store the socket number
+			 * @return Indicates success or failure reason
+			 */
+			int socket_open(uint16_t local_port, int &socket);
+
+			/** Close a UDP socket
+			 *
+			 * @param socket Socket number returned by socket_open()
+			 * @return Indicates success or failure reason
+			 */
+			int socket_close(int socket);
+
+			/** Send a datagram from a caller-supplied buffer
+			 *
+			 * @param socket Socket number returned by socket_open()
+			 * @param *ipv4 Pointer to destination IPv4 address string
+			 * @param port Destination port
+			 * @param *data Pointer to datagram
+			 * @param length Length of datagram, no greater than 512 bytes
+			 * @param rai Release assistance indication, i.e. RELEASE for the last
+			 *            datagram of a batch so that the network releases the RRC
+			 *            connection straight away rather than on inactivity
+			 * @return Indicates success or failure reason
+			 */
+			int socket_send_to(int socket, const char *ipv4, uint16_t port, const uint8_t *data, size_t length,
+							   TP_Release_Assistance rai = TP_Release_Assistance::NONE);
+
+			/** Send a CoAP message encoded by TP_CoAP_Message
+			 *
+			 * @param socket Socket number returned by socket_open()
+			 * @param *ipv4 Pointer to destination IPv4 address string
+			 * @param port Destination port
+			 * @param &message Address of encoded message
+			 * @param rai Release assistance indication
+			 * @return Indicates success or failure reason
+			 */
+			int socket_send_to(int socket, const char *ipv4, uint16_t port, const TP_CoAP_Message &message,
+							   TP_Release_Assistance rai = TP_Release_Assistance::NONE);
+
+			/** Read a received datagram into a caller-supplied buffer. A datagram 
+			 *  longer than recv_cap is read over several calls
+			 *
+			 * @param socket Socket number returned by socket_open()
+			 * @param *recv_buf Pointer to a byte array into which to read
+			 * @param recv_cap Capacity of recv_buf in bytes
+			 * @param &recv_len Address of size_t in which to store the number of 
+			 *                  bytes read
+			 * @param *ipv4 Pointer to a char array of at least 16 bytes in which to
+			 *              store the source IPv4 address
+			 * @param &port Address of uint16_t in which to store the source port
+			 * @return Indicates success or failure reason, NO_DATA if nothing
+			 *         was waiting
+			 */
+			int socket_recv_from(int socket, uint8_t *recv_buf, size_t recv_cap, size_t &recv_len,
+								 char *ipv4, uint16_t &port);
+
+			/** Number of received bytes announced by +NSONMI and not yet read,
+			 *  without communicating with the modem
+			 *
+			 * @param socket Socket number returned by socket_open()
+			 * @return Number of bytes waiting
+			 */
+			size_t socket_pending(int socket);
+
+			/** Sleep until data arrives on a socket, waking only when the modem
+			 *  sends something
+			 *
+			 * @param socket Socket number returned by socket_open()
+			 * @param timeout_ms Maximum time to wait in milliseconds
+			 * @return Indicates success or failure reason, NO_DATA on timeout
+			 */
+			int socket_wait(int socket, uint32_t timeout_ms);
+		#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
 		/** Perform a HTTP GET request over CoAP and capture the server
 		 *  response in recv_data
 		 *
@@ -401,6 +1744,34 @@ class TP_NBIoT_Interface
 		 */
 		int coap_get(char *recv_data, int &response_code);
 
+		#if TP_NBIOT_DRIVER_COAP_BUFFERS
+			/** Perform a HTTP GET request over CoAP and decode the server response
+			 *  directly into a caller-supplied buffer of known capacity
+			 *
+			 * @param *recv_buf Pointer to a byte array into which the response 
+			 *                  will be decoded
+			 * @param recv_cap Capacity of recv_buf in bytes
+			 * @param &recv_len Address of integer in which to store the length of
+			 *                  the response. If greater than recv_cap then only 
+			 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+			 *                  returned
+			 * @param &response_code Address of integer where CoAP operation response code
+			 *                       will be stored
+			 * @return Indicates success or failure reason
+			 */
+			int coap_get(uint8_t *recv_buf, size_t recv_cap, size_t &recv_len, int &response_code);
+
+			/** Perform a HTTP GET request over CoAP and stream the server response
+			 *  to writer in chunks as it is decoded
+			 *
+			 * @param writer Callback to which each chunk of the response is passed
+			 * @param &response_code Address of integer where CoAP operation response code
+			 *                       will be stored
+			 * @return Indicates success or failure reason
+			 */
+			int coap_get(TP_CoAP_Response_Writer writer, int &response_code);
+		#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
 		/** Perform a HTTP DELETE request over CoAP and capture the server
 		 *  response in recv_data
 		 *
@@ -412,6 +1783,24 @@ class TP_NBIoT_Interface
 		 */
 		int coap_delete(char *recv_data, int &response_code);
 
+		#if TP_NBIOT_DRIVER_COAP_BUFFERS
+			/** Perform a HTTP DELETE request over CoAP and decode the server response
+			 *  directly into a caller-supplied buffer of known capacity
+			 *
+			 * @param *recv_buf Pointer to a byte array into which the response 
+			 *                  will be decoded
+			 * @param recv_cap Capacity of recv_buf in bytes
+			 * @param &recv_len Address of integer in which to store the length of
+			 *                  the response. If greater than recv_cap then only 
+			 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+			 *                  returned
+			 * @param &response_code Address of integer where CoAP operation response code
+			 *                       will be stored
+			 * @return Indicates success or failure reason
+			 */
+			int coap_delete(uint8_t *recv_buf, size_t recv_cap, size_t &recv_len, int &response_code);
+		#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
 		/** Perform a PUT request using CoAP and save the returned 
 		 *  data into recv_data
 		 * 
@@ -428,6 +1817,30 @@ class TP_NBIoT_Interface
 		 */ 
 		int coap_put(char *send_data, char *recv_data, int data_indentifier, int &response_code);
 
+		#if TP_NBIOT_DRIVER_COAP_BUFFERS
+			/** Perform a PUT request using CoAP and decode the server response
+			 *  directly into a caller-supplied buffer of known capacity
+			 * 
+			 * @param *send_data Pointer to a byte array containing the 
+			 *                   data to be sent to the server
+			 * @param data_intenfier Integer value representing the data 
+			 *                       format type. Possible values are enumerated
+			 *                       in the header file, i.e. TEXT_PLAIN
+			 * @param *recv_buf Pointer to a byte array into which the response 
+			 *                  will be decoded
+			 * @param recv_cap Capacity of recv_buf in bytes
+			 * @param &recv_len Address of integer in which to store the length of
+			 *                  the response. If greater than recv_cap then only 
+			 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+			 *                  returned
+			 * @param &response_code Address of integer where CoAP operation response code
+			 *                       will be stored
+			 * @return Indicates success or failure reason
+			 */ 
+			int coap_put(char *send_data, int data_indentifier, uint8_t *recv_buf, size_t recv_cap, 
+						 size_t &recv_len, int &response_code);
+		#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
 		/** Perform a POST request using CoAP and save the returned 
 		 *  data into recv_data
 		 * 
@@ -440,10 +1853,387 @@ class TP_NBIoT_Interface
 		 *                       in the header file, i.e. TEXT_PLAIN
          * @param &response_code Address of integer where CoAP operation response code
          *                       will be stored
-		 * @return Indicates success or failure reason
+		 * @param priority Traffic priority, only the first block of a Block1
+		 *                 upload being subject to the coverage gate
+		 * @param endpoint Endpoint handle returned by register_endpoint(), 
+		 *                 whose profile is loaded for this request only, or
+		 *                 SELECTED_ENDPOINT
+		 * @return Indicates success or failure reason, INVALID_ENDPOINT if 
+		 *         the handle isn't registered
 		 */ 
 		int coap_post(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
-                      uint8_t send_block_number, uint8_t send_more_block, int &response_code);
+                      uint8_t send_block_number, uint8_t send_more_block, int &response_code,
+                      TP_Traffic_Priority priority = TP_Traffic_Priority::NORMAL, 
+                      int endpoint = TP_NBIoT_Interface::SELECTED_ENDPOINT);
+
+		#if TP_NBIOT_DRIVER_COAP_BUFFERS
+			/** Perform a POST request using CoAP and decode the server response
+			 *  directly into a caller-supplied buffer of known capacity
+			 * 
+			 * @param *send_data Pointer to a byte array containing the 
+			 *                   data to be sent to the server
+			 * @param buffer_len Number of bytes in send_data
+			 * @param data_intenfier Integer value representing the data 
+			 *                       format type. Possible values are enumerated
+			 *                       in the header file, i.e. TEXT_PLAIN
+			 * @param send_block_number Block1 block number
+			 * @param send_more_block Block1 more-blocks flag
+			 * @param *recv_buf Pointer to a byte array into which the response 
+			 *                  will be decoded
+			 * @param recv_cap Capacity of recv_buf in bytes
+			 * @param &recv_len Address of integer in which to store the length of
+			 *                  the response. If greater than recv_cap then only 
+			 *                  recv_cap bytes were stored and BUFFER_TOO_SMALL is
+			 *                  returned
+			 * @param &response_code Address of integer where CoAP operation response code
+			 *                       will be stored
+			 * @param priority Traffic priority, only the first block of a Block1
+			 *                 upload being subject to the coverage gate
+			 * @return Indicates success or failure reason
+			 */ 
+			int coap_post(uint8_t *send_data, size_t buffer_len, int data_indentifier, uint8_t send_block_number, 
+						  uint8_t send_more_block, uint8_t *recv_buf, size_t recv_cap, size_t &recv_len, 
+						  int &response_code, TP_Traffic_Priority priority = TP_Traffic_Priority::NORMAL);
+		#endif /* #if TP_NBIOT_DRIVER_COAP_BUFFERS */
+
+		/** Perform a single POST request using CoAP with a payload produced by the
+		 *  encoding stage, i.e. TP_SenML_Encoder or TP_Frame_Compressor. The data
+		 *  format is taken from the payload
+		 * 
+		 * @param &payload Encoded payload to send
+		 * @param *recv_data Pointer to a byte array where the data 
+		 *                   returned from the server will be stored
+		 * @param &response_code Address of integer where CoAP operation response code
+		 *                       will be stored
+		 * @param priority Traffic priority, see TP_Traffic_Priority
+		 * @return Indicates success or failure reason
+		 */
+		int coap_post(const TP_Encoded_Payload &payload, char *recv_data, int &response_code,
+					  TP_Traffic_Priority priority = TP_Traffic_Priority::NORMAL);
+
+		/** Upload data as a series of CoAP Block1 POST requests of 
+		 *  MODULE_BLOCK_SIZE, sent back to back on the one loaded profile. 
+		 *  Blocks are passed to the driver straight from the memory handed out
+		 *  by reader, without copying. The total length isn't known up front,
+		 *  so an upload that turns out to need more than MAX_COAP_STREAM_BLOCKS
+		 *  blocks, or a reader returning more than max_length bytes, fails with
+		 *  EXCEEDS_MAX_VALUE having already sent the blocks before it, and the
+		 *  partial upload is left for the server to discard
+		 * 
+		 * @param reader Callback providing each block in turn, see
+		 *               TP_CoAP_Block_Reader
+		 * @param *recv_data Pointer to a byte array where the data 
+		 *                   returned from the server will be stored
+		 * @param data_intenfier Integer value representing the data 
+		 *                       format type. Possible values are enumerated
+		 *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+		 * @param &response_code Address of integer where the response code of
+		 *                       the final block, or of the first block the 
+		 *                       server rejected, will be stored
+		 * @param &stats Address of TP_CoAP_Stream_Stats in which to store
+		 *               aggregated statistics of the upload
+		 * @param *block_stats Optional array in which to store statistics of 
+		 *                     each block sent
+		 * @param max_block_stats Number of elements in block_stats
+		 * @param priority Traffic priority, the upload being subject to the
+		 *                 coverage gate before its first block
+		 * @return Indicates success or failure reason, COAP_REJECTED if 
+		 *         the server answered a block with a 4.xx or 5.xx code
+		 */
+		int coap_post_stream(TP_CoAP_Block_Reader reader, char *recv_data,
+							 int data_indentifier, int &response_code, TP_CoAP_Stream_Stats &stats,
+							 TP_CoAP_Block_Stats *block_stats = NULL, size_t max_block_stats = 0,
+							 TP_Traffic_Priority priority = TP_Traffic_Priority::NORMAL);
+
+		/** Upload a chain of caller-owned buffers as a series of CoAP Block1
+		 *  POST requests. Every buffer except the last must hold a multiple 
+		 *  of MODULE_BLOCK_SIZE bytes so that no block straddles two buffers.
+		 *  The chain is checked against MAX_COAP_STREAM_BLOCKS before 
+		 *  anything is sent
+		 * 
+		 * @param *chain Pointer to the first TP_CoAP_Buffer of the chain
+		 * @param *recv_data Pointer to a byte array where the data 
+		 *                   returned from the server will be stored
+		 * @param data_intenfier Integer value representing the data 
+		 *                       format type. Possible values are enumerated
+		 *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+		 * @param &response_code Address of integer where the response code of
+		 *                       the final block, or of the first block the 
+		 *                       server rejected, will be stored
+		 * @param &stats Address of TP_CoAP_Stream_Stats in which to store
+		 *               aggregated statistics of the upload
+		 * @param *block_stats Optional array in which to store statistics of 
+		 *                     each block sent
+		 * @param max_block_stats Number of elements in block_stats
+		 * @param priority Traffic priority, the upload being subject to the
+		 *                 coverage gate before its first block
+		 * @return Indicates success or failure reason, COAP_REJECTED if 
+		 *         the server answered a block with a 4.xx or 5.xx code
+		 */
+		int coap_post_stream(TP_CoAP_Buffer *chain, char *recv_data,
+							 int data_indentifier, int &response_code, TP_CoAP_Stream_Stats &stats,
+							 TP_CoAP_Block_Stats *block_stats = NULL, size_t max_block_stats = 0,
+							 TP_Traffic_Priority priority = TP_Traffic_Priority::NORMAL);
+
+		#if TP_NBIOT_BATCHING
+			/** Configure the uplink batching stage. Records appended with batch_append()
+			 *  are collected and sent as one coap_post_stream() upload once 
+			 *  flush_threshold bytes are pending, or once a deadline expires. The
+			 *  deadline is placed before the end of the current T3324 active window
+			 *  if the modem is awake when the first record is appended, and is 
+			 *  never later than one T3412 period or max_latency_s. A T3412 of 0,
+			 *  i.e. deactivated, sets no deadline of its own. If URCs are 
+			 *  enabled a pending batch is also flushed as soon as the modem leaves 
+			 *  PSM of its own accord, i.e. for a periodic TAU. The T3412 and T3324 
+			 *  timers are read from the modem once, here
+			 * 
+			 * @param flush_threshold Number of pending bytes at which to flush, no
+			 *                        greater than TP_NBIOT_BATCH_BUFFER_SIZE
+			 * @param max_latency_s Maximum time in seconds a record may be held
+			 * @param *recv_data Pointer to a byte array where the data returned 
+			 *                   from the server on flush will be stored
+			 * @param data_intenfier Integer value representing the data 
+			 *                       format type. Possible values are enumerated
+			 *                       in the driver header file, i.e. SaraN2::TEXT_PLAIN
+			 * @return Indicates success or failure reason
+			 */
+			int configure_batching(size_t flush_threshold, uint32_t max_latency_s, char *recv_data, 
+								   int data_indentifier);
+
+			/** Append a record to the pending batch. Records are concatenated as
+			 *  given so any framing is up to the application. The batch is flushed
+			 *  first if the record would not otherwise fit, and afterwards if the 
+			 *  flush threshold or deadline has been reached
+			 * 
+			 * @param *record Pointer to record data, copied into the batch buffer
+			 * @param length Number of bytes in record
+			 * @return Indicates success or failure reason, COVERAGE_DEFERRED if
+			 *         the batch is full and the coverage gate holds it, in which
+			 *         case the record is not appended
+			 */
+			int batch_append(const uint8_t *record, size_t length);
+
+			/** Flush the pending batch if its flush threshold or deadline has been
+			 *  reached. Should be called periodically, see batch_time_to_deadline()
+			 * 
+			 * @return Indicates success or failure reason
+			 */
+			int batch_poll();
+
+			/** Flush the pending batch now. The batch is only cleared once the
+			 *  server has accepted it, otherwise it is kept to be retried
+			 * 
+			 * @param &response_code Address of integer where CoAP operation response code
+			 *                       will be stored
+			 * @param priority Traffic priority, see TP_Traffic_Priority
+			 * @return Indicates success or failure reason, COAP_REJECTED if the
+			 *         server answered with a 4.xx or 5.xx code
+			 */
+			int batch_flush(int &response_code, TP_Traffic_Priority priority = TP_Traffic_Priority::NORMAL);
+
+			/** Return time until the pending batch is due to be flushed
+			 * 
+			 * @return Milliseconds until the deadline, 0 if it has passed or 
+			 *         UINT32_MAX if nothing is pending
+			 */
+			uint32_t batch_time_to_deadline();
+
+			/** Return the response code of the last batch flushed
+			 * 
+			 * @return CoAP operation response code
+			 */
+			int batch_last_response_code();
+		#endif /* #if TP_NBIOT_BATCHING */
+
+		#if TP_NBIOT_ASYNC
+			/** Queue a HTTP GET request over CoAP for the modem worker thread,
+			 *  which is started on first use. The calling thread is not blocked
+			 *
+			 * @param *recv_data Pointer to a byte array that will be populated
+			 *              	 with the response from the server. Must remain
+			 *                   valid until the callback is called
+			 * @param cb Callback to be called on completion
+			 * @param &handle Address of integer in which to store the handle that
+			 *                identifies this request in TP_Async_Result
+			 * @return Indicates success or failure reason
+			 */
+			int coap_get_async(char *recv_data, TP_Async_Callback cb, uint32_t &handle);
+
+			/** Queue start() for the modem worker thread, which is started on
+			 *  first use, so that several modules can attach at the same time.
+			 *  The calling thread is not blocked
+			 *
+			 * @param timeout_s Timeout period in seconds
+			 * @param cb Callback to be called on completion
+			 * @param &handle Address of integer in which to store the handle that
+			 *                identifies this request in TP_Async_Result
+			 * @return Indicates success or failure reason
+			 */
+			int start_async(uint16_t timeout_s, TP_Async_Callback cb, uint32_t &handle);
+
+			/** Queue a HTTP DELETE request over CoAP for the modem worker thread,
+			 *  which is started on first use. The calling thread is not blocked
+			 *
+			 * @param *recv_data Pointer to a byte array that will be populated
+			 *              	 with the response from the server. Must remain
+			 *                   valid until the callback is called
+			 * @param cb Callback to be called on completion
+			 * @param &handle Address of integer in which to store the handle that
+			 *                identifies this request in TP_Async_Result
+			 * @return Indicates success or failure reason
+			 */
+			int coap_delete_async(char *recv_data, TP_Async_Callback cb, uint32_t &handle);
+
+			/** Queue a PUT request using CoAP for the modem worker thread, which 
+			 *  is started on first use. The calling thread is not blocked
+			 * 
+			 * @param *send_data Pointer to a byte array containing the 
+			 *                   data to be sent to the server. Copied if
+			 *                   TP_NBIOT_ASYNC_PAYLOAD_SIZE is non-zero, 
+			 *                   otherwise must remain valid until the 
+			 *                   callback is called
+			 * @param *recv_data Pointer to a byte array where the data 
+			 *                   returned from the server will be stored. Must 
+			 *                   remain valid until the callback is called
+			 * @param data_intenfier Integer value representing the data 
+			 *                       format type. Possible values are enumerated
+			 *                       in the header file, i.e. TEXT_PLAIN
+			 * @param cb Callback to be called on completion
+			 * @param &handle Address of integer in which to store the handle that
+			 *                identifies this request in TP_Async_Result
+			 * @return Indicates success or failure reason
+			 */ 
+			int coap_put_async(char *send_data, char *recv_data, int data_indentifier, 
+							   TP_Async_Callback cb, uint32_t &handle);
+
+			/** Queue a POST request using CoAP for the modem worker thread, which 
+			 *  is started on first use. The calling thread is not blocked
+			 * 
+			 * @param *send_data Pointer to a byte array containing the 
+			 *                   data to be sent to the server. Copied if
+			 *                   TP_NBIOT_ASYNC_PAYLOAD_SIZE is non-zero, 
+			 *                   otherwise must remain valid until the 
+			 *                   callback is called
+			 * @param *recv_data Pointer to a byte array where the data 
+			 *                   returned from the server will be stored. Must 
+			 *                   remain valid until the callback is called
+			 * @param data_intenfier Integer value representing the data 
+			 *                       format type. Possible values are enumerated
+			 *                       in the header file, i.e. TEXT_PLAIN
+			 * @param cb Callback to be called on completion
+			 * @param &handle Address of integer in which to store the handle that
+			 *                identifies this request in TP_Async_Result
+			 * @param endpoint Endpoint handle returned by register_endpoint() or
+			 *                 SELECTED_ENDPOINT, in which case the endpoint 
+			 *                 selected when the request is queued is used
+			 * @return Indicates success or failure reason, INVALID_ENDPOINT if 
+			 *         the handle isn't registered
+			 */ 
+			int coap_post_async(uint8_t *send_data, size_t buffer_len, char *recv_data, int data_indentifier,
+								uint8_t send_block_number, uint8_t send_more_block, 
+								TP_Async_Callback cb, uint32_t &handle,
+								int endpoint = TP_NBIoT_Interface::SELECTED_ENDPOINT);
+
+			/** Return the number of asynchronous requests that have been queued
+			 *  but whose callbacks have not yet been called. Doesn't wait for the
+			 *  interface lock, so it can be called while the worker is busy
+			 * 
+			 * @return Number of outstanding requests
+			 */
+			uint32_t async_pending();
+
+			#if TP_NBIOT_DRIVER_SOCKETS
+				/** Deliver datagrams received on open sockets to cb. As soon as 
+				 *  +NSONMI announces data the worker thread, started if necessary,
+				 *  reads it into the downlink pool and calls cb, so that commands
+				 *  sent by the server in the active window after an uplink arrive
+				 *  without polling. While a callback is set, received data goes 
+				 *  to it rather than being left for socket_recv_from()
+				 * 
+				 * @param cb Callback to be called with each datagram
+				 * @return Indicates success or failure reason
+				 */
+				int set_downlink_callback(TP_Downlink_Callback cb);
+
+				/** Stop delivering downlinks, leaving received data for 
+				 *  socket_recv_from()
+				 * 
+				 * @return Indicates success or failure reason
+				 */
+				int clear_downlink_callback();
+			#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+		#endif /* #if TP_NBIOT_ASYNC */
+
+		#if TP_NBIOT_PERF_TRACE
+			/** Return totals across all traced operations since the last reset
+			 * 
+			 * @param &counters Address of TP_Perf_Counters in which to store totals
+			 * @return Indicates success or failure reason
+			 */
+			int get_perf_counters(TP_Perf_Counters &counters);
+
+			/** Copy the most recent trace records, oldest first, and remove them
+			 *  from the ring
+			 * 
+			 * @param *records Pointer to array in which to store records
+			 * @param max_records Number of elements in records
+			 * @param &count Address of integer in which to store number of records copied
+			 * @return Indicates success or failure reason
+			 */
+			int get_perf_records(TP_Perf_Record *records, size_t max_records, size_t &count);
+
+			/** Clear all trace records and totals
+			 * 
+			 * @return None
+			 */
+			void reset_perf_counters();
+
+			/** Register a callback to be called with each trace record as it
+			 *  completes, or an empty Callback to stop
+			 * 
+			 * @param cb Callback to register
+			 * @return None
+			 */
+			void set_perf_callback(TP_Perf_Callback cb);
+		#endif /* #if TP_NBIOT_PERF_TRACE */
+
+		#if TP_NBIOT_STATS
+			/** Return the counters since the last reset, time in the current
+			 *  connection status being counted up to now
+			 * 
+			 * @param &stats Address of TP_Modem_Stats in which to store counters
+			 * @return Indicates success or failure reason
+			 */
+			int get_stats(TP_Modem_Stats &stats);
+
+			/** Write the counters as a compact binary summary to piggyback on an
+			 *  uplink: a version byte of 1 followed by each TP_Modem_Stats field, in
+			 *  declaration order, as an unsigned LEB128 varint. attach_time_total_ms
+			 *  is replaced by the mean attach time
+			 * 
+			 * @param *buffer Pointer to buffer into which to write the summary
+			 * @param capacity Capacity of buffer in bytes, STATS_SUMMARY_MAX always
+			 *                 being enough
+			 * @param &length Address of size_t in which to store the summary length
+			 * @return Indicates success or failure reason
+			 */
+			int get_stats_summary(uint8_t *buffer, size_t capacity, size_t &length);
+
+			/** Sample the RADIO and BLER NUESTATS categories into the TX power and
+			 *  BLER distributions. Samples are also taken whenever get_nuestats() is
+			 *  called, so this is only needed if nothing else queries them. Best
+			 *  called while the module is awake, i.e. straight after an uplink
+			 * 
+			 * @return Indicates success or failure reason
+			 */
+			int sample_stats();
+
+			/** Clear all counters
+			 * 
+			 * @return None
+			 */
+			void reset_stats();
+		#endif /* #if TP_NBIOT_STATS */
 
 		/** Set T3412 timer to multiples of given units
 		 * 
@@ -503,23 +2293,1277 @@ class TP_NBIoT_Interface
 		 */
 		int get_active_time(T3324_units &unit, uint8_t &multiples);
 
+		/** Set T3412 and T3324 timers to the closest values that can be encoded,
+		 *  i.e. set_psm_timers(std::chrono::hours(24), std::chrono::seconds(10))
+		 * 
+		 * @param tau Requested T3412 timer value
+		 * @param active Requested T3324 timer value
+		 * @return Indicates success or failure reason
+		 */
+		int set_psm_timers(std::chrono::seconds tau, std::chrono::seconds active);
+
+		/** Set T3412 and T3324 timers from already encoded values. Passing 
+		 *  constants from tau_timer_octet() and active_time_octet() leaves
+		 *  no encoding to be done at runtime
+		 * 
+		 * @param tau_octet T3412 value encoded as a GPRS timer 3 octet
+		 * @param active_octet T3324 value encoded as a GPRS timer 2 octet
+		 * @return Indicates success or failure reason
+		 */
+		int set_psm_timers(uint8_t tau_octet, uint8_t active_octet);
+
+		/** Enable the adaptive PSM controller. The controller measures the
+		 *  interval between uplinks and, on each adaptive_psm_poll(), 
+		 *  picks the T3324 and T3412 values within config that minimise the 
+		 *  expected energy spent per uplink, weighting time awake by the
+		 *  signal power and SNR of the last AT+NUESTATS="RADIO" query. T3324 
+		 *  is kept at 
+		 *  min_active_s, i.e. the window in which downlinks are expected, 
+		 *  unless uplinks come often enough that staying awake is cheaper 
+		 *  than waking from PSM. T3412 is set well beyond the uplink 
+		 *  interval so periodic TAUs are rarely needed. Uplinks are 
+		 *  socket_send_to(), coap_put() and coap_post() requests
+		 * 
+		 * @param &config Address of limits within which to set the timers
+		 * @return Indicates success or failure reason
+		 */
+		int configure_adaptive_psm(const TP_Adaptive_PSM_Config &config);
+
+		/** Disable the adaptive PSM controller, leaving the timers as they are
+		 * 
+		 * @return None
+		 */
+		void disable_adaptive_psm();
+
+		/** Re-evaluate the PSM timers and reprogram them if the saving 
+		 *  expected over TP_NBIOT_PSM_HORIZON_S outweighs the cost of
+		 *  renegotiating them with the network. Nothing is changed until
+		 *  TP_NBIOT_PSM_MIN_SAMPLES uplink intervals have been measured
+		 * 
+		 * @param &reprogrammed Address of boolean set true if the timers
+		 *                      were changed
+		 * @return Indicates success or failure reason
+		 */
+		int adaptive_psm_poll(bool &reprogrammed);
+
+		/** Enable the coverage gate. While the serving cell's signal power is
+		 *  below config.min_rsrp_dbm, or its coverage enhancement level above
+		 *  config.max_ecl, NORMAL priority coap_post() and coap_post_stream() 
+		 *  requests return COVERAGE_DEFERRED and batch_poll() holds the pending 
+		 *  batch. Radio conditions are measured with one AT+NUESTATS="RADIO" query
+		 *  and measured again after a +CEREG URC, i.e. on reselection to another 
+		 *  cell or a change of registration. A module in PSM isn't woken to measure
+		 *  again, the last measurement stands until the module is next awake. Held
+		 *  traffic is let through once it has been held for config.max_deferral_s
+		 * 
+		 * @param &config Thresholds and maximum deferral
+		 * @return Indicates success or failure reason
+		 */
+		int configure_coverage_gate(const TP_Coverage_Gate_Config &config);
+
+		/** Disable the coverage gate
+		 * 
+		 * @return None
+		 */
+		void disable_coverage_gate();
+
+		/** Would traffic of the given priority pass the coverage gate now?
+		 *  Also starts the deferral period if it would not
+		 * 
+		 * @param priority Traffic priority
+		 * @param &open Address of bool in which to store whether traffic may be sent
+		 * @return Indicates success or failure reason
+		 */
+		int coverage_gate_open(TP_Traffic_Priority priority, bool &open);
+
+		/** Encode the T3412 value closest to tau as a GPRS timer 3 octet,
+		 *  the unit being in bits 8 to 6 and the multiples in bits 5 to 1
+		 * 
+		 * @param tau Requested T3412 timer value
+		 * @return Encoded timer value
+		 */
+		static constexpr uint8_t tau_timer_octet(std::chrono::seconds tau)
+		{
+			return timer_octet(T3412_TABLE, sizeof(T3412_TABLE) / sizeof(T3412_TABLE[0]), tau.count());
+		}
+
+		/** Encode the T3324 value closest to active as a GPRS timer 2 octet,
+		 *  the unit being in bits 8 to 6 and the multiples in bits 5 to 1
+		 * 
+		 * @param active Requested T3324 timer value
+		 * @return Encoded timer value
+		 */
+		static constexpr uint8_t active_time_octet(std::chrono::seconds active)
+		{
+			return timer_octet(T3324_TABLE, sizeof(T3324_TABLE) / sizeof(T3324_TABLE[0]), active.count());
+		}
+
+		/** Convert T3412 timer units and multiples to seconds
+		 * 
+		 * @param unit T3412 timer unit
+		 * @param multiples Multiples of unit
+		 * @return Timer value in seconds, UINT32_MAX if deactivated or invalid
+		 */
+		static constexpr uint32_t tau_timer_seconds(T3412_units unit, uint8_t multiples)
+		{
+			return unit < T3412_units::DEACT ? T3412_TABLE[(int)unit].seconds * (multiples & 0x1F) : UINT32_MAX;
+		}
+
+		/** Convert a T3412 GPRS timer 3 octet to seconds
+		 * 
+		 * @param octet Encoded timer value
+		 * @return Timer value in seconds, UINT32_MAX if deactivated or invalid
+		 */
+		static constexpr uint32_t tau_timer_seconds(uint8_t octet)
+		{
+			return tau_timer_seconds(T3412_UNITS[octet >> 5], octet);
+		}
+
+		/** Convert T3324 timer units and multiples to seconds
+		 * 
+		 * @param unit T3324 timer unit
+		 * @param multiples Multiples of unit
+		 * @return Timer value in seconds, 0 if deactivated or invalid
+		 */
+		static constexpr uint32_t active_time_seconds(T3324_units unit, uint8_t multiples)
+		{
+			return unit < T3324_units::DEACT ? T3324_TABLE[(int)unit].seconds * (multiples & 0x1F) : 0;
+		}
+
+		/** Convert a T3324 GPRS timer 2 octet to seconds
+		 * 
+		 * @param octet Encoded timer value
+		 * @return Timer value in seconds, 0 if deactivated or invalid
+		 */
+		static constexpr uint32_t active_time_seconds(uint8_t octet)
+		{
+			return active_time_seconds(T3324_UNITS[octet >> 5], octet);
+		}
+
 
 	private:
 
-		/** Convert decimal number (with max value of 5-bits) to a binary string,
-		 *  i.e. 10 = "01010"
+		/** Value of _coap_loaded_profile when no profile is known to be loaded
+		 */
+		static const int NO_COAP_PROFILE = -1;
+
+		/** Write an endpoint into a CoAP profile of the module and save it
+		 *
+		 * @param profile CoAP profile to write
+		 * @param *ipv4 Pointer to IPv4 address string
+		 * @param port Destination server port
+		 * @param *uri Pointer to URI
+		 * @param uri_length Number of characters in URI
+		 * @return Indicates success or failure reason
+		 */
+		int write_coap_profile(int profile, char *ipv4, uint16_t port, char *uri, uint8_t uri_length);
+
+		/** A single step of an AT batch. Only the arguments used by command 
+		 *  are set, text and value are copied by the driver when issued
+		 */
+		struct TP_AT_Step
+		{
+			TP_AT_Command command;
+			int value;
+			int option;
+			char *text;
+		};
+
+		/** Run a batch of commands, stopping at the first to fail. When 
+		 *  TP_NBIOT_AT_PIPELINE is set the commands are written back to back 
+		 *  and their responses matched in order. The outcome is kept for 
+		 *  get_at_batch_report()
 		 * 
-		 * @param multiples Decimal value to convert to binary
-		 * @param *binary Pointer to a char array to which to return 
-		 *                the binary string
+		 * @param *steps Pointer to the steps of the batch
+		 * @param count Number of steps, no greater than TP_NBIOT_AT_BATCH_MAX
+		 * @return Indicates success or status of the first command to fail
+		 */
+		int run_at_batch(const TP_AT_Step *steps, uint8_t count);
+
+		/** Transient buffers, see TP_NBIOT_SCRATCH. A timer string holds an
+		 *  8 bit timer octet as a null terminated binary string
+		 */
+		typedef char TP_URC_Line[48];
+		typedef char TP_Timer_String[10];
+		typedef uint8_t TP_Discard_Buffer[32];
+		typedef TP_AT_Step TP_AT_Batch[TP_NBIOT_AT_BATCH_MAX];
+
+		#if TP_NBIOT_STATIC_MEMORY
+			/** Transient buffers held in the interface. Each is only used by 
+			 *  one call at a time, timer[0] for T3412 and timer[1] for T3324
+			 */
+			struct TP_Scratch
+			{
+				TP_URC_Line urc_line;
+				TP_Timer_String timer[2];
+				TP_Discard_Buffer discard;
+				TP_AT_Batch steps;
+				TP_Nuestats_Radio radio;
+				TP_Nuestats_BLER bler;
+			};
+		#endif /* #if TP_NBIOT_STATIC_MEMORY */
+
+		/** Issue a single command of an AT batch
+		 * 
+		 * @param &step Address of the step to issue
+		 * @return Indicates success or failure reason
+		 */
+		int issue_at_step(const TP_AT_Step &step);
+
+		/** Does a cached endpoint match a given IP address, port and URI?
+		 *
+		 * @param &endpoint Cached endpoint
+		 * @param *ipv4 Pointer to IPv4 address string
+		 * @param port Destination server port
+		 * @param *uri Pointer to URI
+		 * @param uri_length Number of characters in URI
+		 * @return True if all three match
+		 */
+		static bool endpoint_matches(const TP_CoAP_Endpoint &endpoint, const char *ipv4, uint16_t port, 
+									 const char *uri, uint8_t uri_length);
+
+		/** Record the IP address, port and URI held by a CoAP profile
+		 *
+		 * @param &endpoint Cached endpoint to fill
+		 * @param *ipv4 Pointer to IPv4 address string
+		 * @param port Destination server port
+		 * @param *uri Pointer to URI
+		 * @param uri_length Number of characters in URI
 		 * @return None
 		 */
-		void dec_to_bin_5_bit(uint8_t multiples, char *binary);
+		static void endpoint_set(TP_CoAP_Endpoint &endpoint, const char *ipv4, uint16_t port, 
+								 const char *uri, uint8_t uri_length);
+
+		/** FNV-1a hash of the IP address, port and URI of an endpoint, by 
+		 *  which a saved attach context identifies the endpoint of a profile
+		 *
+		 * @param *ipv4 Pointer to IPv4 address string
+		 * @param port Destination server port
+		 * @param *uri Pointer to URI
+		 * @param uri_length Number of characters in URI
+		 * @return Hash
+		 */
+		static uint32_t endpoint_hash(const char *ipv4, uint16_t port, const char *uri, uint8_t uri_length);
+
+		/** Does a profile hold an endpoint restored by resume() that matches
+		 *  a given IP address, port and URI? If so it is taken back into the
+		 *  endpoint cache
+		 *
+		 * @param profile CoAP profile
+		 * @param *ipv4 Pointer to IPv4 address string
+		 * @param port Destination server port
+		 * @param *uri Pointer to URI
+		 * @param uri_length Number of characters in URI
+		 * @return True if the profile holds the endpoint
+		 */
+		bool endpoint_revalidate(int profile, const char *ipv4, uint16_t port, const char *uri, uint8_t uri_length);
+
+		/** FNV-1a checksum of an attach context, excluding the checksum itself
+		 *
+		 * @param &context Attach context
+		 * @return Checksum
+		 */
+		static uint32_t attach_context_checksum(const TP_Attach_Context &context);
+
+		/** Identifies a TP_Attach_Context written by this version of the interface
+		 */
+		static const uint32_t ATTACH_CONTEXT_MAGIC = 0x54504E05;
+
+		/** Is a baud rate accepted by AT+NATSPEED?
+		 * 
+		 * @param baud Baud rate
+		 * @return True if supported
+		 */
+		static bool link_baud_supported(uint32_t baud);
+
+		#if TP_NBIOT_DRIVER_LINK_SPEED
+			/** Set the flow control mode of module and MCU. Enabled on the module
+			 *  first and disabled on the MCU first, so that the MCU never waits
+			 *  on a CTS line the module isn't driving
+			 * 
+			 * @param flow_control Flow control mode
+			 * @return Indicates success or failure reason
+			 */
+			int link_flow_control(TP_Flow_Control flow_control);
+
+			/** Check that the module answers at the rate the MCU is set to, 
+			 *  allowing TP_NBIOT_LINK_VERIFY_ATTEMPTS attempts
+			 * 
+			 * @return Indicates success or failure reason
+			 */
+			int link_verify();
+		#endif /* #if TP_NBIOT_DRIVER_LINK_SPEED */
+
+		/** _urc_flags values
+		 */
+		static const uint32_t URC_FLAG_UART_ACTIVITY = (1UL << 0);
+		static const uint32_t URC_FLAG_STATE_CHANGED = (1UL << 1);
+		static const uint32_t URC_FLAG_SOCKET_DATA   = (1UL << 2);
+
+		/** Map radio connection, network registration and PSM status onto
+		 *  the u-blox defined connection status
+		 * 
+		 * @param connected Radio connection status
+		 * @param registered Network registration status
+		 * @param psm PSM status
+		 * @return u-blox defined connection status
+		 */
+		static TP_Connection_Status derive_connection_status(int connected, int registered, int psm);
+
+		/** Is the given connection status one in which the module is registered
+		 *  to the network?
+		 * 
+		 * @param status u-blox defined connection status
+		 * @return True if registered
+		 */
+		static bool is_registered(TP_Connection_Status status);
+
+		/** Wait for the module to register to the network, either by waiting
+		 *  for URCs or, if they are not enabled, by polling
+		 * 
+		 * @param timeout_s Timeout period in seconds
+		 * @return Indicates success or failure reason
+		 */
+		int wait_for_registration(uint16_t timeout_s);
+
+		/** Re-derive the connection status of the snapshot from its connected,
+		 *  registered and psm values and mark it as confirmed now
+		 * 
+		 * @return None
+		 */
+		void snapshot_confirm();
+
+		/** Copy the working snapshot to the one read by get_connection_snapshot().
+		 *  The copy is brief so is made with interrupts masked rather than under
+		 *  the lock, which may be held for a whole upload
+		 * 
+		 * @return None
+		 */
+		void snapshot_publish();
+
+		/** Is the cached connection state no older than max_age_ms?
+		 * 
+		 * @param &snapshot Snapshot to check
+		 * @param max_age_ms Maximum age in milliseconds
+		 * @return True if the snapshot may be used
+		 */
+		bool snapshot_is_fresh(const TP_Connection_Snapshot &snapshot, uint32_t max_age_ms);
+
+		/** Forget URC state, i.e. because the modem has been reset and
+		 *  has disabled URCs
+		 * 
+		 * @return None
+		 */
+		void urc_reset();
+
+		#if TP_NBIOT_DRIVER_URCS
+			/** Called from UART interrupt context whenever data is received from modem
+			 * 
+			 * @return None
+			 */
+			void urc_sigio();
+
+			/** Out-of-band handlers for +CSCON, +CEREG and +NPSMR. Both the URC and
+			 *  query response formats are accepted
+			 * 
+			 * @return None
+			 */
+			void urc_cscon();
+			void urc_cereg();
+			void urc_npsmr();
+		#endif /* #if TP_NBIOT_DRIVER_URCS */
+
+		#if TP_NBIOT_DRIVER_SOCKETS
+			/** Out-of-band handler for +NSONMI, recording the bytes waiting
+			 * 
+			 * @return None
+			 */
+			void urc_nsonmi();
 
+			/** Read from a socket with AT+NSORF, accounting for the bytes read
+			 *
+			 * @param socket Socket number
+			 * @param *recv_buf Pointer to a byte array into which to read
+			 * @param recv_cap Capacity of recv_buf in bytes
+			 * @param &recv_len Address of size_t in which to store the number of 
+			 *                  bytes read
+			 * @param *ipv4 Pointer to a char array of at least 16 bytes in which to
+			 *              store the source IPv4 address
+			 * @param &port Address of uint16_t in which to store the source port
+			 * @param &remaining Address of size_t in which to store the number of 
+			 *                   bytes of the datagram left unread
+			 * @return Indicates success or failure reason
+			 */
+			int socket_read(int socket, uint8_t *recv_buf, size_t recv_cap, size_t &recv_len,
+							char *ipv4, uint16_t &port, size_t &remaining);
+
+			/** Forget open sockets and waiting data, i.e. because the modem has
+			 *  been reset
+			 * 
+			 * @return None
+			 */
+			void socket_reset();
+
+			/** Attach the +NSONMI out-of-band handler if it isn't already
+			 * 
+			 * @return None
+			 */
+			void socket_oob_attach();
+
+			/** Is socket a socket number opened by socket_open()?
+			 * 
+			 * @param socket Socket number
+			 * @return True if open
+			 */
+			bool socket_is_open(int socket);
+		#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+		#if TP_NBIOT_DRIVER_URCS
+			/** Read the remainder of a URC and return its first and, if present,
+			 *  second integer fields
+			 * 
+			 * @param &first Address of integer in which to store first field
+			 * @param &second Address of integer in which to store second field,
+			 *                untouched if not present
+			 * @return Number of integer fields parsed
+			 */
+			int urc_read_fields(int &first, int &second);
+		#endif /* #if TP_NBIOT_DRIVER_URCS */
+
+		/** Ensure that the CoAP profile is loaded and the CoAP AT interface
+		 *  is selected before a CoAP request. Each step is only performed if
+		 *  the modem state is not already known to be correct
+		 *
+		 * @param uplink Whether the request carries a payload, i.e. counts as
+		 *               an uplink for the adaptive PSM controller
+		 * @return Indicates success or failure reason
+		 */
+		int coap_session_begin(bool uplink);
+
+		/** Ensure that a CoAP profile is loaded and the CoAP AT interface
+		 *  is selected before a CoAP request to that profile, leaving the
+		 *  selected profile as is
+		 *
+		 * @param uplink Whether the request carries a payload, i.e. counts as
+		 *               an uplink for the adaptive PSM controller
+		 * @param profile CoAP profile to load
+		 * @return Indicates success or failure reason
+		 */
+		int coap_session_begin(bool uplink, int profile);
+
+		/** Return the CoAP profile of an endpoint handle passed to a request
+		 * 
+		 * @param endpoint Endpoint handle returned by register_endpoint() or
+		 *                 SELECTED_ENDPOINT
+		 * @param &profile Address of integer in which to store the profile
+		 * @return Indicates success or failure reason, INVALID_ENDPOINT if 
+		 *         the handle isn't registered
+		 */
+		int endpoint_profile(int endpoint, int &profile);
+
+		/** Forget which CoAP profile is loaded and whether the CoAP AT
+		 *  interface is selected, forcing both to be set up again before
+		 *  the next CoAP request
+		 *
+		 * @return None
+		 */
+		void coap_session_reset();
+
+		/** Position within a chain of TP_CoAP_Buffer elements being uploaded
+		 *  by coap_post_stream(), one per upload
+		 */
+		struct TP_CoAP_Chain_Cursor
+		{
+			TP_CoAP_Buffer *buffer;
+			size_t offset;
+
+			/** TP_CoAP_Block_Reader used to walk the chain
+			 *
+			 * @param *&block Address of pointer to set to the start of the block
+			 * @param max_length Block size
+			 * @return Number of bytes in the block
+			 */
+			size_t read(uint8_t *&block, size_t max_length);
+		};
+
+		#if TP_NBIOT_ASYNC
+			/** Request queued for the modem worker thread
+			 */
+			struct TP_Async_Request
+			{
+				uint32_t handle;
+				TP_Async_Operation operation;
+				uint8_t *send_data;
+				size_t buffer_len;
+				char *recv_data;
+				int data_indentifier;
+				uint8_t send_block_number;
+				uint8_t send_more_block;
+				uint16_t timeout_s;
+				int profile;
+				TP_Async_Callback cb;
+
+				#if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0
+					uint8_t payload[TP_NBIOT_ASYNC_PAYLOAD_SIZE];
+				#endif /* #if TP_NBIOT_ASYNC_PAYLOAD_SIZE > 0 */
+			};
+
+			/** Allocate a request from the pool and initialise its common fields
+			 * 
+			 * @param operation Operation to perform
+			 * @param cb Callback to be called on completion
+			 * @return Pointer to request or NULL if the pool is exhausted
+			 */
+			TP_Async_Request *async_alloc(TP_Async_Operation operation, TP_Async_Callback cb);
+
+			/** Serve a queued CoAP request on the endpoint it was queued for.
+			 *  The selection is swapped for the request under the interface
+			 *  lock, so other threads never see it
+			 * 
+			 * @param *request Pointer to request taken from the queue
+			 * @param &response_code Address of integer where CoAP operation 
+			 *                       response code will be stored
+			 * @return Indicates success or failure reason
+			 */
+			int async_coap(TP_Async_Request *request, int &response_code);
+
+			/** Start the worker thread if necessary and queue the request. The
+			 *  pool, queue and handle counter are safe to use from any thread, so
+			 *  requests are queued without waiting for the interface lock, which 
+			 *  the worker may hold for as long as a request takes
+			 * 
+			 * @param *request Pointer to request allocated by async_alloc()
+			 * @param &handle Address of integer in which to store the request handle
+			 * @return Indicates success or failure reason
+			 */
+			int async_submit(TP_Async_Request *request, uint32_t &handle);
+
+			/** Start the worker thread if it isn't running
+			 * 
+			 * @return Indicates success or failure reason
+			 */
+			int async_start();
+
+			#if TP_NBIOT_DRIVER_SOCKETS
+				/** Wake the worker thread to read downlinks, at most once until it
+				 *  has done so. Safe to call from interrupt context
+				 * 
+				 * @return None
+				 */
+				void downlink_notify();
+
+				/** Called once the UART has been quiet for 
+				 *  TP_NBIOT_DOWNLINK_SETTLE_MS after activity, waking the worker
+				 *  to dispatch any +NSONMI nobody else has. Called from interrupt
+				 *  context
+				 * 
+				 * @return None
+				 */
+				void downlink_settled();
+
+				/** Read announced downlinks into the pool and deliver them. Run by
+				 *  the worker thread
+				 * 
+				 * @return None
+				 */
+				void downlink_drain();
+
+				/** Read a single datagram into a downlink, discarding whatever
+				 *  does not fit
+				 * 
+				 * @param socket Socket number
+				 * @param &downlink Address of TP_Downlink in which to store it
+				 * @return Indicates success or failure reason, NO_DATA if nothing
+				 *         was waiting
+				 */
+				int downlink_read(int socket, TP_Downlink &downlink);
+			#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+			/** Modem worker thread, serves queued requests in order
+			 * 
+			 * @return None
+			 */
+			void async_worker();
+		#endif /* #if TP_NBIOT_ASYNC */
+
+		/** UE configuration flags, one per AT+NCONFIG setting
+		 */
+		enum
+		{
+			UE_AUTOCONNECT      = (1 << 0),
+			UE_SCRAMBLING       = (1 << 1),
+			UE_SI_AVOID         = (1 << 2),
+			UE_COMBINE_ATTACH   = (1 << 3),
+			UE_CELL_RESELECTION = (1 << 4),
+			UE_BIP              = (1 << 5),
+			UE_SIM_PSM          = (1 << 6),
+			UE_ALL              = 0x7F
+		};
+
+		/** Size of the buffer into which AT+NCONFIG? is read
+		 */
+		static const size_t NCONFIG_BUFFER_SIZE = 384;
+
+		/** Read the current AT+NCONFIG settings of the module. Settings 
+		 *  missing from the response, i.e. because it was truncated, are 
+		 *  left out of known rather than assumed FALSE
+		 * 
+		 * @param &flags Address of integer in which to store the UE_*
+		 *               flags of settings that are TRUE
+		 * @param &known Address of integer in which to store the UE_*
+		 *               flags of settings that were read
+		 * @return Indicates success or failure reason, INVALID_RESPONSE
+		 *         unless every setting was read and NOT_SUPPORTED if built 
+		 *         without TP_NBIOT_DRIVER_NCONFIG
+		 */
+		int read_ue_configuration(uint8_t &flags, uint8_t &known);
+
+		/** Write every UE setting in mask that differs from the cached state
+		 *  of the module, or every setting in mask if the state is unknown,
+		 *  then reboot once if requested and anything was written. Settings
+		 *  outside mask are never written
+		 * 
+		 * @param desired UE_* flags of the settings that should be TRUE
+		 * @param mask UE_* flags of the settings to write
+		 * @param reboot Reboot the modem if any setting was written
+		 * @param &changed Address of bool set to true if any setting was written
+		 * @return Indicates success or failure reason
+		 */
+		int apply_ue_flags(uint8_t desired, uint8_t mask, bool reboot, bool &changed);
+
+		/** Return the UE_* flags of the settings that are TRUE, from the
+		 *  cached state if every setting is known or otherwise by reading it
+		 *  from the module, retrying a failed read once. Settings that have
+		 *  been written stay known if the read fails, i.e. without 
+		 *  TP_NBIOT_DRIVER_NCONFIG
+		 * 
+		 * @param &flags Address of integer in which to store flags
+		 * @param &known Address of integer in which to store the UE_* flags
+		 *               of settings whose state is known
+		 * @return Indicates success or failure reason, INVALID_RESPONSE 
+		 *         unless every setting is known
+		 */
+		int ue_config_current(uint8_t &flags, uint8_t &known);
+
+		/** Record a setting that has been successfully written
+		 * 
+		 * @param flag UE_* flag of setting
+		 * @param enable Value written
+		 * @return None
+		 */
+		void ue_config_cache(uint8_t flag, bool enable);
+
+		/** Convert TP_UE_Config to UE_* flags
+		 * 
+		 * @param &config Address of TP_UE_Config to convert
+		 * @return UE_* flags of the settings that are TRUE
+		 */
+		static uint8_t ue_config_to_flags(const TP_UE_Config &config);
+
+		/** Write a single AT+NCONFIG setting, retrying once on failure
+		 * 
+		 * @param flag UE_* flag of setting to write
+		 * @param enable Value to write
+		 * @return Indicates success or failure reason
+		 */
+		int write_ue_configuration(uint8_t flag, bool enable);
+
+		/** Configure the settings required by start() and reboot if necessary,
+		 *  only writing those that differ from the current configuration
+		 * 
+		 * @return Indicates success or failure reason
+		 */
+		int start_configure();
+
+		#if TP_NBIOT_BATCHING
+			/** Work out when the batch begun by a record appended now must be flushed
+			 * 
+			 * @return Deadline in Kernel::get_ms_count() time
+			 */
+			uint64_t batch_deadline();
+		#endif /* #if TP_NBIOT_BATCHING */
+
+		#if TP_NBIOT_PERF_TRACE
+			/** Traces the operation in whose scope it is constructed, recording
+			 *  the value of result as it stands when the scope ends
+			 */
+			class TP_Perf_Scope
+			{
+				public:
+					TP_Perf_Scope(TP_NBIoT_Interface &interface, TP_Perf_Operation operation, int &result);
+					~TP_Perf_Scope();
+
+				private:
+					TP_NBIoT_Interface &_interface;
+					TP_Perf_Operation _operation;
+					int &_result;
+					uint64_t _start_ms;
+					uint32_t _at_commands;
+					uint32_t _uart_tx_bytes;
+					uint32_t _uart_rx_bytes;
+			};
+
+			/** Add a completed record to the ring and totals
+			 * 
+			 * @param &record Address of completed record
+			 * @return None
+			 */
+			void perf_record(const TP_Perf_Record &record);
+		#endif /* #if TP_NBIOT_PERF_TRACE */
+
+		#if TP_NBIOT_STATS
+			/** Credit the time since the last call to the current connection
+			 *  status. Called before the status changes
+			 * 
+			 * @return None
+			 */
+			void stats_note_status();
+
+			/** Count a CoAP request
+			 * 
+			 * @param status Status returned by the driver
+			 * @param response_code CoAP response code, valid if status is NBIOT_OK
+			 * @param sent Number of bytes sent
+			 * @param received Number of bytes received
+			 * @return None
+			 */
+			void stats_note_coap(int status, int response_code, size_t sent, size_t received);
+
+			/** Count bytes sent and received
+			 * 
+			 * @param sent Number of bytes sent
+			 * @param received Number of bytes received
+			 * @return None
+			 */
+			void stats_note_traffic(size_t sent, size_t received);
+
+			/** Add NUESTATS values to the distributions
+			 * 
+			 * @param type NUESTATS category
+			 * @param *values Pointer to the parsed values of that category
+			 * @return None
+			 */
+			void stats_note_nuestats(TP_Nuestats_Type type, const void *values);
+
+			/** Index of the bucket of a distribution that a sample falls into
+			 * 
+			 * @param value Sample
+			 * @param *edges Pointer to the STATS_BUCKETS - 1 ascending bucket edges
+			 * @return Bucket index
+			 */
+			static size_t stats_bucket(int32_t value, const int32_t *edges);
+
+			/** Write an unsigned LEB128 varint
+			 * 
+			 * @param *buffer Pointer to buffer
+			 * @param &length Address of size_t holding the current length, advanced
+			 * @param value Value
+			 * @return None
+			 */
+			static void write_varint(uint8_t *buffer, size_t &length, uint32_t value);
+		#endif /* #if TP_NBIOT_STATS */
+
+		/** Name of a NUESTATS value and the offset of the 32-bit field it is
+		 *  stored in
+		 */
+		struct TP_Nuestats_Field
+		{
+			const char *name;
+			size_t offset;
+		};
+
+		/** Field tables of the named value NUESTATS categories
+		 */
+		static const TP_Nuestats_Field NUESTATS_RADIO_FIELDS[];
+		static const TP_Nuestats_Field NUESTATS_BLER_FIELDS[];
+		static const TP_Nuestats_Field NUESTATS_THP_FIELDS[];
+		static const TP_Nuestats_Field NUESTATS_APPSMEM_FIELDS[];
+
+		/** Query a single NUESTATS category, parsing each line of the 
+		 *  response as it arrives into target
+		 * 
+		 * @param type NUESTATS category
+		 * @param *target Pointer to the TP_Nuestats_* struct of type
+		 * @return Indicates success or failure reason
+		 */
+		int query_nuestats(TP_Nuestats_Type type, void *target);
+
+		/** Parse one line of a NUESTATS response into _nuestats_target
+		 * 
+		 * @param *line Pointer to null terminated line
+		 * @return None
+		 */
+		void nuestats_line(const char *line);
+
+		/** Perform a single recovery step and wait for registration
+		 * 
+		 * @param step Recovery step
+		 * @param timeout_s Timeout period in seconds
+		 * @return Indicates success or failure reason
+		 */
+		int recovery_step(TP_Recovery_Step step, uint16_t timeout_s);
+
+		/** Sleep between recovery steps, waking early if URCs report that
+		 *  the module has registered. Called without the interface lock, 
+		 *  which is taken only to read URCs
+		 * 
+		 * @param backoff_ms Time to sleep in milliseconds
+		 * @return True if the module registered meanwhile
+		 */
+		bool recovery_backoff(uint32_t backoff_ms);
+
+		/** Find the recovery history of a cell, replacing the least recently
+		 *  used entry if it has none
+		 * 
+		 * @param cell_id Cell ID
+		 * @return Reference to the history entry
+		 */
+		TP_Recovery_Cell &recovery_cell(uint32_t cell_id);
+
+		/** Map an EARFCN onto its band
+		 * 
+		 * @param earfcn LTE channel number
+		 * @return Band
+		 */
+		static TP_NBIoT_Band band_from_earfcn(int earfcn);
+
+		/** Read the T3412 and T3324 values in use into _t3412_s and _t3324_s
+		 * 
+		 * @return Indicates success or failure reason
+		 */
+		int read_psm_timers();
+
+		/** Record an uplink for the adaptive PSM controller
+		 * 
+		 * @return None
+		 */
+		void psm_note_uplink();
+
+		/** Is the module known to be in PSM? Only known if URCs are enabled
+		 * 
+		 * @return True if in PSM
+		 */
+		bool modem_in_psm();
+
+		/** Run queries deferred while the module was in PSM, refreshing the
+		 *  snapshot. Called whenever the module is awake anyway
+		 * 
+		 * @return None
+		 */
+		void run_deferred_queries();
+
+		/** Let traffic of the given priority through the coverage gate, or not
+		 * 
+		 * @param priority Traffic priority
+		 * @return NBIOT_OK to send or COVERAGE_DEFERRED to hold
+		 */
+		int coverage_gate(TP_Traffic_Priority priority);
+
+		/** Measure radio conditions for the coverage gate
+		 * 
+		 * @return Indicates success or failure reason
+		 */
+		int coverage_measure();
+
+		/** _deferred_queries values
+		 */
+		static const uint8_t DEFERRED_CSQ      = (1U << 0);
+		static const uint8_t DEFERRED_BAND     = (1U << 1);
+		static const uint8_t DEFERRED_COVERAGE = (1U << 2);
+		static const uint8_t DEFERRED_RADIO    = (1U << 3);
+		static const uint8_t DEFERRED_PSM      = (1U << 4);
+
+		/** Expected energy spent per uplink for given timer values
+		 * 
+		 * @param interval_s Time between uplinks
+		 * @param active_s T3324 value
+		 * @param tau_s T3412 value, UINT32_MAX if deactivated
+		 * @param coverage Cost of a second awake relative to good coverage
+		 * @return Cost in seconds awake in idle mode in good coverage
+		 */
+		static uint64_t psm_uplink_cost(uint32_t interval_s, uint32_t active_s, uint32_t tau_s, uint32_t coverage);
+
+		/** Encoding of a timer unit, indexed by T3412_units or T3324_units
+		 */
+		struct TP_Timer_Unit
+		{
+			uint8_t code;
+			uint32_t seconds;
+		};
+
+		/** T3412 (GPRS timer 3) unit codes and lengths, 0 seconds if deactivated
+		 */
+		static constexpr TP_Timer_Unit T3412_TABLE[] =
+		{
+			{ 0x06, 320UL * 3600UL }, // HR_320
+			{ 0x02, 10UL * 3600UL },  // HR_10
+			{ 0x01, 3600UL },         // HR_1
+			{ 0x00, 600UL },          // MIN_10
+			{ 0x05, 60UL },           // MIN_1
+			{ 0x04, 30UL },           // SEC_30
+			{ 0x03, 2UL },            // SEC_2
+			{ 0x07, 0UL }             // DEACT
+		};
+
+		/** T3324 (GPRS timer 2) unit codes and lengths, 0 seconds if deactivated
+		 */
+		static constexpr TP_Timer_Unit T3324_TABLE[] =
+		{
+			{ 0x02, 360UL },          // MIN_6
+			{ 0x01, 60UL },           // MIN_1
+			{ 0x00, 2UL },            // SEC_2
+			{ 0x07, 0UL }             // DEACT
+		};
+
+		/** T3412 units indexed by unit code
+		 */
+		static constexpr T3412_units T3412_UNITS[8] =
+		{
+			T3412_units::MIN_10, T3412_units::HR_1, T3412_units::HR_10, T3412_units::SEC_2,
+			T3412_units::SEC_30, T3412_units::MIN_1, T3412_units::HR_320, T3412_units::DEACT
+		};
+
+		/** T3324 units indexed by unit code, codes 3 to 6 being treated as
+		 *  MIN_1 as required by 3GPP TS 24.008 
+		 */
+		static constexpr T3324_units T3324_UNITS[8] =
+		{
+			T3324_units::SEC_2, T3324_units::MIN_1, T3324_units::MIN_6, T3324_units::MIN_1,
+			T3324_units::MIN_1, T3324_units::MIN_1, T3324_units::MIN_1, T3324_units::DEACT
+		};
+
+		/** Find the closest encoding of seconds in a timer unit table. Units 
+		 *  are tried from the finest so ties resolve to the finest unit
+		 * 
+		 * @param *table Pointer to T3412_TABLE or T3324_TABLE
+		 * @param size Number of entries in table
+		 * @param seconds Requested timer value
+		 * @return Encoded timer value
+		 */
+		static constexpr uint8_t timer_octet(const TP_Timer_Unit *table, size_t size, int64_t seconds)
+		{
+			uint8_t octet = 0;
+			int64_t best_error = INT64_MAX;
+
+			if(seconds < 0)
+			{
+				seconds = 0;
+			}
+
+			for(size_t i = size; i > 0; i--)
+			{
+				const TP_Timer_Unit &unit = table[i - 1];
+				if(unit.seconds == 0)
+				{
+					continue;
+				}
+
+				int64_t multiples = (seconds + unit.seconds / 2) / unit.seconds;
+				if(multiples > 31)
+				{
+					multiples = 31;
+				}
+
+				int64_t error = seconds - multiples * (int64_t)unit.seconds;
+				if(error < 0)
+				{
+					error = -error;
+				}
+
+				if(error < best_error)
+				{
+					best_error = error;
+					octet = (uint8_t)((unit.code << 5) | multiples);
+				}
+			}
+
+			return octet;
+		}
+
+		/** Write a timer octet as the bit string expected by the driver, 
+		 *  i.e. 0x2A = "00101010"
+		 * 
+		 * @param octet Encoded timer value
+		 * @param *timer Pointer to a char array of at least 9 bytes
+		 * @return None
+		 */
+		static void timer_octet_to_string(uint8_t octet, char *timer);
+
+		/** Parse the bit string returned by the driver into a timer octet
+		 * 
+		 * @param *timer Pointer to bit string
+		 * @param &octet Address of uint8_t in which to store encoded timer value
+		 * @return Indicates success or failure reason
+		 */
+		static int timer_string_to_octet(const char *timer, uint8_t &octet);
+
+		/** Write an encoded T3412 value to the module
+		 * 
+		 * @param octet T3412 value encoded as a GPRS timer 3 octet
+		 * @return Indicates success or failure reason
+		 */
+		int write_tau_timer(uint8_t octet);
+
+		/** Write an encoded T3324 value to the module
+		 * 
+		 * @param octet T3324 value encoded as a GPRS timer 2 octet
+		 * @return Indicates success or failure reason
+		 */
+		int write_active_time(uint8_t octet);
+
+		/** The driver is fixed at compile time by _COMMS_NBIOT_DRIVER, so 
+		 *  _driver is a constant expression rather than a member set by the
+		 *  constructor. The if(_driver == ...) checks and DRIVER_UNKNOWN 
+		 *  fallbacks of each method are kept as they are. Support for another
+		 *  module is added with a further #elif providing its own _modem and
+		 *  _driver
+		 */
 		#if _COMMS_NBIOT_DRIVER == COMMS_DRIVER_SARAN2
 			SaraN2 _modem;
-			int _driver = TP_NBIoT_Interface::SARAN2;
+			static constexpr int _driver = TP_NBIoT_Interface::SARAN2;
 		#else
-			int _driver = TP_NBIoT_Interface::UNDEFINED;
+			static constexpr int _driver = TP_NBIoT_Interface::UNDEFINED;
 		#endif /* #if _COMMS_NBIOT_DRIVER == COMMS_DRIVER_SARAN2 */
-};
\ No newline at end of file
+
+		/** CoAP session state. Cleared on reboot, reconfiguration, failed
+		 *  CoAP requests and whenever the modem appears to have been reset
+		 */
+		int _coap_loaded_profile = TP_NBIoT_Interface::NO_COAP_PROFILE;
+		bool _coap_interface_selected = false;
+
+		/** CoAP endpoint cache. Bit n of _coap_endpoints_used is set while 
+		 *  profile n holds _coap_endpoints[n] and bit n of 
+		 *  _coap_endpoints_registered while it is held by a handle returned by
+		 *  register_endpoint(). _coap_selected_profile is loaded by the next 
+		 *  CoAP request. Bit n of _coap_endpoints_restored is set while 
+		 *  profile n holds an endpoint known only by the hash in 
+		 *  _coap_restored_hashes[n], as restored by resume()
+		 */
+		TP_CoAP_Endpoint _coap_endpoints[TP_NBIOT_COAP_PROFILES] = {};
+		uint8_t _coap_endpoints_used = 0;
+		uint8_t _coap_endpoints_registered = 0;
+		uint8_t _coap_endpoints_restored = 0;
+		uint32_t _coap_restored_hashes[TP_NBIOT_COAP_PROFILES] = {};
+		int _coap_selected_profile = 0;
+
+		/** URC state. _urc_oob_attached persists across modem reboots as the
+		 *  parser's out-of-band handlers do, _urc_enabled does not. URCs 
+		 *  update _snapshot
+		 */
+		EventFlags _urc_flags;
+		bool _urc_oob_attached = false;
+		bool _urc_enabled = false;
+
+		#if TP_NBIOT_DRIVER_SOCKETS
+			/** UDP socket state. Bit n of _sockets_open is set while socket n is
+			 *  open and _socket_pending[n] holds the bytes announced and not read
+			 */
+			uint8_t _sockets_open = 0;
+			size_t _socket_pending[TP_NBIOT_MAX_SOCKETS] = {};
+			bool _socket_oob_attached = false;
+		#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+
+		/** Cached connection state. _snapshot is only touched under the lock,
+		 *  _snapshot_published is a copy of it for lock-free readers
+		 */
+		TP_Connection_Snapshot _snapshot = {};
+		TP_Connection_Snapshot _snapshot_published = {};
+
+#if TP_NBIOT_THREAD_SAFE
+		/** Serialises public calls. Recursive, so public calls may make
+		 *  other public calls
+		 */
+		Mutex _mutex;
+#endif /* #if TP_NBIOT_THREAD_SAFE */
+
+		/** Last known AT+NCONFIG state, as UE_* flags. A setting in 
+		 *  _ue_config is only used if its flag is in _ue_config_known, i.e.
+		 *  once it has been read from or written to the module
+		 */
+		uint8_t _ue_config = 0;
+		uint8_t _ue_config_known = 0;
+
+		/** Outcome of the last AT batch
+		 */
+		TP_AT_Batch_Report _at_batch = {};
+
+		/** Queries deferred until the module next wakes, as DEFERRED_* flags
+		 */
+		uint8_t _deferred_queries = 0;
+
+		/** Radio status and PSM setting last read from or set on the module,
+		 *  -1 if not known since it was last reset. Answer deferred queries
+		 */
+		int8_t _radio_status = -1;
+		int8_t _power_save_mode = -1;
+
+		/** NUESTATS query in progress
+		 */
+		TP_Nuestats_Type _nuestats_type = TP_Nuestats_Type::RADIO;
+		void *_nuestats_target = NULL;
+		size_t _nuestats_fields = 0;
+
+		/** Connection recovery state. _recovery_cell_id is the serving cell
+		 *  last reported by a RADIO NUESTATS query
+		 */
+		TP_Recovery_Cell _recovery_cells[TP_NBIOT_RECOVERY_CELLS] = {};
+		uint32_t _recovery_cell_id = 0;
+		uint32_t _recovery_sequence = 0;
+		uint32_t _recovery_seed = 0;
+
+		/** Last known T3412 and T3324 values in seconds, as read by 
+		 *  configure_batching() or configure_adaptive_psm() or last written
+		 */
+		uint32_t _t3412_s = UINT32_MAX;
+		uint32_t _t3324_s = 0;
+
+		/** UART link state. _link_baud is the rate in use, _link_boot_baud 
+		 *  the rate the module comes up at after a reboot
+		 */
+		uint32_t _link_baud = 0;
+		uint32_t _link_boot_baud = 0;
+		TP_Flow_Control _link_flow_control = TP_Flow_Control::NONE;
+
+		/** Adaptive PSM state. _psm_interval_ms is a moving average of the time
+		 *  between the _psm_uplinks uplinks seen so far
+		 */
+		TP_Adaptive_PSM_Config _psm_config = {};
+		bool _psm_enabled = false;
+		uint64_t _psm_last_uplink_ms = 0;
+		uint32_t _psm_interval_ms = 0;
+		uint32_t _psm_uplinks = 0;
+
+		/** Radio conditions from the last AT+NUESTATS="RADIO" query, in dBm
+		 *  and dB, weighting time awake for the adaptive PSM controller
+		 */
+		int32_t _psm_rsrp_dbm = 0;
+		int32_t _psm_snr_db = 0;
+		bool _psm_radio_valid = false;
+
+		/** Coverage gate state. The last measurement is kept in _gate_rsrp_dbm
+		 *  and _gate_ecl until _gate_measured is cleared by a +CEREG URC. 
+		 *  Traffic has been held since _gate_held_ms while _gate_holding
+		 */
+		TP_Coverage_Gate_Config _gate_config = {};
+		bool _gate_enabled = false;
+		bool _gate_measured = false;
+		uint64_t _gate_measured_ms = 0;
+		int32_t _gate_rsrp_dbm = 0;
+		int32_t _gate_ecl = 0;
+		bool _gate_holding = false;
+		uint64_t _gate_held_ms = 0;
+
+		#if TP_NBIOT_BATCHING
+			/** Uplink batching state
+			 */
+			uint8_t _batch_buffer[TP_NBIOT_BATCH_BUFFER_SIZE];
+			size_t _batch_length = 0;
+			size_t _batch_threshold = 0;
+			uint32_t _batch_max_latency_s = 0;
+			char *_batch_recv_data = NULL;
+			int _batch_data_indentifier = 0;
+			uint64_t _batch_deadline_ms = 0;
+			bool _batch_started_in_psm = false;
+			int _batch_response_code = 0;
+		#endif /* #if TP_NBIOT_BATCHING */
+
+		#if TP_NBIOT_PERF_TRACE
+			/** Performance trace ring and totals
+			 */
+			TP_Perf_Record _perf_records[TP_NBIOT_PERF_RECORDS];
+			size_t _perf_head = 0;
+			size_t _perf_count = 0;
+			TP_Perf_Counters _perf_totals = {};
+			TP_Perf_Callback _perf_callback;
+		#endif /* #if TP_NBIOT_PERF_TRACE */
+
+		#if TP_NBIOT_STATS
+			/** Statistics. _stats_status_ms is when time in the current connection
+			 *  status was last credited
+			 */
+			TP_Modem_Stats _stats = {};
+			uint64_t _stats_reset_ms = 0;
+			uint64_t _stats_status_ms = 0;
+		#endif /* #if TP_NBIOT_STATS */
+
+		#if TP_NBIOT_ASYNC
+			/** Modem worker thread and its request queue, statically allocated
+			 */
+			MBED_ALIGN(8) unsigned char _worker_stack[TP_NBIOT_WORKER_STACK_SIZE];
+			Thread _worker;
+			Mutex _worker_mutex;
+			bool _worker_started = false;
+			MemoryPool<TP_Async_Request, TP_NBIOT_ASYNC_QUEUE_DEPTH> _async_pool;
+			Queue<TP_Async_Request, TP_NBIOT_ASYNC_QUEUE_DEPTH + 1> _async_queue;
+			uint32_t _async_next_handle = 1;
+			volatile uint32_t _async_pending = 0;
+
+			#if TP_NBIOT_DRIVER_SOCKETS
+				/** Downlink state. _downlink_request is never served, it is queued
+				 *  in the worker's request queue, one deeper than the pool, to wake
+				 *  it while _downlink_queued is set. _downlink_enabled mirrors 
+				 *  _downlink_cb for interrupt context. _downlink_settle runs while
+				 *  _downlink_settling, _downlink_activity_ms being the time of the
+				 *  last UART activity
+				 */
+				TP_Downlink_Callback _downlink_cb;
+				volatile bool _downlink_enabled = false;
+				TP_Async_Request _downlink_request = {};
+				volatile bool _downlink_queued = false;
+				Timeout _downlink_settle;
+				volatile bool _downlink_settling = false;
+				volatile uint32_t _downlink_activity_ms = 0;
+				MemoryPool<TP_Downlink, TP_NBIOT_DOWNLINK_POOL_DEPTH> _downlink_pool;
+			#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+		#endif /* #if TP_NBIOT_ASYNC */
+
+		#if TP_NBIOT_STATIC_MEMORY
+			/** Transient buffers, in place of stack
+			 */
+			TP_Scratch _scratch;
+		#endif /* #if TP_NBIOT_STATIC_MEMORY */
+};
+
+/** Return the RAM held by any interface of this build, broken down 
+ *  by buffer, as a constant expression, e.g. for a static_assert. 
+ *  worker_stack_peak is 0
+ * 
+ * @return Sizes of the interface and its buffers
+ */
+constexpr TP_NBIoT_Interface::TP_RAM_Footprint TP_NBIoT_Interface::ram_footprint()
+{
+	TP_RAM_Footprint footprint = {};
+	footprint.interface = sizeof(TP_NBIoT_Interface);
+	footprint.endpoints = sizeof(_coap_endpoints);
+
+	#if _COMMS_NBIOT_DRIVER == COMMS_DRIVER_SARAN2
+		footprint.driver = sizeof(_modem);
+	#endif /* #if _COMMS_NBIOT_DRIVER == COMMS_DRIVER_SARAN2 */
+
+	#if TP_NBIOT_ASYNC
+		footprint.worker_stack = sizeof(_worker_stack);
+		footprint.async_pool = sizeof(_async_pool) + sizeof(_async_queue);
+
+		#if TP_NBIOT_DRIVER_SOCKETS
+			footprint.downlink_pool = sizeof(_downlink_pool);
+		#endif /* #if TP_NBIOT_DRIVER_SOCKETS */
+	#endif /* #if TP_NBIOT_ASYNC */
+
+	#if TP_NBIOT_BATCHING
+		footprint.batch_buffer = sizeof(_batch_buffer);
+	#endif /* #if TP_NBIOT_BATCHING */
+
+	#if TP_NBIOT_PERF_TRACE
+		footprint.perf_trace = sizeof(_perf_records);
+	#endif /* #if TP_NBIOT_PERF_TRACE */
+
+	#if TP_NBIOT_STATS
+		footprint.stats = sizeof(_stats);
+	#endif /* #if TP_NBIOT_STATS */
+
+	#if TP_NBIOT_STATIC_MEMORY
+		footprint.scratch = sizeof(_scratch);
+	#endif /* #if TP_NBIOT_STATIC_MEMORY */
+
+	return footprint;
+}
\ No newline at end of file
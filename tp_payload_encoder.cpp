@@ -0,0 +1,645 @@
+/**
+  * @file    tp_payload_encoder.cpp
+  * @version 0.5.0
+  * @author  Adam Mitchell
+  * @brief   C++ file of the payload encoding stage used ahead of coap_post(). A SenML
+  *          (RFC 8428) encoder writing CBOR into a caller-supplied arena and a delta
+  *          compressor for repeated sensor frames
+  */
+
+/** Includes
+ */
+#include "tp_payload_encoder.h"
+#include <string.h>
+
+/** CBOR major types
+ */
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT     3
+#define CBOR_ARRAY    4
+#define CBOR_MAP      5
+#define CBOR_SIMPLE   7
+
+/** Constructor for the TP_SenML_Encoder class
+ *
+ * @param *arena Pointer to the buffer into which the pack is written
+ * @param capacity Capacity of arena in bytes
+ */
+TP_SenML_Encoder::TP_SenML_Encoder(uint8_t *arena, size_t capacity) : _arena(arena), _capacity(capacity)
+{
+
+}
+
+/** Start a new pack, discarding anything already written. The base fields
+ *  are written into the first record, so *base_name and *base_unit must
+ *  remain valid until it has been added
+ *
+ * @param *base_name Pointer to null terminated base name, i.e. a device
+ *                   identifier, or NULL
+ * @param base_time Base time in seconds, 0 for none
+ * @param *base_unit Pointer to null terminated base unit, or NULL
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::begin(const char *base_name, int64_t base_time, const char *base_unit)
+{
+	_length = 0;
+	_overflow = false;
+	_records = 0;
+	_base_name = base_name;
+	_base_time = base_time;
+	_base_unit = base_unit;
+
+	/** Placeholder for the array head, written by finish() once the
+	 *  number of records is known
+	 */
+	if(_capacity < 1)
+	{
+		return TP_SenML_Encoder::ENCODER_BUFFER_TOO_SMALL;
+	}
+
+	_length = 1;
+
+	return TP_SenML_Encoder::ENCODER_OK;
+}
+
+/** Add a record with a numeric value
+ *
+ * @param *name Pointer to null terminated name, appended to the base name
+ * @param value Value
+ * @param *unit Pointer to null terminated unit, or NULL
+ * @param time Time relative to the base time in seconds, 0 for none
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::add(const char *name, float value, const char *unit, int32_t time)
+{
+	return add_record(name, unit, time, TP_SenML_Value::FLOAT, value, 0, NULL);
+}
+
+/** Add a record with an integer value
+ *
+ * @param *name Pointer to null terminated name, appended to the base name
+ * @param value Value
+ * @param *unit Pointer to null terminated unit, or NULL
+ * @param time Time relative to the base time in seconds, 0 for none
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::add(const char *name, int32_t value, const char *unit, int32_t time)
+{
+	return add_record(name, unit, time, TP_SenML_Value::INTEGER, 0, value, NULL);
+}
+
+/** Add a record with a boolean value
+ *
+ * @param *name Pointer to null terminated name, appended to the base name
+ * @param value Value
+ * @param time Time relative to the base time in seconds, 0 for none
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::add_bool(const char *name, bool value, int32_t time)
+{
+	return add_record(name, NULL, time, TP_SenML_Value::BOOLEAN, value ? 1 : 0, 0, NULL);
+}
+
+/** Add a record with a string value
+ *
+ * @param *name Pointer to null terminated name, appended to the base name
+ * @param *value Pointer to null terminated value
+ * @param time Time relative to the base time in seconds, 0 for none
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::add_string(const char *name, const char *value, int32_t time)
+{
+	if(value == NULL)
+	{
+		return TP_SenML_Encoder::ENCODER_INVALID;
+	}
+
+	return add_record(name, NULL, time, TP_SenML_Value::STRING, 0, 0, value);
+}
+
+/** Close the pack and describe it for sending
+ *
+ * @param &payload Address of TP_Encoded_Payload in which to store the
+ *                 pack and its data format, DATA_CBOR
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::finish(TP_Encoded_Payload &payload)
+{
+	if(_length == 0)
+	{
+		return TP_SenML_Encoder::ENCODER_INVALID;
+	}
+
+	/** Up to 23 records fit the one byte placeholder, otherwise the
+	 *  records are shifted along to make room for a longer head
+	 */
+	size_t head_length = _records < 24 ? 1 : (_records < 256 ? 2 : 3);
+
+	if(head_length > 1)
+	{
+		if(_capacity - _length < head_length - 1)
+		{
+			return TP_SenML_Encoder::ENCODER_BUFFER_TOO_SMALL;
+		}
+
+		memmove(&_arena[head_length], &_arena[1], _length - 1);
+		_length += head_length - 1;
+	}
+
+	size_t length = _length;
+	_length = 0;
+	_overflow = false;
+	write_head(CBOR_ARRAY, _records);
+	_length = length;
+
+	payload.data = _arena;
+	payload.length = _length;
+	payload.data_identifier = TP_Encoded_Payload::DATA_CBOR;
+
+	return TP_SenML_Encoder::ENCODER_OK;
+}
+
+/** Write one record, rewinding the arena if it does not fit
+ *
+ * @param *name Pointer to null terminated name, or NULL
+ * @param *unit Pointer to null terminated unit, or NULL
+ * @param time Relative time, 0 for none
+ * @param kind Kind of value
+ * @param number Numeric or boolean value
+ * @param integer Integer value
+ * @param *string Pointer to null terminated string value
+ * @return Indicates success or failure reason
+ */
+int TP_SenML_Encoder::add_record(const char *name, const char *unit, int32_t time, TP_SenML_Value kind,
+								 float number, int32_t integer, const char *string)
+{
+	if(_length == 0 || _records == 0xFFFF)
+	{
+		return TP_SenML_Encoder::ENCODER_INVALID;
+	}
+
+	bool first = _records == 0;
+	bool base_name = first && _base_name != NULL;
+	bool base_time = first && _base_time != 0;
+	bool base_unit = first && _base_unit != NULL;
+
+	uint8_t pairs = 1 + (name != NULL) + (unit != NULL) + (time != 0) + base_name + base_time + base_unit;
+
+	size_t start = _length;
+	_overflow = false;
+
+	write_head(CBOR_MAP, pairs);
+
+	if(base_name)
+	{
+		write_int(TP_SenML_Encoder::LABEL_BASE_NAME);
+		write_text(_base_name);
+	}
+
+	if(base_time)
+	{
+		write_int(TP_SenML_Encoder::LABEL_BASE_TIME);
+		write_int(_base_time);
+	}
+
+	if(base_unit)
+	{
+		write_int(TP_SenML_Encoder::LABEL_BASE_UNIT);
+		write_text(_base_unit);
+	}
+
+	if(name != NULL)
+	{
+		write_int(TP_SenML_Encoder::LABEL_NAME);
+		write_text(name);
+	}
+
+	if(unit != NULL)
+	{
+		write_int(TP_SenML_Encoder::LABEL_UNIT);
+		write_text(unit);
+	}
+
+	switch(kind)
+	{
+		case TP_SenML_Value::FLOAT:
+		{
+			write_int(TP_SenML_Encoder::LABEL_VALUE);
+			write_float(number);
+			break;
+		}
+		case TP_SenML_Value::INTEGER:
+		{
+			write_int(TP_SenML_Encoder::LABEL_VALUE);
+			write_int(integer);
+			break;
+		}
+		case TP_SenML_Value::BOOLEAN:
+		{
+			uint8_t simple = number != 0 ? 0xF5 : 0xF4;
+			write_int(TP_SenML_Encoder::LABEL_BOOL_VALUE);
+			write_bytes(&simple, 1);
+			break;
+		}
+		case TP_SenML_Value::STRING:
+		{
+			write_int(TP_SenML_Encoder::LABEL_STRING_VALUE);
+			write_text(string);
+			break;
+		}
+	}
+
+	if(time != 0)
+	{
+		write_int(TP_SenML_Encoder::LABEL_TIME);
+		write_int(time);
+	}
+
+	if(_overflow)
+	{
+		_length = start;
+		return TP_SenML_Encoder::ENCODER_BUFFER_TOO_SMALL;
+	}
+
+	_records++;
+
+	return TP_SenML_Encoder::ENCODER_OK;
+}
+
+/** Write a CBOR initial byte and argument
+ *
+ * @param major CBOR major type
+ * @param value Argument
+ * @return None
+ */
+void TP_SenML_Encoder::write_head(uint8_t major, uint64_t value)
+{
+	uint8_t head[9];
+	size_t length = 1;
+	uint8_t info;
+
+	if(value < 24)
+	{
+		info = (uint8_t)value;
+	}
+	else if(value <= 0xFF)
+	{
+		info = 24;
+		length = 2;
+	}
+	else if(value <= 0xFFFF)
+	{
+		info = 25;
+		length = 3;
+	}
+	else if(value <= 0xFFFFFFFF)
+	{
+		info = 26;
+		length = 5;
+	}
+	else
+	{
+		info = 27;
+		length = 9;
+	}
+
+	head[0] = (uint8_t)((major << 5) | info);
+
+	for(size_t i = 1; i < length; i++)
+	{
+		head[i] = (uint8_t)(value >> (8 * (length - 1 - i)));
+	}
+
+	write_bytes(head, length);
+}
+
+/** Write a CBOR integer
+ *
+ * @param value Value
+ * @return None
+ */
+void TP_SenML_Encoder::write_int(int64_t value)
+{
+	if(value >= 0)
+	{
+		write_head(CBOR_UNSIGNED, (uint64_t)value);
+	}
+	else
+	{
+		write_head(CBOR_NEGATIVE, (uint64_t)(-1 - value));
+	}
+}
+
+/** Write a CBOR text string
+ *
+ * @param *text Pointer to null terminated string
+ * @return None
+ */
+void TP_SenML_Encoder::write_text(const char *text)
+{
+	size_t length = strlen(text);
+
+	write_head(CBOR_TEXT, length);
+	write_bytes((const uint8_t *)text, length);
+}
+
+/** Write a float in the fewest bytes that hold it exactly
+ *
+ * @param value Value
+ * @return None
+ */
+void TP_SenML_Encoder::write_float(float value)
+{
+	if(value >= -2147483648.0f && value < 2147483648.0f && value == (float)(int32_t)value)
+	{
+		write_int((int32_t)value);
+		return;
+	}
+
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = bits >> 31;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	/** Half precision holds normal values with exponents of -14 to 15 and
+	 *  10 bits of mantissa. NaN and infinity are left in single precision
+	 */
+	if(exponent >= -14 && exponent <= 15 && (mantissa & 0x1FFF) == 0)
+	{
+		uint16_t half = (uint16_t)((sign << 15) | ((uint32_t)(exponent + 15) << 10) | (mantissa >> 13));
+		uint8_t encoded[3] = { (CBOR_SIMPLE << 5) | 25, (uint8_t)(half >> 8), (uint8_t)half };
+
+		write_bytes(encoded, sizeof(encoded));
+		return;
+	}
+
+	uint8_t encoded[5] = { (CBOR_SIMPLE << 5) | 26, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16),
+						   (uint8_t)(bits >> 8), (uint8_t)bits };
+
+	write_bytes(encoded, sizeof(encoded));
+}
+
+/** Write raw bytes
+ *
+ * @param *data Pointer to bytes
+ * @param length Number of bytes
+ * @return None
+ */
+void TP_SenML_Encoder::write_bytes(const uint8_t *data, size_t length)
+{
+	if(_overflow || _capacity - _length < length)
+	{
+		_overflow = true;
+		return;
+	}
+
+	memcpy(&_arena[_length], data, length);
+	_length += length;
+}
+
+/** Constructor for the TP_Frame_Compressor class
+ *
+ * @param *reference Pointer to a buffer of max_frame bytes in which the
+ *                   previous frame is kept
+ * @param max_frame Largest frame that will be compressed
+ * @param key_interval Number of frames between key frames, so that a
+ *                     lost uplink is recovered from, 1 for key frames only
+ */
+TP_Frame_Compressor::TP_Frame_Compressor(uint8_t *reference, size_t max_frame, uint8_t key_interval) :
+										 _reference(reference), _max_frame(max_frame),
+										 _key_interval(key_interval == 0 ? 1 : key_interval)
+{
+
+}
+
+/** Forget the previous frame so that the next is sent as a key frame
+ *
+ * @return None
+ */
+void TP_Frame_Compressor::reset()
+{
+	_reference_valid = false;
+	_reference_length = 0;
+	_since_key = 0;
+}
+
+/** Compress a frame
+ *
+ * @param *frame Pointer to frame
+ * @param length Length of frame, no greater than max_frame
+ * @param *out Pointer to buffer into which to write the compressed frame.
+ *             length + 2 bytes is always enough
+ * @param capacity Capacity of out in bytes
+ * @param &payload Address of TP_Encoded_Payload in which to store the
+ *                 compressed frame and its data format, DATA_OCTET_STREAM
+ * @return Indicates success or failure reason
+ */
+int TP_Frame_Compressor::compress(const uint8_t *frame, size_t length, uint8_t *out, size_t capacity,
+								  TP_Encoded_Payload &payload)
+{
+	if(length == 0 || length > _max_frame)
+	{
+		return TP_Frame_Compressor::COMPRESSOR_INVALID_FRAME;
+	}
+
+	if(capacity < 2)
+	{
+		return TP_Frame_Compressor::COMPRESSOR_BUFFER_TOO_SMALL;
+	}
+
+	bool delta = _reference_valid && _reference_length == length && _since_key + 1 < _key_interval;
+	uint8_t type = delta ? TP_Frame_Compressor::FRAME_DELTA : TP_Frame_Compressor::FRAME_KEY;
+
+	/** Only keep the encoding if it is smaller than the frame itself
+	 */
+	size_t limit = capacity - 1 < length ? capacity - 1 : length;
+	size_t encoded = 0;
+
+	if(encode_runs(frame, delta ? _reference : NULL, length, &out[1], limit, encoded) != TP_Frame_Compressor::COMPRESSOR_OK ||
+	   encoded >= length)
+	{
+		if(capacity - 1 < length)
+		{
+			return TP_Frame_Compressor::COMPRESSOR_BUFFER_TOO_SMALL;
+		}
+
+		type = TP_Frame_Compressor::FRAME_RAW;
+		delta = false;
+		memcpy(&out[1], frame, length);
+		encoded = length;
+	}
+
+	out[0] = (uint8_t)(type | (_sequence & 0x3F));
+
+	memcpy(_reference, frame, length);
+	_reference_length = length;
+	_reference_valid = true;
+	_sequence = (_sequence + 1) & 0x3F;
+	_since_key = delta ? _since_key + 1 : 0;
+
+	payload.data = out;
+	payload.length = encoded + 1;
+	payload.data_identifier = TP_Encoded_Payload::DATA_OCTET_STREAM;
+
+	return TP_Frame_Compressor::COMPRESSOR_OK;
+}
+
+/** Decompress a frame produced by compress(), i.e. on the receiving side
+ *  or to check an uplink. Uses the reference buffer in the same way
+ *
+ * @param *in Pointer to compressed frame
+ * @param length Length of compressed frame
+ * @param *frame Pointer to buffer into which to write the frame
+ * @param capacity Capacity of frame in bytes
+ * @param &frame_length Address of size_t in which to store the frame length
+ * @return Indicates success or failure reason
+ */
+int TP_Frame_Compressor::decompress(const uint8_t *in, size_t length, uint8_t *frame, size_t capacity,
+									size_t &frame_length)
+{
+	frame_length = 0;
+
+	if(length < 2)
+	{
+		return TP_Frame_Compressor::COMPRESSOR_INVALID_FRAME;
+	}
+
+	uint8_t type = in[0] & 0xC0;
+	uint8_t sequence = in[0] & 0x3F;
+	bool delta = type == TP_Frame_Compressor::FRAME_DELTA;
+	size_t limit = capacity < _max_frame ? capacity : _max_frame;
+
+	if(delta && (!_reference_valid || sequence != _sequence))
+	{
+		return TP_Frame_Compressor::COMPRESSOR_OUT_OF_SEQUENCE;
+	}
+
+	if(type == TP_Frame_Compressor::FRAME_RAW)
+	{
+		if(length - 1 > limit)
+		{
+			return TP_Frame_Compressor::COMPRESSOR_BUFFER_TOO_SMALL;
+		}
+
+		memcpy(frame, &in[1], length - 1);
+		frame_length = length - 1;
+	}
+	else if(type == TP_Frame_Compressor::FRAME_KEY || delta)
+	{
+		if(delta && _reference_length < limit)
+		{
+			limit = _reference_length;
+		}
+
+		size_t index = 1;
+		size_t position = 0;
+
+		while(index < length)
+		{
+			uint8_t control = in[index++];
+			bool literal = control < 128;
+			size_t count = literal ? (size_t)control + 1 : (size_t)control - 127;
+
+			if(position + count > limit || (literal && length - index < count))
+			{
+				return TP_Frame_Compressor::COMPRESSOR_INVALID_FRAME;
+			}
+
+			for(size_t i = 0; i < count; i++, position++)
+			{
+				uint8_t value = literal ? in[index++] : 0;
+				frame[position] = delta ? value ^ _reference[position] : value;
+			}
+		}
+
+		if(delta && position != _reference_length)
+		{
+			return TP_Frame_Compressor::COMPRESSOR_INVALID_FRAME;
+		}
+
+		frame_length = position;
+	}
+	else
+	{
+		return TP_Frame_Compressor::COMPRESSOR_INVALID_FRAME;
+	}
+
+	memcpy(_reference, frame, frame_length);
+	_reference_length = frame_length;
+	_reference_valid = true;
+	_sequence = (sequence + 1) & 0x3F;
+	_since_key = delta ? _since_key + 1 : 0;
+
+	return TP_Frame_Compressor::COMPRESSOR_OK;
+}
+
+/** Run-length encode the XOR of frame and base, or frame itself if base
+ *  is NULL
+ *
+ * @param *frame Pointer to frame
+ * @param *base Pointer to previous frame of the same length, or NULL
+ * @param length Length of frame
+ * @param *out Pointer to output
+ * @param capacity Capacity of out in bytes
+ * @param &out_length Address of size_t in which to store encoded length
+ * @return Indicates success or failure reason
+ */
+int TP_Frame_Compressor::encode_runs(const uint8_t *frame, const uint8_t *base, size_t length,
+									 uint8_t *out, size_t capacity, size_t &out_length)
+{
+	size_t index = 0;
+	out_length = 0;
+
+	while(index < length)
+	{
+		size_t run = 0;
+		while(index + run < length && run < 128 && (frame[index + run] ^ (base ? base[index + run] : 0)) == 0)
+		{
+			run++;
+		}
+
+		/** A lone zero byte is cheaper carried in a literal
+		 */
+		if(run >= 2)
+		{
+			if(out_length >= capacity)
+			{
+				return TP_Frame_Compressor::COMPRESSOR_BUFFER_TOO_SMALL;
+			}
+
+			out[out_length++] = (uint8_t)(run + 127);
+			index += run;
+			continue;
+		}
+
+		size_t count = 0;
+		while(index + count < length && count < 128)
+		{
+			size_t next = index + count;
+			if(next + 1 < length && (frame[next] ^ (base ? base[next] : 0)) == 0 &&
+			   (frame[next + 1] ^ (base ? base[next + 1] : 0)) == 0)
+			{
+				break;
+			}
+
+			count++;
+		}
+
+		if(capacity - out_length < count + 1)
+		{
+			return TP_Frame_Compressor::COMPRESSOR_BUFFER_TOO_SMALL;
+		}
+
+		out[out_length++] = (uint8_t)(count - 1);
+
+		for(size_t i = 0; i < count; i++, index++)
+		{
+			out[out_length++] = frame[index] ^ (base ? base[index] : 0);
+		}
+	}
+
+	return TP_Frame_Compressor::COMPRESSOR_OK;
+}
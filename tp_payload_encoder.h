@@ -0,0 +1,311 @@
+/**
+  * @file    tp_payload_encoder.h
+  * @version 0.5.0
+  * @author  Adam Mitchell
+  * @brief   Header file of the payload encoding stage used ahead of coap_post(). A SenML
+  *          (RFC 8428) encoder writing CBOR into a caller-supplied arena and a delta
+  *          compressor for repeated sensor frames
+  */
+
+/** Define to prevent recursive inclusion
+ */
+#pragma once
+
+/** Includes
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/** An encoded payload ready to be sent, i.e. by coap_post(). data points
+ *  into the arena of the encoder that produced it
+ */
+struct TP_Encoded_Payload
+{
+	/** CoAP data format types of the u-blox AT interface, i.e. the value
+	 *  passed as data_indentifier to coap_post()
+	 */
+	enum
+	{
+		DATA_TEXT_PLAIN   = 0,
+		DATA_OCTET_STREAM = 3,
+		DATA_JSON         = 6,
+		DATA_CBOR         = 7
+	};
+
+	const uint8_t *data;
+	size_t length;
+	int data_identifier;
+};
+
+/** Encodes a SenML pack as CBOR into a caller-supplied arena. Integral
+ *  values are written as integers and other values as half or single
+ *  precision floats, whichever is the smallest to hold them exactly
+ */
+class TP_SenML_Encoder
+{
+
+	public:
+
+		/** Function return codes
+		 */
+		enum
+		{
+			ENCODER_OK               = 0,
+			ENCODER_BUFFER_TOO_SMALL = 90,
+			ENCODER_INVALID          = 91
+		};
+
+		/** Constructor for the TP_SenML_Encoder class
+		 *
+		 * @param *arena Pointer to the buffer into which the pack is written
+		 * @param capacity Capacity of arena in bytes
+		 */
+		TP_SenML_Encoder(uint8_t *arena, size_t capacity);
+
+		/** Start a new pack, discarding anything already written. The base fields
+		 *  are written into the first record, so *base_name and *base_unit must
+		 *  remain valid until it has been added
+		 *
+		 * @param *base_name Pointer to null terminated base name, i.e. a device
+		 *                   identifier, or NULL
+		 * @param base_time Base time in seconds, 0 for none
+		 * @param *base_unit Pointer to null terminated base unit, or NULL
+		 * @return Indicates success or failure reason
+		 */
+		int begin(const char *base_name = NULL, int64_t base_time = 0, const char *base_unit = NULL);
+
+		/** Add a record with a numeric value
+		 *
+		 * @param *name Pointer to null terminated name, appended to the base name
+		 * @param value Value
+		 * @param *unit Pointer to null terminated unit, or NULL
+		 * @param time Time relative to the base time in seconds, 0 for none
+		 * @return Indicates success or failure reason
+		 */
+		int add(const char *name, float value, const char *unit = NULL, int32_t time = 0);
+
+		/** Add a record with an integer value
+		 *
+		 * @param *name Pointer to null terminated name, appended to the base name
+		 * @param value Value
+		 * @param *unit Pointer to null terminated unit, or NULL
+		 * @param time Time relative to the base time in seconds, 0 for none
+		 * @return Indicates success or failure reason
+		 */
+		int add(const char *name, int32_t value, const char *unit = NULL, int32_t time = 0);
+
+		/** Add a record with a boolean value
+		 *
+		 * @param *name Pointer to null terminated name, appended to the base name
+		 * @param value Value
+		 * @param time Time relative to the base time in seconds, 0 for none
+		 * @return Indicates success or failure reason
+		 */
+		int add_bool(const char *name, bool value, int32_t time = 0);
+
+		/** Add a record with a string value
+		 *
+		 * @param *name Pointer to null terminated name, appended to the base name
+		 * @param *value Pointer to null terminated value
+		 * @param time Time relative to the base time in seconds, 0 for none
+		 * @return Indicates success or failure reason
+		 */
+		int add_string(const char *name, const char *value, int32_t time = 0);
+
+		/** Close the pack and describe it for sending
+		 *
+		 * @param &payload Address of TP_Encoded_Payload in which to store the
+		 *                 pack and its data format, DATA_CBOR
+		 * @return Indicates success or failure reason
+		 */
+		int finish(TP_Encoded_Payload &payload);
+
+	private:
+
+		/** SenML CBOR labels, RFC 8428 table 4
+		 */
+		enum
+		{
+			LABEL_BASE_NAME    = -2,
+			LABEL_BASE_TIME    = -3,
+			LABEL_BASE_UNIT    = -4,
+			LABEL_NAME         = 0,
+			LABEL_UNIT         = 1,
+			LABEL_VALUE        = 2,
+			LABEL_STRING_VALUE = 3,
+			LABEL_BOOL_VALUE   = 4,
+			LABEL_TIME         = 6
+		};
+
+		/** Kinds of record value
+		 */
+		enum class TP_SenML_Value
+		{
+			FLOAT,
+			INTEGER,
+			BOOLEAN,
+			STRING
+		};
+
+		/** Write one record, rewinding the arena if it does not fit
+		 *
+		 * @param *name Pointer to null terminated name, or NULL
+		 * @param *unit Pointer to null terminated unit, or NULL
+		 * @param time Relative time, 0 for none
+		 * @param kind Kind of value
+		 * @param number Numeric or boolean value
+		 * @param integer Integer value
+		 * @param *string Pointer to null terminated string value
+		 * @return Indicates success or failure reason
+		 */
+		int add_record(const char *name, const char *unit, int32_t time, TP_SenML_Value kind,
+					   float number, int32_t integer, const char *string);
+
+		/** Write a CBOR initial byte and argument
+		 *
+		 * @param major CBOR major type
+		 * @param value Argument
+		 * @return None
+		 */
+		void write_head(uint8_t major, uint64_t value);
+
+		/** Write a CBOR integer
+		 *
+		 * @param value Value
+		 * @return None
+		 */
+		void write_int(int64_t value);
+
+		/** Write a CBOR text string
+		 *
+		 * @param *text Pointer to null terminated string
+		 * @return None
+		 */
+		void write_text(const char *text);
+
+		/** Write a float in the fewest bytes that hold it exactly
+		 *
+		 * @param value Value
+		 * @return None
+		 */
+		void write_float(float value);
+
+		/** Write raw bytes
+		 *
+		 * @param *data Pointer to bytes
+		 * @param length Number of bytes
+		 * @return None
+		 */
+		void write_bytes(const uint8_t *data, size_t length);
+
+		uint8_t *_arena;
+		size_t _capacity;
+		size_t _length = 0;
+		bool _overflow = false;
+		uint16_t _records = 0;
+		const char *_base_name = NULL;
+		const char *_base_unit = NULL;
+		int64_t _base_time = 0;
+};
+
+/** Compresses frames that change little from one to the next, i.e. fixed
+ *  layout sensor readings. Each frame is XORed with the previous one and
+ *  runs of zero bytes are collapsed, with a key frame sent every
+ *  key_interval frames or whenever the frame length changes. The previous
+ *  frame is held in a caller-supplied reference buffer
+ *
+ *  Encoded frames start with a header byte, the frame type in bits 7 and 6
+ *  and a 6 bit sequence number. A control byte c of 0 to 127 is followed
+ *  by c + 1 literal bytes, c of 128 to 255 stands for c - 127 zero bytes
+ */
+class TP_Frame_Compressor
+{
+
+	public:
+
+		/** Function return codes
+		 */
+		enum
+		{
+			COMPRESSOR_OK               = 0,
+			COMPRESSOR_BUFFER_TOO_SMALL = 92,
+			COMPRESSOR_INVALID_FRAME    = 93,
+			COMPRESSOR_OUT_OF_SEQUENCE  = 94
+		};
+
+		/** Constructor for the TP_Frame_Compressor class
+		 *
+		 * @param *reference Pointer to a buffer of max_frame bytes in which the
+		 *                   previous frame is kept
+		 * @param max_frame Largest frame that will be compressed
+		 * @param key_interval Number of frames between key frames, so that a
+		 *                     lost uplink is recovered from, 1 for key frames only
+		 */
+		TP_Frame_Compressor(uint8_t *reference, size_t max_frame, uint8_t key_interval = 16);
+
+		/** Forget the previous frame so that the next is sent as a key frame
+		 *
+		 * @return None
+		 */
+		void reset();
+
+		/** Compress a frame
+		 *
+		 * @param *frame Pointer to frame
+		 * @param length Length of frame, no greater than max_frame
+		 * @param *out Pointer to buffer into which to write the compressed frame.
+		 *             length + 2 bytes is always enough
+		 * @param capacity Capacity of out in bytes
+		 * @param &payload Address of TP_Encoded_Payload in which to store the
+		 *                 compressed frame and its data format, DATA_OCTET_STREAM
+		 * @return Indicates success or failure reason
+		 */
+		int compress(const uint8_t *frame, size_t length, uint8_t *out, size_t capacity,
+					 TP_Encoded_Payload &payload);
+
+		/** Decompress a frame produced by compress(), i.e. on the receiving side
+		 *  or to check an uplink. Uses the reference buffer in the same way
+		 *
+		 * @param *in Pointer to compressed frame
+		 * @param length Length of compressed frame
+		 * @param *frame Pointer to buffer into which to write the frame
+		 * @param capacity Capacity of frame in bytes
+		 * @param &frame_length Address of size_t in which to store the frame length
+		 * @return Indicates success or failure reason
+		 */
+		int decompress(const uint8_t *in, size_t length, uint8_t *frame, size_t capacity,
+					   size_t &frame_length);
+
+	private:
+
+		/** Frame types, bits 7 and 6 of the header byte
+		 */
+		enum
+		{
+			FRAME_KEY   = 0x00,
+			FRAME_DELTA = 0x40,
+			FRAME_RAW   = 0x80
+		};
+
+		/** Run-length encode the XOR of frame and base, or frame itself if base
+		 *  is NULL
+		 *
+		 * @param *frame Pointer to frame
+		 * @param *base Pointer to previous frame of the same length, or NULL
+		 * @param length Length of frame
+		 * @param *out Pointer to output
+		 * @param capacity Capacity of out in bytes
+		 * @param &out_length Address of size_t in which to store encoded length
+		 * @return Indicates success or failure reason
+		 */
+		static int encode_runs(const uint8_t *frame, const uint8_t *base, size_t length,
+							   uint8_t *out, size_t capacity, size_t &out_length);
+
+		uint8_t *_reference;
+		size_t _max_frame;
+		uint8_t _key_interval;
+		size_t _reference_length = 0;
+		bool _reference_valid = false;
+		uint8_t _sequence = 0;
+		uint8_t _since_key = 0;
+};